@@ -38,6 +38,7 @@
 #include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
 #include <optional>
 
 #include "llvm/Passes/PassBuilder.h"
@@ -46,14 +47,18 @@
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/InstrTypes.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Metadata.h"
+#include "llvm/IR/Operator.h"
 
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Transforms/Scalar.h"
 
 #include "llvm/Analysis/BasicAliasAnalysis.h"
@@ -62,7 +67,9 @@
 #include "llvm/Analysis/InlineCost.h"
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/AbstractCallSite.h"
+#include "llvm/Demangle/Demangle.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/Cloning.h"
@@ -96,12 +103,51 @@ llvm::cl::opt<std::string>
     RaptorTruncateAll("raptor-truncate-all", cl::init(""), cl::Hidden,
                       cl::desc("Truncate all floating point operations."));
 
+llvm::cl::opt<std::string> RaptorTruncateConfig(
+    "raptor-truncate-config", cl::init(""), cl::Hidden,
+    cl::desc("Truncate the floating point operations of the functions listed "
+             "in the given file, one '<function> <from>-<to>' per line, as "
+             "written by the range profile. '<from>-<to>+<acc>' rounds sums "
+             "into accumulators to <acc>."));
+
 llvm::cl::opt<bool> RaptorTruncateCount(
     "raptor-truncate-count", cl::init(false), cl::Hidden,
     cl::desc("Count all non-truncated floating point operations."));
 llvm::cl::opt<bool> RaptorTruncateAccessCount(
     "raptor-truncate-access-count", cl::init(false), cl::Hidden,
     cl::desc("Count all floating-point loads and stores."));
+llvm::cl::opt<bool> RaptorTruncateAccessCountMemIntrinsics(
+    "raptor-truncate-access-count-mem-intrinsics", cl::init(false), cl::Hidden,
+    cl::desc("Also count memcpy, memmove and memset of floating-point arrays "
+             "when counting floating-point loads and stores."));
+llvm::cl::opt<bool> RaptorTruncateAccessTrace(
+    "raptor-truncate-access-trace", cl::init(false), cl::Hidden,
+    cl::desc("Pass the address of every floating-point load and store to the "
+             "cache simulator in the runtime."));
+llvm::cl::opt<bool> RaptorTrackAllocations(
+    "raptor-track-allocations", cl::init(false), cl::Hidden,
+    cl::desc("Register heap allocations with the runtime to attribute "
+             "floating-point memory traffic to allocation sites."));
+llvm::cl::opt<bool> RaptorFlopReport(
+    "raptor-flop-report", cl::init(false), cl::Hidden,
+    cl::desc("Count floating-point operations and memory traffic per function "
+             "and loop for the arithmetic intensity (roofline) report."));
+llvm::cl::opt<unsigned> RaptorCancellationCount(
+    "raptor-cancellation-count", cl::init(0), cl::Hidden,
+    cl::desc("Count the fadd and fsub results whose exponent is at least N "
+             "below the larger operand exponent, per site and by bits lost. 0 "
+             "disables it."));
+llvm::cl::opt<unsigned> RaptorContextDepth(
+    "raptor-context-depth", cl::init(0), cl::Hidden,
+    cl::desc("Keep a per-thread stack of the truncated functions entered and "
+             "key shadow errors by their innermost N as well as by source "
+             "location. 0 disables it."));
+
+llvm::cl::opt<bool> RaptorRangeProfile(
+    "raptor-range-profile", cl::init(false), cl::Hidden,
+    cl::desc("Record the magnitudes and significant bits of the floating-point "
+             "values of every function to recommend a truncation per "
+             "function."));
 
 void addNoCapture(CallInst *CI, unsigned ArgNo) {
 #if LLVM_VERSION_MAJOR >= 21
@@ -544,8 +590,10 @@ public:
           Constructor((unsigned)Cto->getValue().getZExtValue());
       return {FloatTruncation(FRFrom, FRTo, Mode), 3};
 
-    } else if (Cty->getValue().getZExtValue() == FloatRepresentation::MPFR) {
-      if (ArgNum != 5)
+    } else if (Cty->getValue().getZExtValue() == FloatRepresentation::MPFR ||
+               Cty->getValue().getZExtValue() ==
+                   FloatRepresentation::MPFRStochastic) {
+      if (ArgNum != 5 && ArgNum != 7)
         EmitFailure("WrongArgNum", CI->getDebugLoc(), CI,
                     "Wrong number of arguments for MPFR type");
       auto Ctoe = cast<ConstantInt>(CI->getArgOperand(ArgOffset + 2));
@@ -556,12 +604,41 @@ public:
       if (!Ctos)
         EmitFailure("NotConstant", CI->getDebugLoc(), CI,
                     "Expected MPFR significand width to be constant");
+      FloatRepresentation (*Constructor)(unsigned, unsigned) =
+          FloatRepresentation::getMPFR;
+      if (Cty->getValue().getZExtValue() ==
+          FloatRepresentation::MPFRStochastic) {
+        if (Mode == TruncOpMode || Mode == TruncOpFullModuleMode)
+          Constructor = FloatRepresentation::getMPFRStochastic;
+        else
+          EmitWarning("UnsupportedTruncation", *CI,
+                      "Stochastic rounding is only supported in op mode, "
+                      "switching to rounding to nearest.");
+      }
+      // Optionally followed by the exponent and significand width of the
+      // format accumulations are rounded to.
+      std::optional<FloatRepresentation> FRAcc;
+      if (ArgNum == 7) {
+        auto Cacce = dyn_cast<ConstantInt>(CI->getArgOperand(ArgOffset + 4));
+        auto Caccs = dyn_cast<ConstantInt>(CI->getArgOperand(ArgOffset + 5));
+        if (!Cacce || !Caccs)
+          EmitFailure("NotConstant", CI->getDebugLoc(), CI,
+                      "Expected accumulator widths to be constant");
+        if (Mode == TruncOpMode || Mode == TruncOpFullModuleMode)
+          FRAcc = FloatRepresentation::getMPFR(
+              (unsigned)Cacce->getValue().getZExtValue(),
+              (unsigned)Caccs->getValue().getZExtValue());
+        else
+          EmitWarning("UnsupportedTruncation", *CI,
+                      "Accumulator formats are only supported in op mode, "
+                      "ignoring the accumulator format.");
+      }
       return {FloatTruncation(FRFrom,
-                              FloatRepresentation::getMPFR(
+                              Constructor(
                                   (unsigned)Ctoe->getValue().getZExtValue(),
                                   (unsigned)Ctos->getValue().getZExtValue()),
-                              Mode),
-              4};
+                              Mode, FRAcc),
+              ArgNum == 7 ? 6 : 4};
     }
 
     EmitFailure("NotConstant", CI->getDebugLoc(), CI, "Unknown float type");
@@ -582,11 +659,13 @@ public:
 
     RequestContext context(CI, &Builder);
     for (auto FR :
-         {/* FloatRepresentation::getIEEE(16), */ FloatRepresentation::getIEEE(
-              32),
-          FloatRepresentation::getIEEE(64)}) {
+         {FloatRepresentation::getBFloat(), FloatRepresentation::getIEEE(16),
+          FloatRepresentation::getIEEE(32), FloatRepresentation::getIEEE(64)}) {
+      // (value, location, op kind, operand index), see raptor/LogFormat.h.
       FunctionType *Ty = FunctionType::get(
-          Builder.getVoidTy(), FR.getMustBeBuiltinType(Builder.getContext()),
+          Builder.getVoidTy(),
+          {FR.getMustBeBuiltinType(Builder.getContext()), Builder.getPtrTy(),
+           Builder.getInt8Ty(), Builder.getInt8Ty()},
           false);
       FunctionCallee FlopLogger = CI->getModule()->getOrInsertFunction(
           std::string(RaptorPrefix) + "log_flops_" + FR.getMangling(), Ty);
@@ -611,10 +690,10 @@ public:
     if (!F)
       return false;
     unsigned ArgNum = CI->arg_size();
-    if (ArgNum != 4 && ArgNum != 5) {
+    if (ArgNum != 4 && ArgNum != 5 && ArgNum != 7) {
       EmitFailure("TooManyArgs", CI->getDebugLoc(), CI,
                   "Had incorrect number of args to __raptor_truncate_func", *CI,
-                  " - expected 4 or 5");
+                  " - expected 4, 5 or 7");
       return false;
     }
     auto [Truncation, NumArgsParsed] = parseTruncation(CI, Mode, 1);
@@ -647,6 +726,39 @@ public:
     return Logic.CreateTruncateValue(context, Addr, Truncation, isTruncate);
   }
 
+  // Whether every scalar reachable in Ty is floating point, e.g. double,
+  // <4 x float>, [16 x double] or { double, double }.
+  static bool isFPOnlyType(Type *Ty) {
+    if (Ty->isFPOrFPVectorTy())
+      return true;
+    if (auto AT = dyn_cast<ArrayType>(Ty))
+      return isFPOnlyType(AT->getElementType());
+    if (auto ST = dyn_cast<StructType>(Ty)) {
+      if (ST->isOpaque() || ST->getNumElements() == 0)
+        return false;
+      return llvm::all_of(ST->elements(), isFPOnlyType);
+    }
+    return false;
+  }
+
+  // Whether ptr points into floating point data as far as we can tell from the
+  // pointer itself. This is only used for memory intrinsics which carry no
+  // element type.
+  static bool pointsToFPData(Value *ptr) {
+    ptr = ptr->stripPointerCasts();
+    if (auto GEP = dyn_cast<GEPOperator>(ptr))
+      return isFPOnlyType(GEP->getResultElementType());
+    auto Obj = getUnderlyingObject(ptr);
+    if (auto AI = dyn_cast<AllocaInst>(Obj))
+      return isFPOnlyType(AI->getAllocatedType());
+    if (auto GV = dyn_cast<GlobalVariable>(Obj))
+      return isFPOnlyType(GV->getValueType());
+    return false;
+  }
+
+  // Count the bytes of floating point data loaded and stored. The sizes are
+  // summed per basic block at compile time so that we emit a single runtime
+  // call per block instead of one per access.
   bool handleFlopMemory(Function &F) {
     if (F.isDeclaration())
       return false;
@@ -659,46 +771,222 @@ public:
     auto M = F.getParent();
     auto &DL = M->getDataLayout();
     IRBuilder<> B(M->getContext());
+    Type *I64Ty = B.getInt64Ty();
 
-    auto fname = std::string(RaptorFPRTPrefix) + "memory_access";
+    auto fname = std::string(RaptorFPRTPrefix) + "memory_access_block";
     Function *AccessF = M->getFunction(fname);
-    Type *PtrTy = PointerType::get(M->getContext(), 0);
     if (!AccessF) {
       FunctionType *FnTy =
-          FunctionType::get(Type::getVoidTy(M->getContext()),
-                            {PtrTy, Type::getInt64Ty(M->getContext()),
-                             Type::getInt64Ty(M->getContext())},
+          FunctionType::get(Type::getVoidTy(M->getContext()), {I64Ty, I64Ty},
                             /*is_vararg*/ false);
       AccessF = Function::Create(FnTy, Function::ExternalLinkage, fname, M);
     }
 
+    bool changed = false;
     for (auto &BB : F) {
+      uint64_t staticLoad = 0, staticStore = 0;
+      SmallVector<TypeSize, 1> scalableLoad, scalableStore;
+      SmallVector<Value *, 1> dynamicLoad, dynamicStore;
+
+      auto addAccess = [&](Type *ty, bool isLoad, bool isStore) {
+        TypeSize size = DL.getTypeStoreSize(ty);
+        if (size.isScalable()) {
+          if (isLoad)
+            scalableLoad.push_back(size);
+          if (isStore)
+            scalableStore.push_back(size);
+          return;
+        }
+        if (isLoad)
+          staticLoad += size.getFixedValue();
+        if (isStore)
+          staticStore += size.getFixedValue();
+      };
+      auto addMemIntrinsic = [&](Value *length, bool isLoad) {
+        if (auto CI = dyn_cast<ConstantInt>(length)) {
+          if (isLoad)
+            staticLoad += CI->getZExtValue();
+          staticStore += CI->getZExtValue();
+          return;
+        }
+        if (isLoad)
+          dynamicLoad.push_back(length);
+        dynamicStore.push_back(length);
+      };
+
       for (auto &I : BB) {
-        uint64_t isStore;
-        Type *ty;
-        Value *ptr;
         if (auto load = dyn_cast<LoadInst>(&I)) {
-          isStore = false;
-          ty = load->getType();
-          ptr = load->getPointerOperand();
+          if (load->getType()->isFPOrFPVectorTy())
+            addAccess(load->getType(), true, false);
         } else if (auto store = dyn_cast<StoreInst>(&I)) {
-          isStore = true;
-          ty = store->getValueOperand()->getType();
-          ptr = store->getPointerOperand();
-        } else {
+          Type *ty = store->getValueOperand()->getType();
+          if (ty->isFPOrFPVectorTy())
+            addAccess(ty, false, true);
+        } else if (auto RMW = dyn_cast<AtomicRMWInst>(&I)) {
+          if (RMW->getType()->isFPOrFPVectorTy())
+            addAccess(RMW->getType(), true, true);
+        } else if (!RaptorTruncateAccessCountMemIntrinsics) {
           continue;
+        } else if (auto MT = dyn_cast<MemTransferInst>(&I)) {
+          if (pointsToFPData(MT->getRawDest()) ||
+              pointsToFPData(MT->getRawSource()))
+            addMemIntrinsic(MT->getLength(), true);
+        } else if (auto MS = dyn_cast<MemSetInst>(&I)) {
+          if (pointsToFPData(MS->getRawDest()))
+            addMemIntrinsic(MS->getLength(), false);
         }
-        uint64_t size = DL.getTypeStoreSize(ty);
-        CallInst::Create(AccessF,
-                         {B.CreateAddrSpaceCast(ptr, PtrTy), B.getInt64(size),
-                          B.getInt64(isStore)},
-                         "", I.getIterator());
+      }
+
+      if (!staticLoad && !staticStore && scalableLoad.empty() &&
+          scalableStore.empty() && dynamicLoad.empty() && dynamicStore.empty())
+        continue;
+
+      // Everything counted above dominates the terminator. A musttail call
+      // must stay immediately before its return so we go in front of it.
+      Instruction *InsertPt = BB.getTerminator();
+      if (auto CI = BB.getTerminatingMustTailCall())
+        InsertPt = CI;
+      B.SetInsertPoint(InsertPt);
+
+      auto sum = [&](uint64_t staticSize, ArrayRef<TypeSize> scalable,
+                     ArrayRef<Value *> dynamic) {
+        Value *total = B.getInt64(staticSize);
+        for (auto size : scalable)
+          total = B.CreateAdd(total, B.CreateTypeSize(I64Ty, size));
+        for (auto length : dynamic)
+          total = B.CreateAdd(total, B.CreateZExtOrTrunc(length, I64Ty));
+        return total;
+      };
+      B.CreateCall(AccessF, {sum(staticLoad, scalableLoad, dynamicLoad),
+                             sum(staticStore, scalableStore, dynamicStore)});
+      changed = true;
+    }
+
+    return changed;
+  }
+
+  // Unlike handleFlopMemory this needs the address of every access, so we
+  // emit one runtime call per floating point load and store. The scalar width
+  // and the object the pointer is derived from let the runtime remap the
+  // access to a narrower element type within its array.
+  bool handleFlopTrace(Function &F) {
+    if (F.isDeclaration())
+      return false;
+    if (!RaptorTruncateAccessTrace)
+      return false;
+
+    if (F.getName().starts_with(RaptorFPRTPrefix))
+      return false;
+
+    struct Access {
+      Instruction *I;
+      Value *Ptr;
+      Type *Ty;
+      bool IsStore;
+    };
+    SmallVector<Access, 16> Accesses;
+    for (auto &I : instructions(F)) {
+      if (auto load = dyn_cast<LoadInst>(&I)) {
+        if (load->getType()->isFPOrFPVectorTy())
+          Accesses.push_back(
+              {load, load->getPointerOperand(), load->getType(), false});
+      } else if (auto store = dyn_cast<StoreInst>(&I)) {
+        Type *ty = store->getValueOperand()->getType();
+        if (ty->isFPOrFPVectorTy())
+          Accesses.push_back({store, store->getPointerOperand(), ty, true});
+      } else if (auto RMW = dyn_cast<AtomicRMWInst>(&I)) {
+        if (RMW->getType()->isFPOrFPVectorTy())
+          Accesses.push_back(
+              {RMW, RMW->getPointerOperand(), RMW->getType(), true});
       }
     }
+    // The simulator models the host caches only.
+    llvm::erase_if(Accesses, [](const Access &A) {
+      return A.Ptr->getType()->getPointerAddressSpace() != 0;
+    });
+    if (Accesses.empty())
+      return false;
 
+    auto M = F.getParent();
+    auto &DL = M->getDataLayout();
+    IRBuilder<> B(M->getContext());
+    Type *I64Ty = B.getInt64Ty();
+    Type *PtrTy = B.getPtrTy();
+
+    auto fname = std::string(RaptorFPRTPrefix) + "memory_trace";
+    Function *TraceF = M->getFunction(fname);
+    if (!TraceF) {
+      FunctionType *FnTy = FunctionType::get(
+          Type::getVoidTy(M->getContext()),
+          {PtrTy, I64Ty, I64Ty, I64Ty, PtrTy, PtrTy},
+          /*is_vararg*/ false);
+      TraceF = Function::Create(FnTy, Function::ExternalLinkage, fname, M);
+    }
+    Constant *FName = createPrivateGlobalForString(
+        *M, llvm::demangle(F.getName().str()), true);
+
+    for (auto &A : Accesses) {
+      B.SetInsertPoint(A.I);
+      B.CreateCall(TraceF, {A.Ptr,
+                            B.CreateTypeSize(I64Ty, DL.getTypeStoreSize(A.Ty)),
+                            B.getInt64(A.IsStore),
+                            B.getInt64(A.Ty->getScalarSizeInBits()),
+                            getUnderlyingObject(A.Ptr), FName});
+    }
     return true;
   }
 
+  bool handleAllocations(Function &F) {
+    if (F.isDeclaration())
+      return false;
+    if (!RaptorTrackAllocations)
+      return false;
+
+    if (F.getName().starts_with(RaptorFPRTPrefix))
+      return false;
+
+    // With the access trace the cache simulator attributes the accesses.
+    return Logic.TrackAllocationsInFunc(&F, !RaptorTruncateAccessTrace);
+  }
+
+  bool handleFlopReport(Function &F) {
+    if (F.isDeclaration())
+      return false;
+    if (!RaptorFlopReport)
+      return false;
+
+    if (F.getName().starts_with(RaptorFPRTPrefix))
+      return false;
+
+    return Logic.ReportInFunc(&F);
+  }
+
+  // Runs after the truncations were lowered, so it also sees the ops of the
+  // functions truncated to native types.
+  bool handleCancellationCount(Function &F) {
+    if (F.isDeclaration())
+      return false;
+    if (!RaptorCancellationCount)
+      return false;
+
+    if (F.getName().starts_with(RaptorFPRTPrefix))
+      return false;
+
+    return Logic.CountCancellationInFunc(&F, RaptorCancellationCount);
+  }
+
+  bool handleRangeProfile(Function &F) {
+    if (F.isDeclaration())
+      return false;
+    if (!RaptorRangeProfile)
+      return false;
+
+    if (F.getName().starts_with(RaptorFPRTPrefix))
+      return false;
+
+    return Logic.ProfileRangeInFunc(&F);
+  }
+
   bool handleFlopCount(Function &F) {
     if (F.isDeclaration())
       return false;
@@ -709,8 +997,8 @@ public:
       return false;
 
     for (auto Repr :
-         {FloatRepresentation::getIEEE(16), FloatRepresentation::getIEEE(32),
-          FloatRepresentation::getIEEE(64)})
+         {FloatRepresentation::getBFloat(), FloatRepresentation::getIEEE(16),
+          FloatRepresentation::getIEEE(32), FloatRepresentation::getIEEE(64)})
       Logic.CountInFunc(&F, Repr);
     return true;
   }
@@ -721,37 +1009,59 @@ public:
     typedef std::vector<FloatTruncation> TruncationsTy;
     static TruncationsTy FullModuleTruncs = []() -> TruncationsTy {
       StringRef ConfigStr(RaptorTruncateAll);
-      auto Invalid = [=]() {
-        // TODO emit better diagnostic
-        llvm::report_fatal_error("error: invalid format for truncation config");
-      };
 
       // Parse "ieee(64)-mpfr(11, 13);ieee(32)-ieee(16)"
       TruncationsTy Tmp;
-      while (true) {
-        if (ConfigStr.empty())
-          break;
-        auto From = FloatRepresentation::parse(ConfigStr);
-        if (!From)
-          Invalid();
-        if (ConfigStr.empty())
-          Invalid();
-        if (!ConfigStr.consume_front("-"))
-          Invalid();
-        auto To = FloatRepresentation::parse(ConfigStr);
-        if (!To)
-          Invalid();
-        Tmp.push_back({*From, *To, TruncOpFullModuleMode});
+      while (!ConfigStr.empty()) {
+        auto Truncation =
+            FloatTruncation::parse(ConfigStr, TruncOpFullModuleMode);
+        // TODO emit better diagnostic
+        if (!Truncation)
+          llvm::report_fatal_error(
+              "error: invalid format for truncation config");
+        Tmp.push_back(*Truncation);
         ConfigStr.consume_front(";");
       }
       return Tmp;
     }();
+    // Per function truncations from -raptor-truncate-config, which take
+    // precedence over -raptor-truncate-all.
+    static StringMap<TruncationsTy> FunctionTruncs = []() {
+      StringMap<TruncationsTy> Tmp;
+      if (RaptorTruncateConfig.empty())
+        return Tmp;
+      auto Buf = MemoryBuffer::getFile(RaptorTruncateConfig);
+      if (!Buf)
+        llvm::report_fatal_error("error: could not read truncation config '" +
+                                 Twine(RaptorTruncateConfig) +
+                                 "': " + Buf.getError().message());
+      // One "<function> <from>-<to>" per line, # starts a comment.
+      SmallVector<StringRef> Lines;
+      (*Buf)->getBuffer().split(Lines, '\n');
+      for (auto &&[LineNo, Line] : llvm::enumerate(Lines)) {
+        StringRef Str = Line.split('#').first.trim();
+        if (Str.empty())
+          continue;
+        auto [Name, Rest] = getToken(Str);
+        Rest = Rest.trim();
+        auto Truncation = FloatTruncation::parse(Rest, TruncOpFullModuleMode);
+        if (!Truncation || !Rest.empty())
+          llvm::report_fatal_error("error: invalid truncation config at " +
+                                   Twine(RaptorTruncateConfig) + ":" +
+                                   Twine(LineNo + 1));
+        Tmp[Name].push_back(*Truncation);
+      }
+      return Tmp;
+    }();
 
-    if (FullModuleTruncs.empty())
+    auto It = FunctionTruncs.find(F.getName());
+    const TruncationsTy &Truncs =
+        It != FunctionTruncs.end() ? It->second : FullModuleTruncs;
+    if (Truncs.empty())
       return false;
 
     // TODO sort truncations (64to32, then 32to16 will make everything 16)
-    for (auto Truncation : FullModuleTruncs) {
+    for (auto Truncation : Truncs) {
       IRBuilder<> Builder(F.getContext());
       RequestContext context(&*F.getEntryBlock().begin(), &Builder);
       Function *TruncatedFunc =
@@ -774,7 +1084,8 @@ public:
   }
 
   bool lowerRaptorCalls(Function &F, std::set<Function *> &done) {
-    if (!RaptorTruncateAll.empty() && RaptorTruncateCount)
+    if ((!RaptorTruncateAll.empty() || !RaptorTruncateConfig.empty()) &&
+        RaptorTruncateCount)
       llvm::report_fatal_error(
           "error: trunc all and trunc count are incompatible");
 
@@ -1219,6 +1530,9 @@ public:
 
     for (Function &F : M) {
       changed |= handleFlopMemory(F);
+      changed |= handleFlopTrace(F);
+      changed |= handleAllocations(F);
+      changed |= handleFlopReport(F);
     }
 
     std::set<Function *> done;
@@ -1231,6 +1545,8 @@ public:
 
     for (Function &F : M) {
       changed |= handleFlopCount(F);
+      changed |= handleCancellationCount(F);
+      changed |= handleRangeProfile(F);
     }
 
     Logic.clear();
@@ -11,6 +11,7 @@
 //===----------------------------------------------------------------------===//
 #include "RaptorLogic.h"
 #include "Utils.h"
+#include "raptor/Report.h"
 #include "llvm-c/Core.h"
 #include "llvm/IR/AbstractCallSite.h"
 #include "llvm/IR/Constant.h"
@@ -24,10 +25,12 @@
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Transforms/Utils/Instrumentation.h"
 #include <array>
 #include <cmath>
+#include <optional>
 #include <tuple>
 
 #include "llvm/Analysis/ScalarEvolution.h"
@@ -38,6 +41,7 @@
 
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/InstIterator.h"
@@ -46,6 +50,7 @@
 #include "llvm/IR/Verifier.h"
 
 #include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Analysis/ValueTracking.h"
 
@@ -218,38 +223,84 @@ public:
     Args.push_back(V);
     return createFPRTGeneric(B, "delete", Args, B.getVoidTy(), UnknownLoc);
   }
-  // This will result in a unique string for each location, which means the
-  // runtime can check whether two operations are the same with a simple pointer
-  // comparison. However, we need LTO for this to be the case across different
-  // compilation units.
-  // TODO is there some linker hackery that can merge the symbols with the same
-  // content at linking time?
   GlobalValue *getUniquedLocStr(Instruction *I) {
-    std::string FileName = "unknown";
-    unsigned LineNo = 0;
-    unsigned ColNo = 0;
-
-    if (I) {
-      DILocation *DL = I->getDebugLoc();
-      if (DL) {
-        FileName = DL->getFilename();
-        LineNo = DL->getLine();
-        ColNo = DL->getColumn();
+    return Logic.getUniquedLocStr(*M, I);
+  }
+  // The operands of I that carry an accumulator through it, if I can be a
+  // link of a reduction: both of an fadd, the minuend of an fsub and the
+  // addend of fmuladd and fma.
+  static bool getAccOperands(Value *V, SmallVectorImpl<unsigned> &Ops) {
+    if (auto II = dyn_cast<IntrinsicInst>(V)) {
+      if (II->getIntrinsicID() != Intrinsic::fmuladd &&
+          II->getIntrinsicID() != Intrinsic::fma)
+        return false;
+      Ops.push_back(2);
+      return true;
+    }
+    auto BO = dyn_cast<BinaryOperator>(V);
+    if (!BO || (BO->getOpcode() != Instruction::FAdd &&
+                BO->getOpcode() != Instruction::FSub))
+      return false;
+    Ops.push_back(0);
+    if (BO->getOpcode() == Instruction::FAdd)
+      Ops.push_back(1);
+    return true;
+  }
+  // Whether I adds into an accumulator: fmuladd and fma, or an fadd or fsub
+  // on a chain of links from a phi back into the same phi, i.e. a loop
+  // reduction such as p = phi(..., t2), t1 = p + x, t2 = t1 + y.
+  static bool isAccumulation(Instruction &I) {
+    if (auto II = dyn_cast<IntrinsicInst>(&I))
+      return II->getIntrinsicID() == Intrinsic::fmuladd ||
+             II->getIntrinsicID() == Intrinsic::fma;
+    SmallVector<unsigned, 2> Ops;
+    if (!getAccOperands(&I, Ops))
+      return false;
+    // Longer chains are rare and not worth the walk.
+    constexpr unsigned MaxLinks = 16;
+
+    // The phis the accumulator of I comes from.
+    SmallPtrSet<PHINode *, 4> From;
+    SmallPtrSet<Value *, 16> Seen;
+    SmallVector<Value *, 16> Worklist = {&I};
+    while (!Worklist.empty() && Seen.size() < MaxLinks) {
+      Value *V = Worklist.pop_back_val();
+      if (!Seen.insert(V).second)
+        continue;
+      SmallVector<unsigned, 2> LinkOps;
+      getAccOperands(V, LinkOps);
+      for (unsigned Idx : LinkOps) {
+        Value *Op = cast<User>(V)->getOperand(Idx);
+        SmallVector<unsigned, 2> Unused;
+        if (auto PN = dyn_cast<PHINode>(Op))
+          From.insert(PN);
+        else if (getAccOperands(Op, Unused))
+          Worklist.push_back(Op);
       }
     }
+    if (From.empty())
+      return false;
 
-    auto Key = std::make_tuple(FileName, LineNo, ColNo);
-    auto It = Logic.UniqDebugLocStrs.find(Key);
-
-    if (It != Logic.UniqDebugLocStrs.end())
-      return It->second;
-
-    std::string LocStr =
-        FileName + ":" + std::to_string(LineNo) + ":" + std::to_string(ColNo);
-    auto GV = createPrivateGlobalForString(*M, LocStr, true);
-    Logic.UniqDebugLocStrs[Key] = GV;
-
-    return GV;
+    // And whether it flows on into one of them.
+    Seen.clear();
+    Worklist = {&I};
+    while (!Worklist.empty() && Seen.size() < MaxLinks) {
+      Value *V = Worklist.pop_back_val();
+      if (!Seen.insert(V).second)
+        continue;
+      for (Use &U : V->uses()) {
+        if (auto PN = dyn_cast<PHINode>(U.getUser())) {
+          if (From.count(PN))
+            return true;
+          continue;
+        }
+        SmallVector<unsigned, 2> LinkOps;
+        if (getAccOperands(U.getUser(), LinkOps) &&
+            is_contained(LinkOps, U.getOperandNo()))
+          Worklist.push_back(U.getUser());
+      }
+    }
+    return false;
   }
   CallInst *createFPRTOpCall(llvm::IRBuilderBase &B, llvm::Instruction &I,
                              llvm::Type *RetTy,
@@ -278,6 +329,12 @@ public:
       llvm_unreachable("Unexpected instruction for conversion to FPRT");
     }
     createOriginalFPRTFunc(I, Name, ArgsIn, RetTy);
+    if (!TC.AccArgs.empty() && isAccumulation(I)) {
+      SmallVector<Value *, 5> Args(ArgsIn.begin(), ArgsIn.end());
+      Args.append(TC.AccArgs);
+      return createFPRTGeneric(B, Name + "_acc", Args, RetTy,
+                               getUniquedLocStr(&I));
+    }
     return createFPRTGeneric(B, Name, ArgsIn, RetTy, getUniquedLocStr(&I));
   }
 };
@@ -384,6 +441,146 @@ public:
   }
 };
 
+// Gathers the floating point operations (by format and class) and the floating
+// point bytes loaded and stored by a basic block for the roofline report. The
+// counter layout is shared with the runtime through raptor/Report.h.
+class ReportGenerator : public llvm::InstVisitor<ReportGenerator> {
+private:
+  const DataLayout &DL;
+  std::array<uint64_t, RaptorReportNumCounters> Counts;
+
+public:
+  ReportGenerator(Module &M) : DL(M.getDataLayout()) { reset(); }
+
+  void reset() { Counts.fill(0); }
+
+  bool empty() const {
+    return llvm::all_of(Counts, [](uint64_t C) { return C == 0; });
+  }
+
+  ArrayRef<uint64_t> getCounts() const { return Counts; }
+
+  static std::optional<unsigned> getFormat(Type *Ty) {
+    Ty = Ty->getScalarType();
+    if (Ty->isDoubleTy())
+      return RaptorReportFormat_fp64;
+    if (Ty->isFloatTy())
+      return RaptorReportFormat_fp32;
+    if (Ty->isHalfTy())
+      return RaptorReportFormat_fp16;
+    return std::nullopt;
+  }
+
+  void op(Type *Ty, RaptorReportOpClass C) {
+    auto F = getFormat(Ty);
+    if (!F)
+      return;
+    uint64_t Lanes = 1;
+    if (auto VTy = dyn_cast<VectorType>(Ty))
+      Lanes = VTy->getElementCount().getKnownMinValue();
+    Counts[raptorReportOpCounter(*F, C)] += Lanes;
+  }
+
+  void access(Type *Ty, bool IsLoad, bool IsStore) {
+    auto F = getFormat(Ty);
+    if (!F)
+      return;
+    uint64_t Size = DL.getTypeStoreSize(Ty).getKnownMinValue();
+    if (IsLoad)
+      Counts[raptorReportLoadCounter(*F)] += Size;
+    if (IsStore)
+      Counts[raptorReportStoreCounter(*F)] += Size;
+  }
+
+  void visitBinaryOperator(llvm::BinaryOperator &BO) {
+    switch (BO.getOpcode()) {
+    case BinaryOperator::FAdd:
+    case BinaryOperator::FSub:
+      op(BO.getType(), RaptorReportOpClass_addsub);
+      return;
+    case BinaryOperator::FMul:
+      op(BO.getType(), RaptorReportOpClass_mul);
+      return;
+    case BinaryOperator::FDiv:
+    case BinaryOperator::FRem:
+      op(BO.getType(), RaptorReportOpClass_div);
+      return;
+    default:
+      return;
+    }
+  }
+
+  void visitUnaryOperator(llvm::UnaryOperator &UO) {
+    if (UO.getOpcode() == UnaryOperator::FNeg)
+      op(UO.getType(), RaptorReportOpClass_other);
+  }
+
+  void visitLoadInst(llvm::LoadInst &LI) { access(LI.getType(), true, false); }
+
+  void visitStoreInst(llvm::StoreInst &SI) {
+    access(SI.getValueOperand()->getType(), false, true);
+  }
+
+  void visitAtomicRMWInst(llvm::AtomicRMWInst &RMW) {
+    access(RMW.getType(), true, true);
+  }
+
+  static RaptorReportOpClass getOpClass(Intrinsic::ID ID) {
+    switch (ID) {
+    case Intrinsic::fma:
+    case Intrinsic::fmuladd:
+      return RaptorReportOpClass_fma;
+    case Intrinsic::sqrt:
+      return RaptorReportOpClass_sqrt;
+    case Intrinsic::fabs:
+    case Intrinsic::copysign:
+    case Intrinsic::minnum:
+    case Intrinsic::maxnum:
+    case Intrinsic::minimum:
+    case Intrinsic::maximum:
+    case Intrinsic::floor:
+    case Intrinsic::ceil:
+    case Intrinsic::trunc:
+    case Intrinsic::rint:
+    case Intrinsic::nearbyint:
+    case Intrinsic::round:
+    case Intrinsic::roundeven:
+    case Intrinsic::is_fpclass:
+      return RaptorReportOpClass_other;
+    default:
+      return RaptorReportOpClass_math;
+    }
+  }
+
+  bool handleIntrinsic(llvm::CallBase &CI, Intrinsic::ID ID) {
+    if (isDbgInfoIntrinsic(ID))
+      return true;
+
+    Type *Ty = nullptr;
+    if (CI.getType()->isFPOrFPVectorTy())
+      Ty = CI.getType();
+    for (unsigned i = 0; !Ty && i < CI.arg_size(); ++i)
+      if (CI.getArgOperand(i)->getType()->isFPOrFPVectorTy())
+        Ty = CI.getArgOperand(i)->getType();
+    if (!Ty)
+      return false;
+
+    op(Ty, getOpClass(ID));
+    return true;
+  }
+
+  void visitIntrinsicInst(llvm::IntrinsicInst &II) {
+    handleIntrinsic(II, II.getIntrinsicID());
+  }
+
+  void visitCallBase(llvm::CallBase &CI) {
+    Intrinsic::ID ID;
+    StringRef funcName = getFuncNameFromCall(const_cast<CallBase *>(&CI));
+    if (isMemFreeLibMFunction(funcName, &ID))
+      handleIntrinsic(CI, ID);
+  }
+};
+
 // TODO we need to handle cases where constant aggregates are used and they
 // contain constant fp's in them.
 //
@@ -1045,6 +1242,444 @@ bool RaptorLogic::CountInFunc(llvm::Function *F, FloatRepresentation FR) {
   return true;
 }
 
+// The record layout must match struct __raptor_report_rec in
+// runtime/obj/Report.cpp.
+static GlobalVariable *createReportRecord(Module &M, StringRef Name,
+                                          GlobalVariable *Parent) {
+  LLVMContext &Ctx = M.getContext();
+  auto I64Ty = Type::getInt64Ty(Ctx);
+  auto PtrTy = PointerType::get(Ctx, 0);
+  auto CountersTy = ArrayType::get(I64Ty, RaptorReportNumCounters);
+  auto RecTy = StructType::get(Ctx, {I64Ty, PtrTy, PtrTy,
+                                     ArrayType::get(CountersTy, 2)});
+
+  Constant *ParentC = ConstantPointerNull::get(PtrTy);
+  if (Parent)
+    ParentC = Parent;
+  auto Init = ConstantStruct::get(
+      RecTy, {ConstantInt::get(I64Ty, 0),
+              createPrivateGlobalForString(M, Name, true), ParentC,
+              Constant::getNullValue(RecTy->getElementType(3))});
+  return new GlobalVariable(M, RecTy, /*isConstant*/ false,
+                            GlobalValue::PrivateLinkage, Init,
+                            "__raptor_report_rec");
+}
+
+bool RaptorLogic::ReportInFunc(llvm::Function *F) {
+  Module &M = *F->getParent();
+  LLVMContext &Ctx = M.getContext();
+  auto I64Ty = Type::getInt64Ty(Ctx);
+  auto PtrTy = PointerType::get(Ctx, 0);
+
+  auto FName = std::string(RaptorFPRTPrefix) + "report_block";
+  Function *BlockF = M.getFunction(FName);
+  if (!BlockF) {
+    FunctionType *FnTy = FunctionType::get(Type::getVoidTy(Ctx),
+                                           {PtrTy, PtrTy}, /*is_vararg*/ false);
+    BlockF = Function::Create(FnTy, Function::ExternalLinkage, FName, M);
+  }
+
+  DominatorTree DT(*F);
+  LoopInfo LI(DT);
+
+  std::string DisplayName = llvm::demangle(F->getName().str());
+  GlobalVariable *FuncRec = nullptr;
+  std::map<Loop *, GlobalVariable *> LoopRecs;
+  auto getRecord = [&](BasicBlock &BB) {
+    if (!FuncRec)
+      FuncRec = createReportRecord(M, DisplayName, nullptr);
+    Loop *L = LI.getLoopFor(&BB);
+    if (!L)
+      return FuncRec;
+    L = L->getOutermostLoop();
+    auto &Rec = LoopRecs[L];
+    if (!Rec) {
+      std::string Name = DisplayName + " loop";
+      if (DebugLoc DL = L->getStartLoc())
+        Name += " at " + DL->getFilename().str() + ":" +
+                std::to_string(DL.getLine());
+      else
+        Name += " " + std::to_string(LoopRecs.size());
+      Rec = createReportRecord(M, Name, FuncRec);
+    }
+    return Rec;
+  };
+
+  ReportGenerator Handle(M);
+  bool Changed = false;
+  for (auto &BB : *F) {
+    Handle.reset();
+    for (auto &I : BB)
+      Handle.visit(&I);
+    if (Handle.empty())
+      continue;
+
+    auto Counts = Handle.getCounts();
+    auto Desc = new GlobalVariable(
+        M, ArrayType::get(I64Ty, Counts.size()), /*isConstant*/ true,
+        GlobalValue::PrivateLinkage, ConstantDataArray::get(Ctx, Counts),
+        "__raptor_report_block");
+    Desc->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+
+    Instruction *InsertPt = BB.getTerminator();
+    if (auto CI = BB.getTerminatingMustTailCall())
+      InsertPt = CI;
+    IRBuilder<> B(InsertPt);
+    B.CreateCall(BlockF, {getRecord(BB), Desc});
+    Changed = true;
+  }
+
+  if (llvm::verifyFunction(*F, &llvm::errs())) {
+    llvm::errs() << *F << "\n";
+    report_fatal_error("function failed verification (6)");
+  }
+
+  return Changed;
+}
+
+// This will result in a unique string for each location, which means the
+// runtime can check whether two operations are the same with a simple pointer
+// comparison. However, we need LTO for this to be the case across different
+// compilation units.
+// TODO is there some linker hackery that can merge the symbols with the same
+// content at linking time?
+GlobalValue *RaptorLogic::getUniquedLocStr(Module &M, Instruction *I) {
+  std::string FileName = "unknown";
+  unsigned LineNo = 0;
+  unsigned ColNo = 0;
+
+  if (I) {
+    DILocation *DL = I->getDebugLoc();
+    if (DL) {
+      FileName = DL->getFilename();
+      LineNo = DL->getLine();
+      ColNo = DL->getColumn();
+    }
+  }
+
+  auto Key = std::make_tuple(FileName, LineNo, ColNo);
+  auto It = UniqDebugLocStrs.find(Key);
+
+  if (It != UniqDebugLocStrs.end())
+    return It->second;
+
+  std::string LocStr =
+      FileName + ":" + std::to_string(LineNo) + ":" + std::to_string(ColNo);
+  auto GV = createPrivateGlobalForString(M, LocStr, true);
+  UniqDebugLocStrs[Key] = GV;
+
+  return GV;
+}
+
+namespace {
+// Heap allocation and deallocation functions whose blocks we register with the
+// runtime. Size is the product of the SizeArgs, Freed the argument released.
+struct AllocFnInfo {
+  StringRef Name;
+  int SizeArgs[2];
+  int Freed;
+};
+} // namespace
+
+static const AllocFnInfo AllocFns[] = {
+    {"malloc", {0, -1}, -1},
+    {"calloc", {0, 1}, -1},
+    {"realloc", {1, -1}, 0},
+    {"aligned_alloc", {1, -1}, -1},
+    {"_Znwm", {0, -1}, -1},
+    {"_Znam", {0, -1}, -1},
+    {"_ZnwmRKSt9nothrow_t", {0, -1}, -1},
+    {"_ZnamRKSt9nothrow_t", {0, -1}, -1},
+    {"_ZnwmSt11align_val_t", {0, -1}, -1},
+    {"_ZnamSt11align_val_t", {0, -1}, -1},
+    {"free", {-1, -1}, 0},
+    {"_ZdlPv", {-1, -1}, 0},
+    {"_ZdaPv", {-1, -1}, 0},
+    {"_ZdlPvm", {-1, -1}, 0},
+    {"_ZdaPvm", {-1, -1}, 0},
+    {"_ZdlPvSt11align_val_t", {-1, -1}, 0},
+    {"_ZdaPvSt11align_val_t", {-1, -1}, 0},
+    {"_ZdlPvmSt11align_val_t", {-1, -1}, 0},
+    {"_ZdaPvmSt11align_val_t", {-1, -1}, 0},
+};
+
+bool RaptorLogic::TrackAllocationsInFunc(llvm::Function *F,
+                                         bool AttributeAccesses) {
+  Module &M = *F->getParent();
+  auto &DL = M.getDataLayout();
+  LLVMContext &Ctx = M.getContext();
+  auto I64Ty = Type::getInt64Ty(Ctx);
+  auto PtrTy = PointerType::get(Ctx, 0);
+
+  struct Access {
+    Instruction *I;
+    Value *Ptr;
+    Type *Ty;
+    bool IsStore;
+  };
+  SmallVector<std::pair<CallBase *, const AllocFnInfo *>, 4> Calls;
+  SmallVector<Access, 16> Accesses;
+  for (auto &I : instructions(F)) {
+    if (AttributeAccesses) {
+      if (auto load = dyn_cast<LoadInst>(&I)) {
+        if (load->getType()->isFPOrFPVectorTy())
+          Accesses.push_back(
+              {load, load->getPointerOperand(), load->getType(), false});
+      } else if (auto store = dyn_cast<StoreInst>(&I)) {
+        Type *ty = store->getValueOperand()->getType();
+        if (ty->isFPOrFPVectorTy())
+          Accesses.push_back({store, store->getPointerOperand(), ty, true});
+      } else if (auto RMW = dyn_cast<AtomicRMWInst>(&I)) {
+        if (RMW->getType()->isFPOrFPVectorTy())
+          Accesses.push_back(
+              {RMW, RMW->getPointerOperand(), RMW->getType(), true});
+      }
+    }
+    auto CB = dyn_cast<CallBase>(&I);
+    if (!CB)
+      continue;
+    auto Callee = CB->getCalledFunction();
+    if (!Callee)
+      continue;
+    for (auto &Info : AllocFns)
+      if (Callee->getName() == Info.Name)
+        Calls.push_back({CB, &Info});
+  }
+  // Only host memory is registered.
+  llvm::erase_if(Accesses, [](const Access &A) {
+    return A.Ptr->getType()->getPointerAddressSpace() != 0;
+  });
+  if (Calls.empty() && Accesses.empty())
+    return false;
+
+  auto getRTFunc = [&](StringRef Name, ArrayRef<Type *> Params) {
+    auto FName = std::string(RaptorFPRTPrefix) + Name.str();
+    return M.getOrInsertFunction(
+        FName, FunctionType::get(Type::getVoidTy(Ctx), Params, false));
+  };
+  auto AllocF = getRTFunc("alloc", {PtrTy, I64Ty, PtrTy});
+  auto ReallocF = getRTFunc("realloc", {PtrTy, PtrTy, I64Ty, PtrTy});
+  auto FreeF = getRTFunc("free", {PtrTy});
+  auto AccessF = getRTFunc("alloc_access", {PtrTy, I64Ty, I64Ty});
+
+  bool Changed = false;
+  // One call per access, the runtime caches the block the thread last hit.
+  for (auto &A : Accesses) {
+    IRBuilder<> B(A.I);
+    B.CreateCall(AccessF, {A.Ptr,
+                           B.CreateTypeSize(I64Ty, DL.getTypeStoreSize(A.Ty)),
+                           B.getInt64(A.IsStore)});
+    Changed = true;
+  }
+
+  for (auto [CB, Info] : Calls) {
+    IRBuilder<> B(CB);
+    // realloc keeps the old block if it fails, so it is replaced after the
+    // call instead.
+    bool IsRealloc = Info->Freed >= 0 && Info->SizeArgs[0] >= 0;
+    if (Info->Freed >= 0 && !IsRealloc) {
+      B.CreateCall(FreeF, {CB->getArgOperand(Info->Freed)});
+      Changed = true;
+    }
+    if (Info->SizeArgs[0] < 0)
+      continue;
+
+    // operator new may be invoked, we can only register the result on the
+    // normal path if that path does not merge with others.
+    Instruction *InsertPt = CB->getNextNode();
+    if (auto II = dyn_cast<InvokeInst>(CB)) {
+      BasicBlock *Normal = II->getNormalDest();
+      if (!Normal->getSinglePredecessor())
+        continue;
+      InsertPt = &*Normal->getFirstInsertionPt();
+    }
+    B.SetInsertPoint(InsertPt);
+    Value *Size = B.CreateZExtOrTrunc(
+        CB->getArgOperand(Info->SizeArgs[0]), I64Ty);
+    if (Info->SizeArgs[1] >= 0)
+      Size = B.CreateMul(
+          Size, B.CreateZExtOrTrunc(CB->getArgOperand(Info->SizeArgs[1]),
+                                    I64Ty));
+    if (IsRealloc)
+      B.CreateCall(ReallocF, {CB->getArgOperand(Info->Freed), CB, Size,
+                              getUniquedLocStr(M, CB)});
+    else
+      B.CreateCall(AllocF, {CB, Size, getUniquedLocStr(M, CB)});
+    Changed = true;
+  }
+
+  if (llvm::verifyFunction(*F, &llvm::errs())) {
+    llvm::errs() << *F << "\n";
+    report_fatal_error("function failed verification (7)");
+  }
+
+  return Changed;
+}
+
+bool RaptorLogic::CountCancellationInFunc(llvm::Function *F,
+                                          unsigned MinBits) {
+  Module &M = *F->getParent();
+  LLVMContext &Ctx = M.getContext();
+  auto I64Ty = Type::getInt64Ty(Ctx);
+  auto PtrTy = PointerType::get(Ctx, 0);
+
+  SmallVector<BinaryOperator *, 16> Ops;
+  for (auto &I : instructions(F)) {
+    auto BO = dyn_cast<BinaryOperator>(&I);
+    if (!BO || (BO->getOpcode() != Instruction::FAdd &&
+                BO->getOpcode() != Instruction::FSub))
+      continue;
+    // Only scalars of the IEEE-like types, whose exponent field sits right
+    // above the significand.
+    Type *Ty = BO->getType();
+    if (Ty->isHalfTy() || Ty->isBFloatTy() || Ty->isFloatTy() ||
+        Ty->isDoubleTy())
+      Ops.push_back(BO);
+  }
+  if (Ops.empty())
+    return false;
+
+  auto CancelF = M.getOrInsertFunction(
+      std::string(RaptorFPRTPrefix) + "cancellation",
+      FunctionType::get(Type::getVoidTy(Ctx), {I64Ty, I64Ty, PtrTy},
+                        /*is_vararg*/ false));
+  MDNode *Unlikely = MDBuilder(Ctx).createBranchWeights(1, (1U << 20) - 1);
+
+  for (auto BO : Ops) {
+    Type *Ty = BO->getType();
+    unsigned Width = Ty->getPrimitiveSizeInBits();
+    unsigned Significand =
+        APFloat::semanticsPrecision(Ty->getFltSemantics()) - 1;
+    auto IntTy = IntegerType::get(Ctx, Width);
+    auto ExpMask = ConstantInt::get(
+        IntTy, (1ULL << (Width - 1 - Significand)) - 1);
+
+    Instruction *Next = BO->getNextNode();
+    IRBuilder<> B(Next);
+    auto Exponent = [&](Value *V) {
+      return B.CreateAnd(
+          B.CreateLShr(B.CreateBitCast(V, IntTy), Significand), ExpMask);
+    };
+    // The exponent fields are biased the same way, so their difference is
+    // the number of leading significand bits that cancelled. NaN and
+    // infinite results have the largest exponent and never count.
+    Value *Larger = B.CreateBinaryIntrinsic(
+        Intrinsic::umax, Exponent(BO->getOperand(0)),
+        Exponent(BO->getOperand(1)));
+    Value *ResultExp = Exponent(BO);
+    Value *Lost = B.CreateSub(Larger, ResultExp);
+    // A zero or subnormal result lost all of the significand, also where the
+    // operands were too close to the subnormal range for the difference to
+    // show it. Sums of zeros and subnormals do not count.
+    auto Zero = ConstantInt::get(IntTy, 0);
+    Value *Total = B.CreateAnd(B.CreateICmpEQ(ResultExp, Zero),
+                               B.CreateICmpNE(Larger, Zero));
+    Lost = B.CreateSelect(Total, ConstantInt::get(IntTy, Significand + 1),
+                          Lost);
+    // Anything beyond the significand is a total cancellation.
+    Value *Cond = B.CreateICmpSGE(
+        Lost, ConstantInt::get(IntTy, std::min(MinBits, Significand + 1)));
+
+    Instruction *Then = SplitBlockAndInsertIfThen(Cond, Next, false, Unlikely);
+    B.SetInsertPoint(Then);
+    B.CreateCall(CancelF, {B.CreateSExt(Lost, I64Ty),
+                           B.getInt64(Significand), getUniquedLocStr(M, BO)});
+  }
+
+  if (llvm::verifyFunction(*F, &llvm::errs())) {
+    llvm::errs() << *F << "\n";
+    report_fatal_error("function failed verification (8)");
+  }
+
+  return true;
+}
+
+bool RaptorLogic::ProfileRangeInFunc(llvm::Function *F) {
+  Module &M = *F->getParent();
+  LLVMContext &Ctx = M.getContext();
+  auto I64Ty = Type::getInt64Ty(Ctx);
+  auto PtrTy = PointerType::get(Ctx, 0);
+
+  // The values a truncation of F would have to represent: what it loads and
+  // what it computes. Calls to defined functions are profiled in the callee.
+  SmallVector<Instruction *, 16> Values;
+  for (auto &I : instructions(F)) {
+    Type *Ty = I.getType();
+    if (!Ty->isHalfTy() && !Ty->isBFloatTy() && !Ty->isFloatTy() &&
+        !Ty->isDoubleTy())
+      continue;
+    if (auto CI = dyn_cast<CallInst>(&I)) {
+      Function *Callee = CI->getCalledFunction();
+      if (!Callee || !Callee->isDeclaration() ||
+          Callee->getName().starts_with(RaptorFPRTPrefix))
+        continue;
+    } else if (!isa<BinaryOperator>(I) && !isa<LoadInst>(I)) {
+      continue;
+    }
+    Values.push_back(&I);
+  }
+  if (Values.empty())
+    return false;
+
+  auto ProfileF = M.getOrInsertFunction(
+      std::string(RaptorFPRTPrefix) + "range_profile",
+      FunctionType::get(Type::getVoidTy(Ctx),
+                        {Type::getDoubleTy(Ctx), I64Ty, I64Ty, PtrTy},
+                        /*is_vararg*/ false));
+  // The mangled name, which is what -raptor-truncate-config matches.
+  Constant *FName = createPrivateGlobalForString(M, F->getName(), true);
+
+  for (auto I : Values) {
+    const fltSemantics &Sem = I->getType()->getFltSemantics();
+    unsigned Significand = APFloat::semanticsPrecision(Sem) - 1;
+    unsigned Exponent = APFloat::semanticsSizeInBits(Sem) - 1 - Significand;
+    IRBuilder<> B(I->getNextNode());
+    B.CreateCall(ProfileF,
+                 {B.CreateFPExt(I, B.getDoubleTy()), B.getInt64(Exponent),
+                  B.getInt64(Significand), FName});
+  }
+
+  if (llvm::verifyFunction(*F, &llvm::errs())) {
+    llvm::errs() << *F << "\n";
+    report_fatal_error("function failed verification (9)");
+  }
+
+  return true;
+}
+
+// Push the truncated function on the calling context stack of the runtime on
+// entry and pop it on every exit, see -raptor-context-depth. The exit restores
+// the depth returned by the entry, so frames skipped by unwinding are dropped
+// the next time an enclosing function returns.
+static void instrumentContext(Function *NewF, Function *ToTrunc) {
+  Module &M = *NewF->getParent();
+  LLVMContext &Ctx = M.getContext();
+  auto I64Ty = Type::getInt64Ty(Ctx);
+  auto PtrTy = PointerType::get(Ctx, 0);
+
+  auto EnterF = M.getOrInsertFunction(
+      std::string(RaptorFPRTPrefix) + "ctx_enter",
+      FunctionType::get(I64Ty, {PtrTy, I64Ty}, /*is_vararg*/ false));
+  auto ExitF = M.getOrInsertFunction(
+      std::string(RaptorFPRTPrefix) + "ctx_exit",
+      FunctionType::get(Type::getVoidTy(Ctx), {I64Ty}, /*is_vararg*/ false));
+  Constant *FName = createPrivateGlobalForString(
+      M, llvm::demangle(ToTrunc->getName().str()), true);
+
+  IRBuilder<> B(&*NewF->getEntryBlock().getFirstInsertionPt());
+  Value *Depth =
+      B.CreateCall(EnterF, {FName, B.getInt64(RaptorContextDepth)});
+  for (auto &BB : *NewF) {
+    Instruction *InsertPt = BB.getTerminator();
+    if (!isa<ReturnInst>(InsertPt) && !isa<ResumeInst>(InsertPt))
+      continue;
+    if (auto CI = BB.getTerminatingMustTailCall())
+      InsertPt = CI;
+    B.SetInsertPoint(InsertPt);
+    B.CreateCall(ExitF, {Depth});
+  }
+}
+
 llvm::Function *RaptorLogic::CreateTruncateFunc(RequestContext Context,
                                                 llvm::Function *ToTrunc,
                                                 TruncationConfiguration TC) {
@@ -1129,6 +1764,9 @@ llvm::Function *RaptorLogic::CreateTruncateFunc(RequestContext Context,
     for (auto &I : BB)
       Handle.visit(&I);
 
+  if (RaptorContextDepth)
+    instrumentContext(NewF, ToTrunc);
+
   if (llvm::verifyFunction(*NewF, &llvm::errs())) {
     llvm::errs() << *ToTrunc << "\n";
     llvm::errs() << *NewF << "\n";
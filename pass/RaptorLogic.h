@@ -35,6 +35,7 @@ extern "C" {
 extern llvm::cl::opt<bool> RaptorPrint;
 extern llvm::cl::opt<bool> RaptorJuliaAddrLoad;
 }
+extern llvm::cl::opt<unsigned> RaptorContextDepth;
 
 constexpr char RaptorPrefix[] = "__raptor_";
 constexpr char RaptorFPRTPrefix[] = "__raptor_fprt_";
@@ -52,6 +53,9 @@ constexpr unsigned F16Width = 16;
 constexpr unsigned F16Exponent = 5;
 constexpr unsigned F16Significand = 10;
 static_assert(F16Width == F16Exponent + F16Significand + 1);
+constexpr unsigned BF16Exponent = 8;
+constexpr unsigned BF16Significand = 7;
+static_assert(F16Width == BF16Exponent + BF16Significand + 1);
 
 // Holder class to represent a context in which a derivative
 // or batch is being requested. This contains the instruction
@@ -65,8 +69,10 @@ struct RequestContext {
       : req(req), ip(ip) {}
 };
 
+// bfloat selects bfloat16 instead of IEEE half for a width of 16.
 [[maybe_unused]] static llvm::Type *
-getTypeForWidth(llvm::LLVMContext &ctx, unsigned width, bool builtinFloat) {
+getTypeForWidth(llvm::LLVMContext &ctx, unsigned width, bool builtinFloat,
+                bool bfloat = false) {
   switch (width) {
   default:
     if (builtinFloat)
@@ -79,6 +85,8 @@ getTypeForWidth(llvm::LLVMContext &ctx, unsigned width, bool builtinFloat) {
   case F32Width:
     return llvm::Type::getFloatTy(ctx);
   case F16Width:
+    if (bfloat)
+      return llvm::Type::getBFloatTy(ctx);
     return llvm::Type::getHalfTy(ctx);
   }
 }
@@ -88,6 +96,8 @@ enum TruncateMode {
   TruncOpMode = 0b0010,
   TruncOpFullModuleMode = 0b0110,
 };
+// Or'ed into the mode passed to the runtime when the ops round stochastically.
+static constexpr int64_t TruncStochasticRounding = 0b1000;
 [[maybe_unused]] static const char *truncateModeStr(TruncateMode mode) {
   switch (mode) {
   case TruncMemMode:
@@ -102,7 +112,8 @@ enum TruncateMode {
 
 struct FloatRepresentation {
 public:
-  enum FloatRepresentationType { IEEE = 0, MPFR = 1 };
+  // The values are those of the type argument of __raptor_truncate_*_func.
+  enum FloatRepresentationType { IEEE = 0, MPFR = 1, MPFRStochastic = 2 };
 
 private:
   FloatRepresentation() {}
@@ -135,6 +146,14 @@ public:
     return Repr;
   }
 
+  // Emulated like getMPFR, but every op result is rounded up or down with
+  // probability proportional to its distance.
+  static FloatRepresentation getMPFRStochastic(unsigned E, unsigned S) {
+    FloatRepresentation Repr = getMPFR(E, S);
+    Repr.Ty = MPFRStochastic;
+    return Repr;
+  }
+
   static std::optional<FloatRepresentation> parse(llvm::StringRef &ConfigStr) {
     if (ConfigStr.consume_front("ieee(")) {
       unsigned Width = 0;
@@ -143,7 +162,10 @@ public:
       if (!ConfigStr.consume_front(")"))
         return {};
       return getIEEE(Width);
-    } else if (ConfigStr.consume_front("mpfr(")) {
+    } else if (ConfigStr.starts_with("mpfr")) {
+      bool Stochastic = ConfigStr.consume_front("mpfrsr(");
+      if (!Stochastic && !ConfigStr.consume_front("mpfr("))
+        return {};
       unsigned Exponent = 0;
       unsigned Significand = 0;
       if (ConfigStr.consumeInteger(10, Exponent))
@@ -154,7 +176,11 @@ public:
         return {};
       if (!ConfigStr.consume_front(")"))
         return {};
+      if (Stochastic)
+        return getMPFRStochastic(Exponent, Significand);
       return getMPFR(Exponent, Significand);
+    } else if (ConfigStr.consume_front("bfloat")) {
+      return getBFloat();
     }
     return {};
   }
@@ -183,6 +209,16 @@ public:
     return Repr;
   }
 
+  // bfloat16 is no IEEE format but a builtin type like the IEEE ones, so it
+  // shares their representation type and only differs in the widths.
+  static FloatRepresentation getBFloat() {
+    FloatRepresentation Repr;
+    Repr.ExponentWidth = BF16Exponent;
+    Repr.SignificandWidth = BF16Significand;
+    Repr.Ty = IEEE;
+    return Repr;
+  }
+
   FloatRepresentationType getType() const { return Ty; }
 
   unsigned getWidth() const { return 1 + ExponentWidth + SignificandWidth; }
@@ -192,24 +228,30 @@ public:
   unsigned getSignificandWidth() const { return SignificandWidth; }
 
   bool isIEEE() { return Ty == IEEE; }
-  bool isMPFR() { return Ty == MPFR; }
+  bool isMPFR() { return Ty == MPFR || Ty == MPFRStochastic; }
+  bool isStochastic() { return Ty == MPFRStochastic; }
+  bool isBFloat() const {
+    return Ty == IEEE && ExponentWidth == BF16Exponent &&
+           SignificandWidth == BF16Significand;
+  }
 
   bool canBeBuiltin() const {
     unsigned w = getWidth();
     return (w == F16Width && SignificandWidth == F16Significand) ||
+           isBFloat() ||
            (w == F32Width && SignificandWidth == F32Significand) ||
            (w == F64Width && SignificandWidth == F64Significand);
   }
 
   llvm::Type *getMustBeBuiltinType(llvm::LLVMContext &ctx) const {
     assert(canBeBuiltin());
-    return getTypeForWidth(ctx, getWidth(), /*builtinFloat=*/true);
+    return getTypeForWidth(ctx, getWidth(), /*builtinFloat=*/true, isBFloat());
   }
 
   llvm::Type *getBuiltinType(llvm::LLVMContext &ctx) const {
     if (!canBeBuiltin())
       return nullptr;
-    return getTypeForWidth(ctx, getWidth(), /*builtinFloat=*/true);
+    return getTypeForWidth(ctx, getWidth(), /*builtinFloat=*/true, isBFloat());
   }
 
   llvm::Type *getType(llvm::LLVMContext &ctx) const {
@@ -232,10 +274,15 @@ public:
   std::string getMangling() const {
     switch (Ty) {
     case IEEE:
+      if (isBFloat())
+        return "bf_16";
       return "ieee_" + std::to_string(getWidth());
     case MPFR:
       return "mpfr_" + std::to_string(getExponentWidth()) + "_" +
              std::to_string(getSignificandWidth());
+    case MPFRStochastic:
+      return "mpfrsr_" + std::to_string(getExponentWidth()) + "_" +
+             std::to_string(getSignificandWidth());
     default:
       llvm_unreachable("Unknown type");
     }
@@ -246,11 +293,15 @@ struct FloatTruncation {
 private:
   FloatRepresentation From, To;
   TruncateMode Mode;
+  // Format the sums into an accumulator are rounded to, the products and
+  // all other ops are rounded to To.
+  std::optional<FloatRepresentation> Acc;
 
 public:
   FloatTruncation(FloatRepresentation From, FloatRepresentation To,
-                  TruncateMode mode)
-      : From(From), To(To), Mode(mode) {
+                  TruncateMode mode,
+                  std::optional<FloatRepresentation> Acc = std::nullopt)
+      : From(From), To(To), Mode(mode), Acc(Acc) {
     if (!From.isIEEE())
       llvm::report_fatal_error("Float truncation `from` type is not IEEE.");
     if (!From.canBeBuiltin())
@@ -268,22 +319,46 @@ public:
     //   llvm::report_fatal_error(
     //       "Float truncation `from` and `to` type must not be the same.");
   }
+
+  // Parse "from-to" or "from-to+acc", e.g. "ieee(64)-mpfr(11,13)" or
+  // "ieee(64)-mpfr(5,10)+ieee(32)".
+  static std::optional<FloatTruncation> parse(llvm::StringRef &ConfigStr,
+                                              TruncateMode Mode) {
+    auto From = FloatRepresentation::parse(ConfigStr);
+    if (!From)
+      return {};
+    if (!ConfigStr.consume_front("-"))
+      return {};
+    auto To = FloatRepresentation::parse(ConfigStr);
+    if (!To)
+      return {};
+    std::optional<FloatRepresentation> Acc;
+    if (ConfigStr.consume_front("+")) {
+      Acc = FloatRepresentation::parse(ConfigStr);
+      if (!Acc)
+        return {};
+    }
+    return FloatTruncation(*From, *To, Mode, Acc);
+  }
+
   TruncateMode getMode() { return Mode; }
   FloatRepresentation getTo() { return To; }
   FloatRepresentation getFrom() { return From; }
+  std::optional<FloatRepresentation> getAcc() { return Acc; }
   unsigned getFromTypeWidth() { return From.getWidth(); }
   unsigned getToTypeWidth() { return To.getWidth(); }
   llvm::Type *getFromType(llvm::LLVMContext &ctx) {
     return From.getBuiltinType(ctx);
   }
-  bool isToFPRT() { return To.isMPFR(); }
+  // Accumulations are only emulated by the runtime.
+  bool isToFPRT() { return To.isMPFR() || Acc.has_value(); }
   llvm::Type *getToType(llvm::LLVMContext &ctx) {
     if (isToFPRT())
       return getFromType(ctx);
     else
       return To.getBuiltinType(ctx);
   }
-  auto getTuple() const { return std::tuple(From, To, Mode); }
+  auto getTuple() const { return std::tuple(From, To, Mode, Acc); }
   bool operator==(const FloatTruncation &other) const {
     return getTuple() == other.getTuple();
   }
@@ -291,6 +366,9 @@ public:
     return getTuple() < other.getTuple();
   }
   std::string mangleTruncation() const {
+    if (Acc)
+      return From.getMangling() + "_to_" + To.getMangling() + "_acc_" +
+             Acc->getMangling();
     return From.getMangling() + "_to_" + To.getMangling();
   }
   std::string mangleFrom() const { return From.getMangling(); }
@@ -311,6 +389,9 @@ public:
 
   bool IsToFPRT;
   std::optional<FloatRepresentation> ToRepr;
+  // Exponent and significand width of the accumulator format, passed to
+  // accumulations before the CustomArgs. Empty without one.
+  CustomArgsTy AccArgs = {};
 
   std::string mangle() {
     return std::string(truncateModeStr(Mode)) + "_func_" +
@@ -363,8 +444,16 @@ public:
     CustomArgsTy Args;
     Args.push_back(B.getInt64(Truncation.getTo().getExponentWidth()));
     Args.push_back(B.getInt64(Truncation.getTo().getSignificandWidth()));
-    Args.push_back(B.getInt64(Truncation.getMode()));
+    Args.push_back(B.getInt64(
+        Truncation.getMode() |
+        (Truncation.getTo().isStochastic() ? TruncStochasticRounding : 0)));
     std::string Mangle = "to_" + Truncation.getTo().getMangling();
+    CustomArgsTy AccArgs;
+    if (auto Acc = Truncation.getAcc()) {
+      AccArgs.push_back(B.getInt64(Acc->getExponentWidth()));
+      AccArgs.push_back(B.getInt64(Acc->getSignificandWidth()));
+      Mangle += "_acc_" + Acc->getMangling();
+    }
     if (Truncation.getMode() == TruncOpMode) {
       if (Truncation.isToFPRT())
         return TruncationConfiguration{Truncation.getFrom(),
@@ -376,7 +465,8 @@ public:
                                        Mangle,
                                        "fprt",
                                        true,
-                                       std::nullopt};
+                                       std::nullopt,
+                                       AccArgs};
       else
         return TruncationConfiguration{Truncation.getFrom(),
                                        Truncation.getMode(),
@@ -389,7 +479,7 @@ public:
                                        false,
                                        Truncation.getTo()};
     } else if (Truncation.getMode() == TruncMemMode) {
-      assert(Truncation.isToFPRT());
+      assert(Truncation.isToFPRT() && !Truncation.getAcc());
       return TruncationConfiguration{Truncation.getFrom(),
                                      Truncation.getMode(),
                                      false,
@@ -411,7 +501,8 @@ public:
                                        Mangle,
                                        "fprt",
                                        true,
-                                       std::nullopt};
+                                       std::nullopt,
+                                       AccArgs};
       else
         return TruncationConfiguration{Truncation.getFrom(),
                                        Truncation.getMode(),
@@ -452,6 +543,12 @@ public:
   bool CreateTruncateValue(RequestContext context, llvm::Value *addr,
                            FloatTruncation Truncation, bool isTruncate);
   bool CountInFunc(llvm::Function *F, FloatRepresentation FR);
+  bool ReportInFunc(llvm::Function *F);
+  bool TrackAllocationsInFunc(llvm::Function *F, bool AttributeAccesses);
+  bool CountCancellationInFunc(llvm::Function *F, unsigned MinBits);
+  bool ProfileRangeInFunc(llvm::Function *F);
+
+  llvm::GlobalValue *getUniquedLocStr(llvm::Module &M, llvm::Instruction *I);
 
   void clear();
 };
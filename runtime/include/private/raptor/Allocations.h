@@ -0,0 +1,19 @@
+#ifndef _RAPTOR_ALLOCATIONS_H_
+#define _RAPTOR_ALLOCATIONS_H_
+
+#include <atomic>
+#include <cstdint>
+
+// Registry of heap allocations for per-array attribution of the floating point
+// memory traffic, see obj/Allocations.cpp.
+
+// Set once the first allocation is registered so the access hooks cost a
+// single branch in programs that do not track allocations.
+extern std::atomic<bool> raptor_fprt_alloc_tracking;
+
+// Attribute an access to the allocation containing ptr. Returns whether there
+// is one and, if so, its start in base.
+bool raptor_fprt_alloc_access(const void *ptr, int64_t size, bool is_store,
+                              uintptr_t *base);
+
+#endif // _RAPTOR_ALLOCATIONS_H_
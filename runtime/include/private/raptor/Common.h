@@ -45,6 +45,9 @@ static inline bool __raptor_fprt_is_op_mode(int64_t mode) {
 static inline bool __raptor_fprt_is_full_module_op_mode(int64_t mode) {
   return mode & 0b0100;
 }
+static inline bool __raptor_fprt_is_stochastic_mode(int64_t mode) {
+  return mode & 0b1000;
+}
 
 __RAPTOR_MPFR_DECL_ATTRIBUTES
 void raptor_fprt_gc_dump_status();
@@ -73,7 +76,7 @@ template <typename To, typename From> To checked_raptor_bitcast(From from) {
     abort();
 }
 
-#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY)                                     \
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME)                               \
   static inline CPP_TY __raptor_fprt_idx_to_##FROM_TY(uint64_t p) {            \
     return checked_raptor_bitcast<CPP_TY>(p);                                  \
   }                                                                            \
@@ -88,7 +91,7 @@ template <typename To, typename From> To checked_raptor_bitcast(From from) {
   }
 #include "raptor/FloatTypes.def"
 
-#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY)                                     \
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME)                               \
   __RAPTOR_MPFR_DECL_ATTRIBUTES                                                \
   CPP_TY __raptor_fprt_##FROM_TY##_get(CPP_TY _a, int64_t exponent,            \
                                        int64_t significand, int64_t mode,      \
@@ -0,0 +1,17 @@
+#ifndef _RAPTOR_CONTEXT_H_
+#define _RAPTOR_CONTEXT_H_
+
+#include <cstdint>
+
+// Per-thread calling context of the truncated functions, maintained by the
+// calls the pass inserts with -raptor-context-depth, see obj/Context.cpp.
+
+// Hash of the innermost frames of this thread's context stack, 0 outside of
+// the instrumented functions.
+extern thread_local uint64_t raptor_fprt_context_hash;
+
+// Accumulate a shadow error sample of the op at loc in the current context.
+void raptor_fprt_context_record(const char *loc, const char *op,
+                                bool violation, double err);
+
+#endif // _RAPTOR_CONTEXT_H_
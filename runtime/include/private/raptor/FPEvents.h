@@ -0,0 +1,15 @@
+#ifndef _RAPTOR_FP_EVENTS_H_
+#define _RAPTOR_FP_EVENTS_H_
+
+// Overflow, underflow and NaN events of the emulated format, see
+// obj/FPEvents.cpp.
+
+// Whether RAPTOR_FP_EVENTS_REPORT was set. The MPFR wrappers only look at the
+// flags when it is.
+extern const bool raptor_fprt_fp_events_enabled;
+
+// Attribute the MPFR flags raised by the op at loc to it and clear them. The
+// wrappers clear the flags when the op starts, see RAPTOR_FP_EVENTS_CLEAR.
+void raptor_fprt_fp_events_check(const char *loc, const char *op);
+
+#endif // _RAPTOR_FP_EVENTS_H_
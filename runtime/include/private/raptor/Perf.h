@@ -0,0 +1,16 @@
+#ifndef _RAPTOR_PERF_H_
+#define _RAPTOR_PERF_H_
+
+// Hardware performance counter sampling, see obj/PerfCounters.cpp.
+//
+// Samples are taken in matching push/pop pairs per thread, the counters read in
+// between are attributed to the key of the push.
+
+// Whether RAPTOR_PERF_COUNTERS was set. Check this before calling the
+// functions below to keep the cost of the hooks to a single branch.
+extern const bool raptor_fprt_perf_enabled;
+
+void raptor_fprt_perf_push(const char *key, const char *kind);
+void raptor_fprt_perf_pop();
+
+#endif // _RAPTOR_PERF_H_
@@ -0,0 +1,42 @@
+#ifndef _RAPTOR_REGION_H_
+#define _RAPTOR_REGION_H_
+
+// Per-thread attribution of the runtime counters to the innermost region
+// opened with __raptor_region_begin, see obj/Region.cpp.
+
+struct __raptor_region_stats {
+  long long calls = 0;
+  double seconds = 0;      // Wall time, including nested regions.
+  double self_seconds = 0; // Wall time, excluding nested regions.
+  long long trunc_flops = 0;
+  long long double_flops = 0;
+  long long float_flops = 0;
+  long long half_flops = 0;
+  long long bfloat_flops = 0;
+  long long load_bytes = 0;
+  long long store_bytes = 0;
+  long long shadow_count = 0;
+  long long shadow_violations = 0;
+  double shadow_l1_err = 0;
+
+  void add(const __raptor_region_stats &other) {
+    calls += other.calls;
+    seconds += other.seconds;
+    self_seconds += other.self_seconds;
+    trunc_flops += other.trunc_flops;
+    double_flops += other.double_flops;
+    float_flops += other.float_flops;
+    half_flops += other.half_flops;
+    bfloat_flops += other.bfloat_flops;
+    load_bytes += other.load_bytes;
+    store_bytes += other.store_bytes;
+    shadow_count += other.shadow_count;
+    shadow_violations += other.shadow_violations;
+    shadow_l1_err += other.shadow_l1_err;
+  }
+};
+
+// The innermost open region of this thread, null outside of any region.
+extern thread_local __raptor_region_stats *raptor_fprt_current_region;
+
+#endif // _RAPTOR_REGION_H_
@@ -0,0 +1,36 @@
+#ifndef _RAPTOR_REPORT_H_
+#define _RAPTOR_REPORT_H_
+
+// Counter indices of the roofline report, see ReportCounters.def. Included by
+// both the pass and the runtime so this header must stay free of any runtime
+// or LLVM dependencies.
+
+enum RaptorReportFormat : unsigned {
+#define RAPTOR_REPORT_FORMAT(NAME, WIDTH) RaptorReportFormat_##NAME,
+#include "ReportCounters.def"
+  RaptorReportNumFormats
+};
+
+enum RaptorReportOpClass : unsigned {
+#define RAPTOR_REPORT_OP_CLASS(NAME, FLOPS_PER_OP) RaptorReportOpClass_##NAME,
+#include "ReportCounters.def"
+  RaptorReportNumOpClasses
+};
+
+constexpr unsigned RaptorReportCountersPerFormat = RaptorReportNumOpClasses + 2;
+constexpr unsigned RaptorReportNumCounters =
+    RaptorReportNumFormats * RaptorReportCountersPerFormat;
+
+constexpr unsigned raptorReportOpCounter(unsigned Format, unsigned OpClass) {
+  return Format * RaptorReportCountersPerFormat + OpClass;
+}
+
+constexpr unsigned raptorReportLoadCounter(unsigned Format) {
+  return Format * RaptorReportCountersPerFormat + RaptorReportNumOpClasses;
+}
+
+constexpr unsigned raptorReportStoreCounter(unsigned Format) {
+  return Format * RaptorReportCountersPerFormat + RaptorReportNumOpClasses + 1;
+}
+
+#endif // _RAPTOR_REPORT_H_
@@ -0,0 +1,15 @@
+#ifndef _RAPTOR_STOCHASTIC_H_
+#define _RAPTOR_STOCHASTIC_H_
+
+#include <mpfr.h>
+
+// Stochastic rounding of the op mode results, see obj/Stochastic.cpp.
+
+// This thread's register for the op results before they are rounded.
+mpfr_ptr raptor_fprt_sr_extended();
+
+// Round x to the precision of r, away from zero with probability of the
+// distance to r truncated, in units of the last place. Clobbers x.
+void raptor_fprt_sr_round(mpfr_ptr r, mpfr_ptr x);
+
+#endif // _RAPTOR_STOCHASTIC_H_
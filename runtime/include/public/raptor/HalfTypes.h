@@ -0,0 +1,20 @@
+#ifndef _RAPTOR_HALF_TYPES_H_
+#define _RAPTOR_HALF_TYPES_H_
+
+// The 16-bit floating point types of FloatTypes.def. They are only available
+// where the compiler supports them, test RAPTOR_FPRT_HAS_HALF and
+// RAPTOR_FPRT_HAS_BFLOAT. The types use reserved names so they do not clash
+// with the `half` and `bfloat` of CUDA, half.hpp or the program itself, the
+// functions and log files derived from them are still named half and bfloat.
+
+#if defined(__FLT16_MAX__)
+typedef _Float16 __raptor_half;
+#define RAPTOR_FPRT_HAS_HALF 1
+#endif
+
+#if defined(__BFLT16_MAX__)
+typedef __bf16 __raptor_bfloat;
+#define RAPTOR_FPRT_HAS_BFLOAT 1
+#endif
+
+#endif // _RAPTOR_HALF_TYPES_H_
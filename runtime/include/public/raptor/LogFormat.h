@@ -0,0 +1,64 @@
+#ifndef _RAPTOR_LOG_FORMAT_H_
+#define _RAPTOR_LOG_FORMAT_H_
+
+// On-disk format of the flop logs written with RAPTOR_FLOP_LOG_SITES=1.
+//
+// <log> is a plain array of fixed width records, one per logged operand, so
+// it can be memory mapped and split at any record boundary:
+//
+//   struct __raptor_log_record_<type> records[];
+//
+// <log>.sites maps the site IDs to source locations, one "<id>\t<file:line:col>"
+// per line. ID 0 is used when the location is unknown.
+
+#include <stdint.h>
+
+enum __raptor_log_op {
+#define RAPTOR_LOG_OP(NAME) __raptor_log_op_##NAME,
+#include "LogOps.def"
+  __raptor_log_num_ops
+};
+
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME)                               \
+  struct __raptor_log_record_##NAME {                                          \
+    CPP_TY value;                                                              \
+    uint32_t site;                                                             \
+    /* enum __raptor_log_op */                                                 \
+    uint8_t op;                                                                \
+    /* Which operand of the operation value is, starting at 0. */              \
+    uint8_t operand;                                                           \
+    uint16_t reserved;                                                         \
+  };
+#include "FloatTypes.def"
+
+#ifdef __cplusplus
+static constexpr const char *__raptor_log_op_names[] = {
+#define RAPTOR_LOG_OP(NAME) #NAME,
+#include "LogOps.def"
+};
+
+namespace __raptor_log_format {
+// Whether name is NAME, llvm_NAME, llvm_NAME_<type>, __NAME_finite etc.
+constexpr bool matchesOp(const char *name, const char *op) {
+  if (name[0] == 'l' && name[1] == 'l' && name[2] == 'v' && name[3] == 'm' &&
+      name[4] == '_')
+    name += 5;
+  else if (name[0] == '_' && name[1] == '_')
+    name += 2;
+  for (; *op; ++op, ++name)
+    if (*op != *name)
+      return false;
+  return *name == '\0' || *name == '_';
+}
+} // namespace __raptor_log_format
+
+// Maps the operation names used by the runtime entry points to their kind.
+constexpr uint8_t __raptor_log_op_kind(const char *name) {
+  for (unsigned i = 1; i < __raptor_log_num_ops; ++i)
+    if (__raptor_log_format::matchesOp(name, __raptor_log_op_names[i]))
+      return i;
+  return __raptor_log_op_unknown;
+}
+#endif
+
+#endif // _RAPTOR_LOG_FORMAT_H_
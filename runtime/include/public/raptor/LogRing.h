@@ -0,0 +1,41 @@
+#ifndef _RAPTOR_LOG_RING_H_
+#define _RAPTOR_LOG_RING_H_
+
+// Layout of the shared memory ring buffers the flop logger writes with
+// RAPTOR_FLOP_LOG_SHM, for use by live consumers such as raptor-logd.
+//
+// The file starts with struct __raptor_log_ring, the data follows at
+// RAPTOR_LOG_RING_DATA_OFFSET. head and tail count bytes since the ring was
+// created, the data of byte i is at data[i % capacity]. There is one producer
+// and one consumer: only the producer advances head, with release semantics
+// after writing the data, and only the consumer advances tail once it is done
+// reading. Both always move by whole records and capacity is a multiple of the
+// record size, so a record never wraps around the end of the data.
+
+#include <stdint.h>
+
+#define RAPTOR_LOG_RING_MAGIC 0x474e495252545052ull /* "RPTRRING" */
+#define RAPTOR_LOG_RING_VERSION 1
+#define RAPTOR_LOG_RING_DATA_OFFSET 4096
+
+struct __raptor_log_ring {
+  uint64_t magic;
+  uint32_t version;
+  // Size of a record, sizeof(type) or sizeof(__raptor_log_record_<type>).
+  uint32_t record_size;
+  // Bytes of data, a multiple of record_size.
+  uint64_t capacity;
+  // Name of the logged type, e.g. "double".
+  char type[16];
+  // Whether the records are the __raptor_log_record_ of LogFormat.h.
+  uint32_t sites;
+  // Set by the producer once it will not write any more.
+  uint32_t closed;
+  // Records dropped because the ring was full, with the drop policy.
+  uint64_t dropped;
+
+  __attribute__((aligned(64))) uint64_t head;
+  __attribute__((aligned(64))) uint64_t tail;
+};
+
+#endif // _RAPTOR_LOG_RING_H_
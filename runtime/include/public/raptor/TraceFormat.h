@@ -0,0 +1,171 @@
+#ifndef _RAPTOR_TRACE_FORMAT_H_
+#define _RAPTOR_TRACE_FORMAT_H_
+
+// On-disk format of the tapes spilled with RAPTOR_TRACE_SPILL.
+//
+// The file starts with a __raptor_trace_file_header, followed by the tape in
+// segments of consecutive nodes, each a __raptor_trace_segment_header and the
+// encoded nodes. It ends in an index and a __raptor_trace_trailer, which
+// tells where the index starts:
+//
+//   uint64_t segment_offsets[num_segments];
+//   uint32_t outputs[num_outputs];          sorted node IDs
+//   num_sites times: uint32_t name_length, name, uint32_t loc_length, loc
+//
+// Site 0 is unused. Each node is encoded as
+//
+//   uint8_t flags      __raptor_trace_node_flags, the number of inputs
+//                      shifted by __raptor_trace_input_shift and
+//                      __raptor_trace_same_site
+//   varint site        unless the flags have __raptor_trace_same_site
+//   varint id - input  for every input, inputs always precede their users
+//   double result
+//   derivatives        for every input, float with __raptor_trace_float
+//                      set in the file header, double otherwise
+//
+// where varints are unsigned LEB128.
+
+#include <stdint.h>
+
+#define RAPTOR_TRACE_MAGIC "RPTRTAPE"
+#define RAPTOR_TRACE_VERSION 1
+#define RAPTOR_TRACE_SEGMENT_MAGIC 0x4d474553u
+
+enum __raptor_trace_node_flags {
+  __raptor_trace_input = 1 << 0,
+  __raptor_trace_const = 1 << 1,
+  __raptor_trace_output = 1 << 2,
+  __raptor_trace_input_shift = 4,
+  __raptor_trace_input_mask = 3 << 4,
+  __raptor_trace_same_site = 1 << 6,
+};
+
+enum __raptor_trace_file_flags {
+  __raptor_trace_float = 1 << 0,
+};
+
+struct __raptor_trace_file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+};
+
+struct __raptor_trace_segment_header {
+  uint32_t magic;
+  uint32_t num_nodes;
+  uint32_t first_id;
+  uint32_t reserved;
+  // Size of the encoded nodes that follow.
+  uint64_t bytes;
+};
+
+struct __raptor_trace_trailer {
+  uint64_t index_offset;
+  uint32_t num_nodes;
+  uint32_t num_segments;
+  uint32_t num_outputs;
+  uint32_t num_sites;
+  char magic[8];
+};
+
+#ifdef __cplusplus
+#include <string.h>
+
+// The largest encoding of a node.
+static constexpr unsigned __raptor_trace_max_node_bytes =
+    1 + 5 + 3 * 5 + 8 + 3 * 8;
+
+struct __raptor_trace_node {
+  double result;
+  double derivatives[3];
+  uint32_t inputs[3];
+  uint32_t site;
+  uint8_t flags;
+  uint8_t input_num;
+};
+
+namespace __raptor_trace_format {
+inline uint8_t *putVarint(uint8_t *p, uint32_t v) {
+  while (v >= 0x80) {
+    *p++ = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (uint8_t)v;
+  return p;
+}
+
+inline const uint8_t *getVarint(const uint8_t *p, uint32_t &v) {
+  v = 0;
+  for (unsigned shift = 0;; shift += 7) {
+    uint8_t b = *p++;
+    v |= (uint32_t)(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return p;
+  }
+}
+
+template <typename T> inline uint8_t *put(uint8_t *p, T v) {
+  memcpy(p, &v, sizeof(v));
+  return p + sizeof(v);
+}
+
+template <typename T> inline const uint8_t *get(const uint8_t *p, T &v) {
+  memcpy(&v, p, sizeof(v));
+  return p + sizeof(v);
+}
+} // namespace __raptor_trace_format
+
+// Encode node `id`. `site` is the site of the previous node of the segment
+// and is updated.
+inline uint8_t *__raptor_trace_encode(uint8_t *p, uint32_t id,
+                                      const __raptor_trace_node &node,
+                                      uint32_t &site, bool floats) {
+  using namespace __raptor_trace_format;
+  uint8_t flags = node.flags | node.input_num << __raptor_trace_input_shift;
+  if (node.site == site)
+    flags |= __raptor_trace_same_site;
+  *p++ = flags;
+  if (node.site != site)
+    p = putVarint(p, node.site);
+  site = node.site;
+  for (unsigned i = 0; i < node.input_num; i++)
+    p = putVarint(p, id - node.inputs[i]);
+  p = put(p, node.result);
+  for (unsigned i = 0; i < node.input_num; i++)
+    p = floats ? put(p, (float)node.derivatives[i])
+               : put(p, node.derivatives[i]);
+  return p;
+}
+
+inline const uint8_t *__raptor_trace_decode(const uint8_t *p, uint32_t id,
+                                            __raptor_trace_node &node,
+                                            uint32_t &site, bool floats) {
+  using namespace __raptor_trace_format;
+  uint8_t flags = *p++;
+  node.flags = flags & (__raptor_trace_input | __raptor_trace_const |
+                        __raptor_trace_output);
+  node.input_num =
+      (flags & __raptor_trace_input_mask) >> __raptor_trace_input_shift;
+  if (!(flags & __raptor_trace_same_site))
+    p = getVarint(p, site);
+  node.site = site;
+  for (unsigned i = 0; i < node.input_num; i++) {
+    uint32_t delta;
+    p = getVarint(p, delta);
+    node.inputs[i] = id - delta;
+  }
+  p = get(p, node.result);
+  for (unsigned i = 0; i < node.input_num; i++) {
+    if (floats) {
+      float d;
+      p = get(p, d);
+      node.derivatives[i] = d;
+    } else {
+      p = get(p, node.derivatives[i]);
+    }
+  }
+  return p;
+}
+#endif
+
+#endif // _RAPTOR_TRACE_FORMAT_H_
@@ -8,6 +8,8 @@
 template <typename fty>
 fty *__raptor_truncate_op_func(fty *, int, int, int, int);
 template <typename fty> fty *__raptor_truncate_op_func(fty *, int, int, int);
+template <typename fty>
+fty *__raptor_truncate_op_func(fty *, int, int, int, int, int, int);
 #endif
 
 #ifdef __cplusplus
@@ -23,13 +25,50 @@ void __raptor_fprt_delete_all();
 long long __raptor_get_trunc_flop_count();
 long long f_raptor_get_trunc_flop_count();
 
-#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY)                                     \
-  struct __raptor_logged_flops_##CPP_TY {                                      \
+void __raptor_flop_report_write(const char *path);
+void __raptor_flop_report_clear();
+void __raptor_cache_report_write(const char *path);
+
+void __raptor_alloc_register(void *ptr, int64_t size, const char *name);
+void __raptor_alloc_unregister(void *ptr);
+void __raptor_alloc_report_write(const char *path);
+void __raptor_flop_report_estimate(const char *machine, const char *truncation,
+                                   const char *path);
+
+void __raptor_region_begin(const char *name);
+void __raptor_region_end();
+void __raptor_region_report_write(const char *path);
+void f_raptor_region_begin(const char *name);
+void f_raptor_region_end();
+
+void __raptor_context_report_write(const char *path);
+void f_raptor_context_report_write(const char *path);
+
+void __raptor_cancellation_report_write(const char *path);
+void f_raptor_cancellation_report_write(const char *path);
+
+void __raptor_fp_events_report_write(const char *path);
+void f_raptor_fp_events_report_write(const char *path);
+
+void __raptor_range_profile_write(const char *path);
+void f_raptor_range_profile_write(const char *path);
+
+void __raptor_sr_set_stream(int64_t stream);
+
+void __raptor_flop_log_start();
+void __raptor_flop_log_stop();
+void __raptor_flop_log_sample(int64_t every);
+void __raptor_flop_log_max_records(int64_t max);
+void f_raptor_flop_log_start();
+void f_raptor_flop_log_stop();
+
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME)                               \
+  struct __raptor_logged_flops_##NAME {                                        \
     CPP_TY *vals;                                                              \
     size_t num;                                                                \
   };                                                                           \
-  void __raptor_clear_flop_log_##CPP_TY();                                     \
-  void __raptor_set_flop_log_##CPP_TY(const char *path);
+  void __raptor_clear_flop_log_##NAME();                                       \
+  void __raptor_set_flop_log_##NAME(const char *path);
 #include "FloatTypes.def"
 
 #ifdef __cplusplus
@@ -1,78 +1,992 @@
+// Flop logger. Every logged operand is appended to a large per-thread buffer.
+// Full buffers are handed to a background writer thread through a lock-free
+// queue and written out with writev, so logging costs a memcpy per operand and
+// a syscall per batch of buffers instead of a stream write per operand.
+//
+//   RAPTOR_FLOP_LOG_PREFIX=<prefix>      log <type> to <prefix>.<type>
+//   RAPTOR_FLOP_LOG_BUFFER_SIZE=<bytes>  size of each buffer, default 1 MiB
+//   RAPTOR_FLOP_LOG_BUFFERS=<n>          buffers in flight before logging
+//                                        threads wait for the writer,
+//                                        default 64
+//   RAPTOR_FLOP_LOG_DIRECT=1             write with O_DIRECT, bypassing the
+//                                        page cache
+//
+// <type> is double, float and, where the compiler supports them, half and
+// bfloat, see raptor/HalfTypes.h.
+//
+// Buffers are flushed when a log is cleared or reopened, when a thread exits
+// and at program exit. Clearing or reopening a log while other threads are
+// still logging to it is not supported.
+//
+// With RAPTOR_FLOP_LOG_MODE=histogram nothing but a histogram of the exponent
+// field and of the special values is kept per type, and written as a small
+// text file (<prefix>.<type>.hist) when the log is cleared or at exit. Set
+// RAPTOR_FLOP_LOG_MANTISSA=1 to also count the trailing zero bits of the
+// mantissa. scripts/raptor_plot_float_histogram.py reads both formats.
+//
+// By default the raw log is just the logged values. RAPTOR_FLOP_LOG_SITES=1
+// instead writes the fixed width records of raptor/LogFormat.h, which add the
+// source location and the kind of the operation and which operand of it the
+// value was. Locations are stored as 32-bit IDs, the table mapping them back
+// to file:line:col is written next to the log as <prefix>.<type>.sites when
+// the log is cleared or at exit.
+//
+// Instead of files the logs can go to shared memory ring buffers, to be
+// consumed live by another process (e.g. raptor-logd) without touching the
+// file system:
+//
+//   RAPTOR_FLOP_LOG_SHM=<name>           log <type> to /dev/shm/<name>.<type>
+//   RAPTOR_FLOP_LOG_SHM_SIZE=<bytes>     size of each ring, default 64 MiB
+//   RAPTOR_FLOP_LOG_SHM_POLICY=block     wait for the consumer when a ring is
+//                                        full (default), or drop: count and
+//                                        discard the records that do not fit
+//
+// __raptor_set_flop_log_<type>("shm:<name>") opens a ring explicitly. The
+// layout is described in raptor/LogRing.h.
+//
+// Records of different threads end up interleaved in the log in no particular
+// order. With RAPTOR_FLOP_LOG_PER_THREAD=1 every thread writes its own file,
+// <log>.t<tag>, instead. Threads of an OpenMP team are tagged with their
+// omp_get_thread_num() if that tag is still free, all other threads with the
+// smallest free tag, so the first thread to log (usually the main thread) gets
+// t0. scripts/raptor_merge_flop_logs.py concatenates the files in tag order.
+// This does not apply to rings.
+//
+// To log less, in all modes:
+//
+//   RAPTOR_FLOP_LOG_SAMPLE=<n>           log only every n-th value of each
+//                                        thread
+//   RAPTOR_FLOP_LOG_MAX_RECORDS=<n>      stop after at most n values in
+//                                        total, the threads claim the budget
+//                                        in chunks and may leave a little
+//                                        unused
+//   RAPTOR_FLOP_LOG_PAUSED=1             log nothing until
+//                                        __raptor_flop_log_start()
+//
+// __raptor_flop_log_start/stop open and close the logging window at runtime,
+// __raptor_flop_log_sample and __raptor_flop_log_max_records change the other
+// two settings.
+
 #include "raptor/Common.h"
+#include "raptor/LogFormat.h"
+#include "raptor/LogRing.h"
 #include "raptor/raptor.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
-#include <fstream>
-#include <ios>
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
-#include <memory>
+#include <iterator>
+#include <limits.h>
+#include <limits>
+#include <mutex>
+#include <set>
 #include <string>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
-typedef void (*LogFuncTy_ieee_64)(double);
-typedef void (*LogFuncTy_ieee_32)(float);
-// typedef void (*LogFuncTy_ieee_16)(half);
+// Only used to tag the threads of OpenMP programs.
+extern "C" int omp_get_thread_num() __attribute__((weak));
+
+// The logger the pass passes to the __raptor_fprtlog_ functions, called with
+// the location, the __raptor_log_op of the operation and the operand index.
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME)                               \
+  typedef void (*LogFuncTy_##FROM_TY)(CPP_TY, const char *, uint8_t, uint8_t);
+#include "raptor/FloatTypes.def"
 
 void __raptor_fprt_trunc_change(int64_t is_push, int64_t to_e, int64_t to_m,
                                 int64_t mode, const char *loc, void *scratch) {}
 
 namespace {
-struct FloatLoggerTy {
 
-#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY)                                     \
-  std::unique_ptr<std::ofstream> OS_##FROM_TY;
+enum LogTypeIdx : unsigned {
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME) LogType_##FROM_TY,
+#include "raptor/FloatTypes.def"
+  NumLogTypes
+};
+
+template <typename T> constexpr unsigned getLogTypeIdx() {
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME)                               \
+  if constexpr (std::is_same<T, CPP_TY>::value)                                \
+    return LogType_##FROM_TY;
+#include "raptor/FloatTypes.def"
+  return NumLogTypes;
+}
+
+template <typename T> struct LogRecordTy;
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME)                               \
+  template <> struct LogRecordTy<CPP_TY> {                                     \
+    typedef __raptor_log_record_##NAME type;                                   \
+  };
 #include "raptor/FloatTypes.def"
 
+// Alignment of the buffers and of the writes in O_DIRECT mode.
+constexpr size_t LogBlockSize = 4096;
+
+struct LogFileTy {
+  int fd;
+  bool direct;
+  // With O_DIRECT we may only write whole blocks, the data of the partially
+  // filled block at the end of the file waits here.
+  char *staging = nullptr;
+  size_t stagingUsed = 0;
+  // Shared memory ring instead of a file, mapped with ringMapSize bytes.
+  __raptor_log_ring *ring = nullptr;
+  size_t ringMapSize = 0;
+  bool ringWarned = false;
+  // In per-thread mode the log itself is not opened. The files of the
+  // threads are opened on their first record and have parent set to it.
+  bool perThread = false;
+  uint64_t generation = 0;
+  std::string path;
+  std::vector<LogFileTy *> threadFiles;
+  LogFileTy *parent = nullptr;
+};
+
+struct LogBuffer {
+  LogBuffer *next;
+  LogFileTy *file;
+  size_t used;
+  char *data;
+};
+
+// std::numeric_limits is not specialized for the 16-bit types everywhere.
+template <typename T> constexpr unsigned getLogMantissaBits() {
+#ifdef RAPTOR_FPRT_HAS_HALF
+  if constexpr (std::is_same<T, __raptor_half>::value)
+    return 10;
+#endif
+#ifdef RAPTOR_FPRT_HAS_BFLOAT
+  if constexpr (std::is_same<T, __raptor_bfloat>::value)
+    return 7;
+#endif
+  return std::numeric_limits<T>::digits - 1;
+}
+
+template <typename T> struct LogFloatInfo {
+  static constexpr unsigned Bits = sizeof(T) * 8;
+  static constexpr unsigned MantissaBits = getLogMantissaBits<T>();
+  static constexpr unsigned ExponentBits = Bits - 1 - MantissaBits;
+  static constexpr unsigned Bias = (1u << (ExponentBits - 1)) - 1;
+  typedef std::conditional_t<
+      Bits == 64, uint64_t,
+      std::conditional_t<Bits == 32, uint32_t, uint16_t>>
+      IntTy;
+};
+
+enum LogSpecialValue : unsigned { Zero, Subnormal, Inf, NaN, NumSpecialValues };
+
+const char *LogSpecialValueNames[NumSpecialValues] = {"zero", "subnormal",
+                                                      "inf", "nan"};
+
+// Sized for the widest logged type, narrower types use a prefix.
+struct LogHistogram {
+  uint64_t count = 0;
+  uint64_t exponent[1 << 11] = {};
+  uint64_t special[NumSpecialValues] = {};
+  // Indexed by the number of trailing zero bits of the mantissa.
+  uint64_t trailingZeros[53] = {};
+
+  void add(const LogHistogram &other) {
+    count += other.count;
+    for (unsigned i = 0; i < std::size(exponent); ++i)
+      exponent[i] += other.exponent[i];
+    for (unsigned i = 0; i < NumSpecialValues; ++i)
+      special[i] += other.special[i];
+    for (unsigned i = 0; i < std::size(trailingZeros); ++i)
+      trailingZeros[i] += other.trailingZeros[i];
+  }
+
+  template <typename T> void log(T F, bool mantissa) {
+    typedef LogFloatInfo<T> Info;
+    typename Info::IntTy bits;
+    memcpy(&bits, &F, sizeof(F));
+    uint64_t man = bits & ((1ull << Info::MantissaBits) - 1);
+    unsigned exp =
+        (bits >> Info::MantissaBits) & ((1u << Info::ExponentBits) - 1);
+    ++count;
+    ++exponent[exp];
+    if (exp == 0)
+      ++special[man ? Subnormal : Zero];
+    else if (exp == (1u << Info::ExponentBits) - 1)
+      ++special[man ? NaN : Inf];
+    else if (mantissa)
+      ++trailingZeros[man ? __builtin_ctzll(man) : Info::MantissaBits];
+  }
+};
+
+// Assigns the site IDs. The location strings the pass emits are uniqued per
+// module, so most lookups are by pointer; equal strings from different modules
+// share an ID. 0 stands for no location.
+class LogSitesTy {
+  std::mutex lock;
+  std::unordered_map<const char *, uint32_t> byPtr;
+  std::unordered_map<std::string, uint32_t> byName;
+  // The location of ID i + 1.
+  std::vector<std::string> names;
+
+public:
+  uint32_t lookup(const char *loc) {
+    if (!loc)
+      return 0;
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = byPtr.find(loc);
+    if (it != byPtr.end())
+      return it->second;
+    auto res = byName.emplace(loc, names.size() + 1);
+    if (res.second)
+      names.push_back(loc);
+    byPtr[loc] = res.first->second;
+    return res.first->second;
+  }
+
+  template <typename T> void write(const std::string &path, const char *type) {
+    FILE *out = fopen(path.c_str(), "w");
+    if (!out) {
+      std::cerr << "Could not open flop log site table '" << path
+                << "': " << strerror(errno) << "\n";
+      return;
+    }
+    typedef typename LogRecordTy<T>::type RecordTy;
+    fprintf(out, "# raptor flop log sites v1\n");
+    fprintf(out, "# record %zu bytes: %s value, uint32 site, uint8 op, "
+                 "uint8 operand, uint16 reserved\n",
+            sizeof(RecordTy), type);
+    for (unsigned i = 0; i < __raptor_log_num_ops; ++i)
+      fprintf(out, "# op %u %s\n", i, __raptor_log_op_names[i]);
+    std::lock_guard<std::mutex> guard(lock);
+    for (size_t i = 0; i < names.size(); ++i)
+      fprintf(out, "%zu\t%s\n", i + 1, names[i].c_str());
+    fclose(out);
+  }
+};
+
+struct LogThreadTy;
+
+// Write all of iov, retrying after partial writes.
+bool writeAll(int fd, struct iovec *iov, int iovcnt) {
+  while (iovcnt > 0) {
+    ssize_t n = writev(fd, iov, iovcnt);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      ++iov;
+      --iovcnt;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return true;
+}
+
+class FloatLoggerTy {
+  size_t bufferSize = 1 << 20;
+  unsigned maxBuffers = 64;
+  bool direct = false;
+  bool histogram = false;
+  bool histogramMantissa = false;
+  bool sites = false;
+  bool perThread = false;
+
+  // Why nothing is logged at the moment, 0 while logging. This is the only
+  // check on the logging path when not logging.
+  enum PauseReason : unsigned { Stopped = 1, BudgetExhausted = 2 };
+  std::atomic<unsigned> paused = 0;
+  // Log one in sampleEvery records of each thread.
+  std::atomic<uint64_t> sampleEvery = 1;
+  // RAPTOR_FLOP_LOG_MAX_RECORDS, claimed by the threads in chunks so the
+  // counter is not touched for every record.
+  static constexpr uint64_t BudgetChunk = 1024;
+  std::atomic<bool> limited = false;
+  std::atomic<uint64_t> budgetLeft = 0;
+  // Tells a thread whether its file still belongs to the current log.
+  uint64_t generations = 0;
+  size_t ringSize = 64 << 20;
+  bool ringDrop = false;
+
+  LogSitesTy siteTable;
+  std::string logPath[NumLogTypes];
+
+  // Histogram mode. The histograms of exited threads are merged here.
+  std::atomic<bool> histogramEnabled[NumLogTypes] = {};
+  std::string histogramPath[NumLogTypes];
+  LogHistogram histograms[NumLogTypes];
+
+  std::atomic<LogFileTy *> files[NumLogTypes] = {};
+
+  // Full buffers, pushed by the logging threads and taken all at once by the
+  // writer. The list is in reverse order.
+  std::atomic<LogBuffer *> queue = nullptr;
+  // Buffers queued or being written.
+  std::atomic<unsigned> pending = 0;
+
+  // Protects everything below.
+  std::mutex lock;
+  std::condition_variable wake, drained, freed;
+  std::vector<LogBuffer *> pool;
+  unsigned allocated = 0;
+  std::set<LogThreadTy *> threads;
+  std::set<unsigned> threadTags;
+  std::thread writer;
+  bool stop = false;
+
+  void writeDirect(LogFileTy *file, const char *data, size_t size) {
+    while (size) {
+      size_t n = std::min(size, bufferSize - file->stagingUsed);
+      memcpy(file->staging + file->stagingUsed, data, n);
+      file->stagingUsed += n;
+      data += n;
+      size -= n;
+      if (file->stagingUsed == bufferSize) {
+        struct iovec iov = {file->staging, bufferSize};
+        if (!writeAll(file->fd, &iov, 1))
+          perror("raptor: flop log write failed");
+        file->stagingUsed = 0;
+      }
+    }
+  }
+
+  // Only the writer thread produces into a ring, so the producer side needs
+  // no synchronization besides publishing head.
+  void writeRing(LogFileTy *file, const char *data, size_t size) {
+    __raptor_log_ring *ring = file->ring;
+    char *base = (char *)ring + RAPTOR_LOG_RING_DATA_OFFSET;
+    uint64_t head = ring->head;
+    auto waitStart = std::chrono::steady_clock::now();
+    while (size) {
+      uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+      uint64_t space = ring->capacity - (head - tail);
+      if (space == 0) {
+        if (ringDrop) {
+          __atomic_fetch_add(&ring->dropped, size / ring->record_size,
+                             __ATOMIC_RELAXED);
+          return;
+        }
+        if (!file->ringWarned && std::chrono::steady_clock::now() - waitStart >
+                                     std::chrono::seconds(10)) {
+          std::cerr << "raptor: flop log ring for " << ring->type
+                    << " is full, waiting for a consumer\n";
+          file->ringWarned = true;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        continue;
+      }
+      // capacity, head and size are multiples of the record size, so this
+      // never cuts a record.
+      uint64_t offset = head % ring->capacity;
+      size_t n = std::min<uint64_t>({size, space, ring->capacity - offset});
+      memcpy(base + offset, data, n);
+      head += n;
+      data += n;
+      size -= n;
+      __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+    }
+  }
+
+  // Writes a list of buffers in queue order, batching runs of buffers for the
+  // same file into one writev.
+  void writeBuffers(LogBuffer *list) {
+    std::vector<struct iovec> iov;
+    while (list) {
+      LogFileTy *file = list->file;
+      iov.clear();
+      for (; list && list->file == file && iov.size() < IOV_MAX;
+           list = list->next) {
+        if (file->ring)
+          writeRing(file, list->data, list->used);
+        else if (file->direct)
+          writeDirect(file, list->data, list->used);
+        else
+          iov.push_back({list->data, list->used});
+      }
+      if (!iov.empty() && !writeAll(file->fd, iov.data(), iov.size()))
+        perror("raptor: flop log write failed");
+    }
+  }
+
+  void writerLoop() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+      wake.wait_for(guard, std::chrono::milliseconds(100), [&] {
+        return stop || queue.load(std::memory_order_relaxed);
+      });
+      LogBuffer *head = queue.exchange(nullptr, std::memory_order_acquire);
+      if (!head) {
+        if (stop)
+          break;
+        continue;
+      }
+      guard.unlock();
+
+      LogBuffer *list = nullptr;
+      unsigned n = 0;
+      while (head) {
+        LogBuffer *next = head->next;
+        head->next = list;
+        list = head;
+        head = next;
+        ++n;
+      }
+      writeBuffers(list);
+
+      guard.lock();
+      for (; list; list = list->next)
+        pool.push_back(list);
+      pending -= n;
+      freed.notify_all();
+      drained.notify_all();
+    }
+  }
+
+  LogBuffer *acquire(LogFileTy *file) {
+    std::unique_lock<std::mutex> guard(lock);
+    // Throttle the logging threads if the writer cannot keep up.
+    freed.wait(guard, [&] { return !pool.empty() || allocated < maxBuffers; });
+    LogBuffer *buf;
+    if (!pool.empty()) {
+      buf = pool.back();
+      pool.pop_back();
+    } else {
+      buf = new LogBuffer;
+      buf->data = (char *)aligned_alloc(LogBlockSize, bufferSize);
+      ++allocated;
+    }
+    buf->file = file;
+    buf->used = 0;
+    return buf;
+  }
+
+  void release(LogBuffer *buf) {
+    std::lock_guard<std::mutex> guard(lock);
+    pool.push_back(buf);
+    freed.notify_one();
+  }
+
+  void flushThreads(LogFileTy *file);
+  LogHistogram collectHistogram(unsigned Idx);
+
+  template <typename T> void writeHistogram() {
+    constexpr unsigned Idx = getLogTypeIdx<T>();
+    typedef LogFloatInfo<T> Info;
+    LogHistogram hist = collectHistogram(Idx);
+    FILE *out = fopen(histogramPath[Idx].c_str(), "w");
+    if (!out) {
+      std::cerr << "Could not open flop histogram '" << histogramPath[Idx]
+                << "': " << strerror(errno) << "\n";
+      return;
+    }
+    fprintf(out, "# raptor flop histogram v1\n");
+    fprintf(out, "type %s\n", getTypeStr<T>());
+    fprintf(out, "exponent_bits %u\n", Info::ExponentBits);
+    fprintf(out, "mantissa_bits %u\n", Info::MantissaBits);
+    fprintf(out, "bias %u\n", Info::Bias);
+    fprintf(out, "count %llu\n", (unsigned long long)hist.count);
+    for (unsigned i = 0; i < NumSpecialValues; ++i)
+      fprintf(out, "%s %llu\n", LogSpecialValueNames[i],
+              (unsigned long long)hist.special[i]);
+    // Biased exponent field, only the bins in use.
+    for (unsigned i = 0; i < (1u << Info::ExponentBits); ++i)
+      if (hist.exponent[i])
+        fprintf(out, "exponent %u %llu\n", i,
+                (unsigned long long)hist.exponent[i]);
+    if (histogramMantissa)
+      for (unsigned i = 0; i <= Info::MantissaBits; ++i)
+        if (hist.trailingZeros[i])
+          fprintf(out, "trailing_zeros %u %llu\n", i,
+                  (unsigned long long)hist.trailingZeros[i]);
+    fclose(out);
+  }
+
+  void closeFile(LogFileTy *file) {
+    for (auto threadFile : file->threadFiles)
+      closeFile(threadFile);
+    if (file->ring) {
+      __atomic_store_n(&file->ring->closed, 1, __ATOMIC_RELEASE);
+      munmap(file->ring, file->ringMapSize);
+    } else if (file->direct) {
+#ifdef O_DIRECT
+      fcntl(file->fd, F_SETFL, fcntl(file->fd, F_GETFL) & ~O_DIRECT);
+#endif
+      struct iovec iov = {file->staging, file->stagingUsed};
+      if (file->stagingUsed && !writeAll(file->fd, &iov, 1))
+        perror("raptor: flop log write failed");
+      free(file->staging);
+    }
+    if (file->fd >= 0)
+      close(file->fd);
+    delete file;
+  }
+
+public:
   template <typename T> const char *getTypeStr() {
-#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY)                                     \
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME)                               \
   if constexpr (std::is_same<T, CPP_TY>::value)                                \
-    return #CPP_TY;
+    return #NAME;
 #include "raptor/FloatTypes.def"
     abort();
   }
 
+  void enqueue(LogBuffer *buf) {
+    if (!buf->used) {
+      release(buf);
+      return;
+    }
+    pending.fetch_add(1, std::memory_order_relaxed);
+    buf->next = queue.load(std::memory_order_relaxed);
+    while (!queue.compare_exchange_weak(buf->next, buf,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed))
+      ;
+    wake.notify_one();
+  }
+
+  void registerThread(LogThreadTy *thread) {
+    std::lock_guard<std::mutex> guard(lock);
+    threads.insert(thread);
+  }
+
+  void unregisterThread(LogThreadTy *thread) {
+    std::lock_guard<std::mutex> guard(lock);
+    threads.erase(thread);
+  }
+
   template <typename T> void clear() {
-#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY)                                     \
-  if constexpr (std::is_same<T, CPP_TY>::value)                                \
-    OS_##FROM_TY.reset(nullptr);
-#include "raptor/FloatTypes.def"
+    constexpr unsigned Idx = getLogTypeIdx<T>();
+    static_assert(Idx < NumLogTypes, "not a logged type");
+    if (histogram) {
+      if (histogramEnabled[Idx].exchange(false))
+        writeHistogram<T>();
+      return;
+    }
+    LogFileTy *file = files[Idx].exchange(nullptr);
+    if (!file)
+      return;
+    flushThreads(file);
+    // Before closing, a ring consumer looks for the table once it is closed.
+    if (sites)
+      siteTable.write<T>(logPath[Idx] + ".sites", getTypeStr<T>());
+    closeFile(file);
   }
 
   template <typename T> void setLogPath(const std::string Path) {
-#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY)                                     \
-  if constexpr (std::is_same<T, CPP_TY>::value) {                              \
-    std::cerr << "Writing flop log for " #CPP_TY " to '" << Path << "'...\n";  \
-    OS_##FROM_TY = std::make_unique<std::ofstream>(                            \
-        Path, std::ios_base::out | std::ios_base::binary);                     \
+    constexpr unsigned Idx = getLogTypeIdx<T>();
+    static_assert(Idx < NumLogTypes, "not a logged type");
+    clear<T>();
+    if (histogram) {
+      std::cerr << "Writing flop histogram for " << getTypeStr<T>() << " to '"
+                << Path << "'...\n";
+      histogramPath[Idx] = Path;
+      histogramEnabled[Idx] = true;
+      return;
+    }
+    if (Path.compare(0, 4, "shm:") == 0) {
+      openRing<T>(Path.substr(4));
+      return;
+    }
+    if (perThread) {
+      std::cerr << "Writing flop log for " << getTypeStr<T>() << " to '"
+                << Path << ".t<thread>'...\n";
+      logPath[Idx] = Path;
+      auto file = new LogFileTy{-1, false};
+      file->perThread = true;
+      file->path = Path;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        file->generation = ++generations;
+      }
+      startLogging(Idx, file);
+      return;
+    }
+    std::cerr << "Writing flop log for " << getTypeStr<T>() << " to '" << Path
+              << "'...\n";
+    LogFileTy *file = openFile(Path);
+    if (!file)
+      return;
+    logPath[Idx] = Path;
+    startLogging(Idx, file);
   }
-#include "raptor/FloatTypes.def"
+
+  LogFileTy *openFile(const std::string &Path) {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    int fd = -1;
+    bool isDirect = false;
+#ifdef O_DIRECT
+    if (direct) {
+      fd = open(Path.c_str(), flags | O_DIRECT, 0644);
+      isDirect = fd >= 0;
+    }
+#endif
+    if (fd < 0)
+      fd = open(Path.c_str(), flags, 0644);
+    if (fd < 0) {
+      std::cerr << "Could not open flop log '" << Path
+                << "': " << strerror(errno) << "\n";
+      return nullptr;
+    }
+    auto file = new LogFileTy{fd, isDirect};
+    if (isDirect)
+      file->staging = (char *)aligned_alloc(LogBlockSize, bufferSize);
+    return file;
   }
 
-  template <typename T> void log(T F) {
-#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY)                                     \
-  if constexpr (std::is_same<T, CPP_TY>::value)                                \
-    if (OS_##FROM_TY)                                                          \
-      OS_##FROM_TY->write(reinterpret_cast<const char *>(&F), sizeof(F));
-#include "raptor/FloatTypes.def"
+  LogFileTy *getThreadFile(unsigned Idx, LogFileTy *log);
+  unsigned getThreadTag();
+  bool claimBudget(LogThreadTy &thread);
+
+  void resume() { paused.fetch_and(~Stopped); }
+  void pause() { paused.fetch_or(Stopped); }
+
+  void setSample(uint64_t every) { sampleEvery = std::max<uint64_t>(every, 1); }
+
+  // Allow max more records from now on, 0 for no limit. Records already
+  // claimed by the threads still count against the old limit.
+  void setMaxRecords(uint64_t max) {
+    limited = max != 0;
+    budgetLeft = max;
+    paused.fetch_and(~BudgetExhausted);
+  }
+
+  void startLogging(unsigned Idx, LogFileTy *file) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (!writer.joinable())
+        writer = std::thread([this] { writerLoop(); });
+    }
+    files[Idx].store(file, std::memory_order_release);
+  }
+
+  // Creates the ring /dev/shm/<name>, or <name> if it is a path.
+  template <typename T> void openRing(const std::string &Name) {
+    constexpr unsigned Idx = getLogTypeIdx<T>();
+    std::string Path =
+        Name.find('/') == std::string::npos ? "/dev/shm/" + Name : Name;
+    std::cerr << "Writing flop log for " << getTypeStr<T>()
+              << " to shared memory ring '" << Path << "'...\n";
+    size_t recordSize =
+        sites ? sizeof(typename LogRecordTy<T>::type) : sizeof(T);
+    size_t capacity = std::max(ringSize / recordSize, (size_t)1) * recordSize;
+    size_t mapSize = RAPTOR_LOG_RING_DATA_OFFSET + capacity;
+    // A consumer may still have the previous ring of that name mapped.
+    unlink(Path.c_str());
+    int fd = open(Path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, mapSize) != 0) {
+      std::cerr << "Could not create flop log ring '" << Path
+                << "': " << strerror(errno) << "\n";
+      if (fd >= 0)
+        close(fd);
+      return;
+    }
+    void *map =
+        mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      std::cerr << "Could not map flop log ring '" << Path
+                << "': " << strerror(errno) << "\n";
+      close(fd);
+      return;
+    }
+    auto ring = (__raptor_log_ring *)map;
+    ring->version = RAPTOR_LOG_RING_VERSION;
+    ring->record_size = recordSize;
+    ring->capacity = capacity;
+    strncpy(ring->type, getTypeStr<T>(), sizeof(ring->type) - 1);
+    ring->sites = sites;
+    // Consumers wait for the magic before looking at anything else.
+    __atomic_store_n(&ring->magic, RAPTOR_LOG_RING_MAGIC, __ATOMIC_RELEASE);
+
+    logPath[Idx] = Path;
+    auto file = new LogFileTy{fd, false};
+    file->ring = ring;
+    file->ringMapSize = mapSize;
+    startLogging(Idx, file);
   }
 
+  template <typename T>
+  void log(T F, const char *loc, uint8_t op, uint8_t operand);
+  uint32_t getSiteId(const char *loc);
+
   FloatLoggerTy() {
+    if (char *C = getenv("RAPTOR_FLOP_LOG_BUFFER_SIZE")) {
+      size_t size = strtoull(C, nullptr, 0);
+      // Whole blocks for O_DIRECT and aligned_alloc.
+      bufferSize = std::max(LogBlockSize, (size + LogBlockSize - 1) /
+                                              LogBlockSize * LogBlockSize);
+    }
+    if (char *C = getenv("RAPTOR_FLOP_LOG_BUFFERS"))
+      maxBuffers = std::max(2u, (unsigned)strtoul(C, nullptr, 0));
+    if (char *C = getenv("RAPTOR_FLOP_LOG_DIRECT"))
+      direct = atoi(C) != 0;
+    if (char *C = getenv("RAPTOR_FLOP_LOG_MODE")) {
+      if (strcmp(C, "histogram") == 0)
+        histogram = true;
+      else if (strcmp(C, "raw") != 0)
+        std::cerr << "Unknown RAPTOR_FLOP_LOG_MODE '" << C
+                  << "', expected raw or histogram\n";
+    }
+    if (char *C = getenv("RAPTOR_FLOP_LOG_MANTISSA"))
+      histogramMantissa = atoi(C) != 0;
+    if (char *C = getenv("RAPTOR_FLOP_LOG_SITES"))
+      sites = atoi(C) != 0;
+    if (char *C = getenv("RAPTOR_FLOP_LOG_SAMPLE"))
+      setSample(strtoull(C, nullptr, 0));
+    if (char *C = getenv("RAPTOR_FLOP_LOG_MAX_RECORDS"))
+      setMaxRecords(strtoull(C, nullptr, 0));
+    if (char *C = getenv("RAPTOR_FLOP_LOG_PAUSED"))
+      if (atoi(C) != 0)
+        pause();
+    if (char *C = getenv("RAPTOR_FLOP_LOG_PER_THREAD"))
+      perThread = atoi(C) != 0;
+    if (char *C = getenv("RAPTOR_FLOP_LOG_SHM_SIZE"))
+      ringSize = strtoull(C, nullptr, 0);
+    if (char *C = getenv("RAPTOR_FLOP_LOG_SHM_POLICY")) {
+      if (strcmp(C, "drop") == 0)
+        ringDrop = true;
+      else if (strcmp(C, "block") != 0)
+        std::cerr << "Unknown RAPTOR_FLOP_LOG_SHM_POLICY '" << C
+                  << "', expected block or drop\n";
+    }
+    if (char *C = getenv("RAPTOR_FLOP_LOG_SHM")) {
+      if (histogram)
+        std::cerr << "RAPTOR_FLOP_LOG_SHM is not supported in histogram mode\n";
+      else {
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME)                               \
+  setLogPath<CPP_TY>(std::string("shm:") + C + "." #NAME);
+#include "raptor/FloatTypes.def"
+      }
+    }
     if (char *C = getenv("RAPTOR_FLOP_LOG_PREFIX")) {
-#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY)                                     \
-  setLogPath<CPP_TY>(std::string(C) + "." #CPP_TY);
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME)                               \
+  setLogPath<CPP_TY>(std::string(C) + "." #NAME +                              \
+                     (histogram ? ".hist" : ""));
 #include "raptor/FloatTypes.def"
     }
   }
 
-  ~FloatLoggerTy() {}
+  ~FloatLoggerTy() {
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME) clear<CPP_TY>();
+#include "raptor/FloatTypes.def"
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stop = true;
+    }
+    wake.notify_all();
+    if (writer.joinable())
+      writer.join();
+    for (auto buf : pool) {
+      free(buf->data);
+      delete buf;
+    }
+  }
 
+  friend struct LogThreadTy;
 } FloatLogger;
+
+struct LogThreadTy {
+  LogBuffer *cur[NumLogTypes] = {};
+  LogHistogram *hist[NumLogTypes] = {};
+
+  // Per-thread mode, the file of this thread and the generation of the log
+  // it was opened for.
+  LogFileTy *file[NumLogTypes] = {};
+  uint64_t fileGeneration[NumLogTypes] = {};
+  int tag = -1;
+
+  // Records to skip before the next sampled one, and records left of the
+  // chunk of RAPTOR_FLOP_LOG_MAX_RECORDS claimed by this thread.
+  uint64_t sampleLeft = 1;
+  uint64_t budget = 0;
+
+  // Direct mapped cache of site IDs, to keep the site table lock off the
+  // logging path.
+  struct SiteCacheEntry {
+    const char *loc = nullptr;
+    uint32_t id = 0;
+  };
+  static constexpr unsigned SiteCacheSize = 256;
+  SiteCacheEntry siteCache[SiteCacheSize];
+
+  LogThreadTy() { FloatLogger.registerThread(this); }
+
+  ~LogThreadTy() {
+    FloatLogger.unregisterThread(this);
+    FloatLogger.budgetLeft += budget;
+    for (auto &buf : cur)
+      if (buf)
+        FloatLogger.enqueue(buf);
+    std::lock_guard<std::mutex> guard(FloatLogger.lock);
+    for (unsigned Idx = 0; Idx < NumLogTypes; ++Idx) {
+      if (hist[Idx])
+        FloatLogger.histograms[Idx].add(*hist[Idx]);
+      delete hist[Idx];
+    }
+  }
+};
+
+thread_local LogThreadTy LogThread;
+
+// Hand the partially filled buffers of all threads for file, or of all files,
+// to the writer and wait until everything queued so far is written.
+void FloatLoggerTy::flushThreads(LogFileTy *file) {
+  std::vector<LogBuffer *> partial;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto thread : threads) {
+      for (auto &buf : thread->cur) {
+        if (buf && (!file || buf->file == file || buf->file->parent == file)) {
+          partial.push_back(buf);
+          buf = nullptr;
+        }
+      }
+    }
+  }
+  for (auto buf : partial)
+    enqueue(buf);
+  std::unique_lock<std::mutex> guard(lock);
+  wake.notify_one();
+  drained.wait(guard, [&] { return pending.load() == 0; });
+}
+
+unsigned FloatLoggerTy::getThreadTag() {
+  if (LogThread.tag >= 0)
+    return LogThread.tag;
+  std::lock_guard<std::mutex> guard(lock);
+  unsigned tag = 0;
+  int ompTag = omp_get_thread_num ? omp_get_thread_num() : -1;
+  if (ompTag >= 0 && !threadTags.count(ompTag))
+    tag = ompTag;
+  else
+    while (threadTags.count(tag))
+      ++tag;
+  threadTags.insert(tag);
+  LogThread.tag = tag;
+  return tag;
+}
+
+LogFileTy *FloatLoggerTy::getThreadFile(unsigned Idx, LogFileTy *log) {
+  if (LogThread.fileGeneration[Idx] == log->generation)
+    return LogThread.file[Idx];
+  LogFileTy *file =
+      openFile(log->path + ".t" + std::to_string(getThreadTag()));
+  // Do not retry if opening failed.
+  LogThread.file[Idx] = file;
+  LogThread.fileGeneration[Idx] = log->generation;
+  if (file) {
+    file->parent = log;
+    std::lock_guard<std::mutex> guard(lock);
+    log->threadFiles.push_back(file);
+  }
+  return file;
+}
+
+bool FloatLoggerTy::claimBudget(LogThreadTy &thread) {
+  uint64_t left = budgetLeft.load(std::memory_order_relaxed), n;
+  do {
+    // Smaller chunks towards the end, so little is left unused by threads
+    // that stop logging.
+    n = std::min<uint64_t>(left, std::max<uint64_t>(left / 64, 1));
+    n = std::min(n, BudgetChunk);
+    if (!n) {
+      paused.fetch_or(BudgetExhausted, std::memory_order_relaxed);
+      return false;
+    }
+  } while (!budgetLeft.compare_exchange_weak(left, left - n,
+                                             std::memory_order_relaxed));
+  thread.budget = n;
+  return true;
+}
+
+// Takes the histograms of all threads for type Idx, including the live ones.
+LogHistogram FloatLoggerTy::collectHistogram(unsigned Idx) {
+  std::lock_guard<std::mutex> guard(lock);
+  LogHistogram res = histograms[Idx];
+  histograms[Idx] = LogHistogram();
+  for (auto thread : threads) {
+    if (auto &hist = thread->hist[Idx]) {
+      res.add(*hist);
+      *hist = LogHistogram();
+    }
+  }
+  return res;
+}
+
+uint32_t FloatLoggerTy::getSiteId(const char *loc) {
+  auto &entry = LogThread.siteCache[((uintptr_t)loc >> 3) %
+                                    LogThreadTy::SiteCacheSize];
+  if (entry.loc != loc || !loc) {
+    entry.loc = loc;
+    entry.id = siteTable.lookup(loc);
+  }
+  return entry.id;
+}
+
+template <typename T>
+void FloatLoggerTy::log(T F, const char *loc, uint8_t op, uint8_t operand) {
+  constexpr unsigned Idx = getLogTypeIdx<T>();
+  static_assert(Idx < NumLogTypes, "not a logged type");
+  if (paused.load(std::memory_order_relaxed))
+    return;
+  LogFileTy *file = nullptr;
+  if (histogram ? !histogramEnabled[Idx].load(std::memory_order_relaxed)
+                : !(file = files[Idx].load(std::memory_order_acquire)))
+    return;
+  LogThreadTy &thread = LogThread;
+  if (sampleEvery > 1) {
+    if (--thread.sampleLeft)
+      return;
+    thread.sampleLeft = sampleEvery;
+  }
+  if (limited) {
+    if (!thread.budget && !claimBudget(thread))
+      return;
+    --thread.budget;
+  }
+  if (histogram) {
+    auto &hist = thread.hist[Idx];
+    if (!hist)
+      hist = new LogHistogram;
+    hist->log(F, histogramMantissa);
+    return;
+  }
+  if (file->perThread && !(file = getThreadFile(Idx, file)))
+    return;
+  typename LogRecordTy<T>::type record;
+  const void *data = &F;
+  size_t size = sizeof(T);
+  if (sites) {
+    record = {F, getSiteId(loc), op, operand, 0};
+    data = &record;
+    size = sizeof(record);
+  }
+  LogBuffer *&buf = thread.cur[Idx];
+  if (!buf || buf->file != file || buf->used + size > bufferSize) {
+    if (buf)
+      enqueue(buf);
+    buf = acquire(file);
+  }
+  memcpy(buf->data + buf->used, data, size);
+  buf->used += size;
+}
+
 } // namespace
 
-#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY)                                     \
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME)                               \
   __RAPTOR_MPFR_ATTRIBUTES                                                     \
   CPP_TY __raptor_fprtlog_##FROM_TY##_abs_err(CPP_TY a, CPP_TY b) {            \
-    return std::abs(a - b);                                                    \
+    return a > b ? a - b : b - a;                                              \
   }                                                                            \
   __RAPTOR_MPFR_ATTRIBUTES                                                     \
   void __raptor_fprtlog_##FROM_TY##_trunc_change(                              \
@@ -91,15 +1005,38 @@ struct FloatLoggerTy {
       int64_t to_e, int64_t to_m, int64_t mode, const char *loc,               \
       void *scratch) {}                                                        \
   __RAPTOR_MPFR_ATTRIBUTES                                                     \
-  void __raptor_log_flops_##FROM_TY(CPP_TY a) { FloatLogger.log(a); }          \
+  void __raptor_log_flops_##FROM_TY(CPP_TY a, const char *loc, uint8_t op,    \
+                                   uint8_t operand) {                          \
+    FloatLogger.log(a, loc, op, operand);                                      \
+  }                                                                            \
   __RAPTOR_MPFR_ATTRIBUTES                                                     \
-  void __raptor_clear_flop_log_##CPP_TY() { FloatLogger.clear<CPP_TY>(); }     \
+  void __raptor_clear_flop_log_##NAME() { FloatLogger.clear<CPP_TY>(); }       \
   __RAPTOR_MPFR_ATTRIBUTES                                                     \
-  void __raptor_set_flop_log_##CPP_TY(const char *path) {                      \
+  void __raptor_set_flop_log_##NAME(const char *path) {                        \
     FloatLogger.setLogPath<CPP_TY>(path);                                      \
   }
 #include "raptor/FloatTypes.def"
 
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_flop_log_start() { FloatLogger.resume(); }
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_flop_log_stop() { FloatLogger.pause(); }
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_flop_log_sample(int64_t every) { FloatLogger.setSample(every); }
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_flop_log_max_records(int64_t max) {
+  FloatLogger.setMaxRecords(max);
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void f_raptor_flop_log_start() { __raptor_flop_log_start(); }
+
+__RAPTOR_MPFR_ATTRIBUTES
+void f_raptor_flop_log_stop() { __raptor_flop_log_stop(); }
+
 #define __RAPTOR_MPFR_LROUND(OP_TYPE, LLVM_OP_NAME, FROM_TYPE, RET, ARG1,      \
                              MPFR_SET_ARG1, ROUNDING_MODE)                     \
   __RAPTOR_MPFR_ORIGINAL_ATTRIBUTES                                            \
@@ -108,7 +1045,8 @@ struct FloatLoggerTy {
   __RAPTOR_MPFR_ATTRIBUTES                                                     \
   RET __raptor_fprtlog_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME(               \
       ARG1 a, LogFuncTy_##FROM_TYPE f, const char *loc, void *scratch) {       \
-    f(a);                                                                      \
+    constexpr uint8_t op = __raptor_log_op_kind(#LLVM_OP_NAME);                \
+    f(a, loc, op, 0);                                                          \
     return __raptor_fprtlog_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME( \
         a);                                                                    \
   }
@@ -122,7 +1060,8 @@ struct FloatLoggerTy {
   __RAPTOR_MPFR_ATTRIBUTES                                                     \
   RET __raptor_fprtlog_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME(               \
       ARG1 a, LogFuncTy_##FROM_TYPE f, const char *loc, void *scratch) {       \
-    f(a);                                                                      \
+    constexpr uint8_t op = __raptor_log_op_kind(#LLVM_OP_NAME);                \
+    f(a, loc, op, 0);                                                          \
     return __raptor_fprtlog_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME( \
         a);                                                                    \
   }
@@ -137,7 +1076,8 @@ struct FloatLoggerTy {
   RET __raptor_fprtlog_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME(               \
       ARG1 a, ARG2 b, LogFuncTy_##FROM_TYPE f, const char *loc,                \
       void *scratch) {                                                         \
-    f(a);                                                                      \
+    constexpr uint8_t op = __raptor_log_op_kind(#LLVM_OP_NAME);                \
+    f(a, loc, op, 0);                                                          \
     return __raptor_fprtlog_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME( \
         a, b);                                                                 \
   }
@@ -152,8 +1092,9 @@ struct FloatLoggerTy {
   RET __raptor_fprtlog_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME(               \
       ARG1 a, ARG2 b, LogFuncTy_##FROM_TYPE f, const char *loc,                \
       void *scratch) {                                                         \
-    f(a);                                                                      \
-    f(b);                                                                      \
+    constexpr uint8_t op = __raptor_log_op_kind(#LLVM_OP_NAME);                \
+    f(a, loc, op, 0);                                                          \
+    f(b, loc, op, 1);                                                          \
     return __raptor_fprtlog_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME( \
         a, b);                                                                 \
   }
@@ -168,9 +1109,10 @@ struct FloatLoggerTy {
   TYPE __raptor_fprtlog_##FROM_TYPE##_intr_##LLVM_OP_NAME##_##LLVM_TYPE(                     \
       TYPE a, TYPE b, TYPE c, LogFuncTy_##FROM_TYPE f, int64_t mode,                         \
       const char *loc, void *scratch) {                                                      \
-    f(a);                                                                                    \
-    f(b);                                                                                    \
-    f(c);                                                                                    \
+    constexpr uint8_t op = __raptor_log_op_kind(#LLVM_OP_NAME);                              \
+    f(a, loc, op, 0);                                                                        \
+    f(b, loc, op, 1);                                                                        \
+    f(c, loc, op, 2);                                                                        \
     return __raptor_fprtlog_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME##_##LLVM_TYPE( \
         a, b, c);                                                                            \
   }
@@ -198,4 +1140,74 @@ struct FloatLoggerTy {
         a, tests);                                                                   \
   }
 
+// Logging never uses the accumulator formats of op mode truncation.
+#define __RAPTOR_MPFR_ACC_BIN(...)
+#define __RAPTOR_MPFR_ACC_FMULADD(...)
+
 #include "Flops.def"
+
+// Flops.def is shared with the MPFR runtime, which has no 16-bit types, so the
+// wrappers of the operations the pass may log for them are listed here.
+#define __RAPTOR_LOG_16_BIT_BINOP(FROM_TYPE, TYPE, LLVM_OP_NAME)               \
+  __RAPTOR_MPFR_BIN(binop, LLVM_OP_NAME, , FROM_TYPE, TYPE, , TYPE, , TYPE, ,  \
+                    __RAPTOR_MPFR_DEFAULT_ROUNDING_MODE)
+#define __RAPTOR_LOG_16_BIT_INTR2(FROM_TYPE, TYPE, LLVM_OP_NAME)               \
+  __RAPTOR_MPFR_BIN(intr, LLVM_OP_NAME, , FROM_TYPE, TYPE, , TYPE, , TYPE, ,   \
+                    __RAPTOR_MPFR_DEFAULT_ROUNDING_MODE)
+#define __RAPTOR_LOG_16_BIT_INTR1(FROM_TYPE, TYPE, LLVM_OP_NAME)               \
+  __RAPTOR_MPFR_SINGOP(intr, LLVM_OP_NAME, , FROM_TYPE, TYPE, , TYPE, ,        \
+                       __RAPTOR_MPFR_DEFAULT_ROUNDING_MODE)
+#define __RAPTOR_LOG_16_BIT_FCMP(FROM_TYPE, TYPE, NAME)                        \
+  __RAPTOR_MPFR_FCMP_IMPL(NAME, , , FROM_TYPE, TYPE, ,                         \
+                          __RAPTOR_MPFR_DEFAULT_ROUNDING_MODE)
+
+#define __RAPTOR_LOG_16_BIT_FLOPS(FROM_TYPE, TYPE, LLVM_TYPE)                  \
+  __RAPTOR_LOG_16_BIT_BINOP(FROM_TYPE, TYPE, fadd)                             \
+  __RAPTOR_LOG_16_BIT_BINOP(FROM_TYPE, TYPE, fsub)                             \
+  __RAPTOR_LOG_16_BIT_BINOP(FROM_TYPE, TYPE, fmul)                             \
+  __RAPTOR_LOG_16_BIT_BINOP(FROM_TYPE, TYPE, fdiv)                             \
+  __RAPTOR_LOG_16_BIT_BINOP(FROM_TYPE, TYPE, frem)                             \
+  __RAPTOR_MPFR_SINGOP(unaryop, fneg, , FROM_TYPE, TYPE, , TYPE, ,             \
+                       __RAPTOR_MPFR_DEFAULT_ROUNDING_MODE)                    \
+  __RAPTOR_LOG_16_BIT_INTR2(FROM_TYPE, TYPE, llvm_pow_##LLVM_TYPE)             \
+  __RAPTOR_LOG_16_BIT_INTR2(FROM_TYPE, TYPE, llvm_copysign_##LLVM_TYPE)        \
+  __RAPTOR_LOG_16_BIT_INTR2(FROM_TYPE, TYPE, llvm_maxnum_##LLVM_TYPE)          \
+  __RAPTOR_LOG_16_BIT_INTR2(FROM_TYPE, TYPE, llvm_minnum_##LLVM_TYPE)          \
+  __RAPTOR_LOG_16_BIT_INTR1(FROM_TYPE, TYPE, llvm_sqrt_##LLVM_TYPE)            \
+  __RAPTOR_LOG_16_BIT_INTR1(FROM_TYPE, TYPE, llvm_fabs_##LLVM_TYPE)            \
+  __RAPTOR_LOG_16_BIT_INTR1(FROM_TYPE, TYPE, llvm_exp_##LLVM_TYPE)             \
+  __RAPTOR_LOG_16_BIT_INTR1(FROM_TYPE, TYPE, llvm_exp2_##LLVM_TYPE)            \
+  __RAPTOR_LOG_16_BIT_INTR1(FROM_TYPE, TYPE, llvm_log_##LLVM_TYPE)             \
+  __RAPTOR_LOG_16_BIT_INTR1(FROM_TYPE, TYPE, llvm_log2_##LLVM_TYPE)            \
+  __RAPTOR_LOG_16_BIT_INTR1(FROM_TYPE, TYPE, llvm_log10_##LLVM_TYPE)           \
+  __RAPTOR_LOG_16_BIT_INTR1(FROM_TYPE, TYPE, llvm_sin_##LLVM_TYPE)             \
+  __RAPTOR_LOG_16_BIT_INTR1(FROM_TYPE, TYPE, llvm_cos_##LLVM_TYPE)             \
+  __RAPTOR_LOG_16_BIT_INTR1(FROM_TYPE, TYPE, llvm_floor_##LLVM_TYPE)           \
+  __RAPTOR_LOG_16_BIT_INTR1(FROM_TYPE, TYPE, llvm_ceil_##LLVM_TYPE)            \
+  __RAPTOR_LOG_16_BIT_INTR1(FROM_TYPE, TYPE, llvm_trunc_##LLVM_TYPE)           \
+  __RAPTOR_LOG_16_BIT_INTR1(FROM_TYPE, TYPE, llvm_round_##LLVM_TYPE)           \
+  __RAPTOR_LOG_16_BIT_INTR1(FROM_TYPE, TYPE, llvm_nearbyint_##LLVM_TYPE)       \
+  __RAPTOR_MPFR_FMULADD(intr, llvm_fmuladd, FROM_TYPE, TYPE, , LLVM_TYPE,      \
+                        __RAPTOR_MPFR_DEFAULT_ROUNDING_MODE)                   \
+  __RAPTOR_MPFR_FMULADD(intr, llvm_fma, FROM_TYPE, TYPE, , LLVM_TYPE,          \
+                        __RAPTOR_MPFR_DEFAULT_ROUNDING_MODE)                   \
+  __RAPTOR_MPFR_ISCLASS(FROM_TYPE, TYPE, LLVM_TYPE)                            \
+  __RAPTOR_LOG_16_BIT_FCMP(FROM_TYPE, TYPE, oeq)                               \
+  __RAPTOR_LOG_16_BIT_FCMP(FROM_TYPE, TYPE, ueq)                               \
+  __RAPTOR_LOG_16_BIT_FCMP(FROM_TYPE, TYPE, ogt)                               \
+  __RAPTOR_LOG_16_BIT_FCMP(FROM_TYPE, TYPE, ugt)                               \
+  __RAPTOR_LOG_16_BIT_FCMP(FROM_TYPE, TYPE, oge)                               \
+  __RAPTOR_LOG_16_BIT_FCMP(FROM_TYPE, TYPE, uge)                               \
+  __RAPTOR_LOG_16_BIT_FCMP(FROM_TYPE, TYPE, olt)                               \
+  __RAPTOR_LOG_16_BIT_FCMP(FROM_TYPE, TYPE, ult)                               \
+  __RAPTOR_LOG_16_BIT_FCMP(FROM_TYPE, TYPE, ole)                               \
+  __RAPTOR_LOG_16_BIT_FCMP(FROM_TYPE, TYPE, ule)                               \
+  __RAPTOR_LOG_16_BIT_FCMP(FROM_TYPE, TYPE, one)                               \
+  __RAPTOR_LOG_16_BIT_FCMP(FROM_TYPE, TYPE, une)
+
+#ifdef RAPTOR_FPRT_HAS_HALF
+__RAPTOR_LOG_16_BIT_FLOPS(ieee_16, __raptor_half, f16)
+#endif
+#ifdef RAPTOR_FPRT_HAS_BFLOAT
+__RAPTOR_LOG_16_BIT_FLOPS(bf_16, __raptor_bfloat, bf16)
+#endif
@@ -28,6 +28,11 @@
 #include <stdlib.h>
 
 #include "raptor/Common.h"
+#include "raptor/Context.h"
+#include "raptor/FPEvents.h"
+#include "raptor/Perf.h"
+#include "raptor/Region.h"
+#include "raptor/Stochastic.h"
 
 // TODO s
 //
@@ -82,6 +87,30 @@
   } while (0)
 #endif
 
+// With stochastic rounding op mode computes the result in the extended
+// register of the thread first, see obj/Stochastic.cpp.
+#define RAPTOR_SR_RESULT(DST)                                                  \
+  (__raptor_fprt_is_stochastic_mode(mode) ? raptor_fprt_sr_extended() : (DST))
+#define RAPTOR_SR_ROUND(DST, RES)                                              \
+  do {                                                                         \
+    if ((RES) != (DST))                                                        \
+      raptor_fprt_sr_round(DST, RES);                                          \
+  } while (0)
+
+// Attribute the overflow, underflow and NaN flags raised by the op to its
+// site, see obj/FPEvents.cpp. The flags are cleared when the op starts, so
+// the ones raised by unchecked MPFR calls in between are not blamed on it.
+#define RAPTOR_FP_EVENTS_CLEAR()                                               \
+  do {                                                                         \
+    if (raptor_fprt_fp_events_enabled)                                         \
+      mpfr_clear_flags();                                                      \
+  } while (0)
+#define RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME)                                   \
+  do {                                                                         \
+    if (raptor_fprt_fp_events_enabled)                                         \
+      raptor_fprt_fp_events_check(loc, #LLVM_OP_NAME);                         \
+  } while (0)
+
 __RAPTOR_MPFR_ATTRIBUTES
 void __raptor_fprt_trunc_change(int64_t is_push, int64_t to_e, int64_t to_m,
                                 int64_t mode, const char *loc, void *scratch) {
@@ -90,6 +119,8 @@ void __raptor_fprt_trunc_change(int64_t is_push, int64_t to_e, int64_t to_m,
     puts("Nested truncation is unsupported");
     abort();
   }
+  if (!is_push && raptor_fprt_perf_enabled)
+    raptor_fprt_perf_pop();
   global_is_truncating.store(is_push);
 
   // If we are starting to truncate, set the max and min exponents
@@ -107,11 +138,45 @@ void __raptor_fprt_trunc_change(int64_t is_push, int64_t to_e, int64_t to_m,
     mpfr_set_emax(max_e);
     mpfr_set_emin(min_e);
   }
+
+  if (is_push && raptor_fprt_perf_enabled)
+    raptor_fprt_perf_push(loc, "truncated");
 }
 
-#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY)                                     \
+// Sums into an accumulator are rounded to a format of their own, e.g.
+// mpfr(8,23) while the products are rounded to mpfr(5,10) like on matrix
+// units. For the duration of the sum the exponent range is the one of the
+// accumulator instead of the one trunc_change set for the operands.
+struct __raptor_fprt_acc_scope {
+  mpfr_exp_t emin = mpfr_get_emin();
+  mpfr_exp_t emax = mpfr_get_emax();
+  mpfr_ptr reg;
+
+  __raptor_fprt_acc_scope(int64_t acc_e, int64_t acc_s) {
+    // Same range as trunc_change, see MPFR_FP_EMULATION
+    int64_t max_e = 1 << (acc_e - 1);
+    mpfr_set_emax(max_e);
+    mpfr_set_emin(-max_e + 2 - acc_s + 2);
+
+    thread_local struct AccRegister {
+      mpfr_t r;
+      AccRegister() { mpfr_init2(r, MPFR_PREC_MIN); }
+      ~AccRegister() { mpfr_clear(r); }
+    } acc;
+    if (mpfr_get_prec(acc.r) != acc_s + 1)
+      mpfr_set_prec(acc.r, acc_s + 1);
+    reg = acc.r;
+  }
+
+  ~__raptor_fprt_acc_scope() {
+    mpfr_set_emin(emin);
+    mpfr_set_emax(emax);
+  }
+};
+
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME)                               \
   CPP_TY __raptor_fprt_##FROM_TY##_abs_err(CPP_TY a, CPP_TY b) {               \
-    return std::abs(a - b);                                                    \
+    return a > b ? a - b : b - a;                                              \
   }                                                                            \
                                                                                \
   /* Handle the case where people zero out memory and expect the floating */   \
@@ -187,6 +252,10 @@ void __raptor_fprt_ieee_16_count(int64_t exponent, int64_t significand,
                                  int64_t mode, const char *loc,
                                  mpfr_t *scratch);
 
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_fprt_bf_16_count(int64_t exponent, int64_t significand,
+                               int64_t mode, const char *loc, mpfr_t *scratch);
+
 __RAPTOR_MPFR_ATTRIBUTES
 long long __raptor_get_trunc_flop_count();
 
@@ -199,6 +268,9 @@ long long __raptor_get_float_flop_count();
 __RAPTOR_MPFR_ATTRIBUTES
 long long __raptor_get_half_flop_count();
 
+__RAPTOR_MPFR_ATTRIBUTES
+long long __raptor_get_bfloat_flop_count();
+
 __RAPTOR_MPFR_ATTRIBUTES
 long long f_raptor_get_trunc_flop_count();
 
@@ -211,6 +283,9 @@ long long f_raptor_get_float_flop_count();
 __RAPTOR_MPFR_ATTRIBUTES
 long long f_raptor_get_half_flop_count();
 
+__RAPTOR_MPFR_ATTRIBUTES
+long long f_raptor_get_bfloat_flop_count();
+
 __RAPTOR_MPFR_ATTRIBUTES
 long long __raptor_get_memory_access_trunc_store();
 
@@ -238,6 +313,9 @@ long long f_raptor_get_memory_access_original_load();
 __RAPTOR_MPFR_ATTRIBUTES
 void __raptor_fprt_memory_access(void *, int64_t size, int64_t is_store);
 
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_fprt_memory_access_block(int64_t load_bytes, int64_t store_bytes);
+
 __RAPTOR_MPFR_ATTRIBUTES
 void __raptor_fprt_ieee_64_count(int64_t exponent, int64_t significand,
                                  int64_t mode, const char *loc,
@@ -253,6 +331,10 @@ void __raptor_fprt_ieee_16_count(int64_t exponent, int64_t significand,
                                  int64_t mode, const char *loc,
                                  mpfr_t *scratch);
 
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_fprt_bf_16_count(int64_t exponent, int64_t significand,
+                               int64_t mode, const char *loc, mpfr_t *scratch);
+
 __RAPTOR_MPFR_ATTRIBUTES
 long long __raptor_reset_shadow_trace();
 
@@ -275,6 +357,29 @@ void raptor_fprt_op_clear();
 // #define SHADOW_ERR_REL 6.0e-8   //
 // #define SHADOW_ERR_ABS 6.0e-8   // If reference is 0.
 
+// Accumulate the error of the truncated result against the shadow value per
+// source location, for the innermost open region and per calling context.
+static inline void __raptor_fprt_record_shadow_err(const char *loc,
+                                                   const char *op,
+                                                   double trunc, double err) {
+  bool violation = (trunc != 0 && err / trunc > SHADOW_ERR_REL) ||
+                   (trunc == 0 && err > SHADOW_ERR_ABS);
+  auto &data = opdata[loc];
+  if (!data.count)
+    data.op = op;
+  if (violation)
+    ++data.count_thresh;
+  data.l1_err += err;
+  ++data.count;
+  if (auto *region = raptor_fprt_current_region) {
+    region->shadow_violations += violation;
+    region->shadow_l1_err += err;
+    ++region->shadow_count;
+  }
+  if (raptor_fprt_context_hash)
+    raptor_fprt_context_record(loc, op, violation, err);
+}
+
 // TODO this is a bit sketchy if the user cast their float to int before calling
 // this. We need to detect these patterns
 #define __RAPTOR_MPFR_LROUND(OP_TYPE, LLVM_OP_NAME, FROM_TYPE, RET, ARG1,      \
@@ -302,12 +407,17 @@ void raptor_fprt_op_clear();
       ARG1 a, int64_t exponent, int64_t significand, int64_t mode,             \
       const char *loc, mpfr_t *scratch) {                                      \
     if (__raptor_fprt_is_op_mode(mode)) {                                      \
+      RAPTOR_FP_EVENTS_CLEAR();                                                \
       __raptor_fprt_trunc_count(exponent, significand, mode, loc, scratch);    \
       mpfr_set_##MPFR_SET_ARG1(scratch[0], a, ROUNDING_MODE);                  \
-      mpfr_##MPFR_FUNC_NAME(scratch[2], scratch[0], ROUNDING_MODE);            \
+      mpfr_ptr mres = RAPTOR_SR_RESULT(scratch[2]);                            \
+      mpfr_##MPFR_FUNC_NAME(mres, scratch[0], ROUNDING_MODE);                  \
+      RAPTOR_SR_ROUND(scratch[2], mres);                                       \
       RET c = mpfr_get_##MPFR_GET(scratch[2], ROUNDING_MODE);                  \
+      RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME);                                    \
       return c;                                                                \
     } else if (__raptor_fprt_is_mem_mode(mode)) {                              \
+      RAPTOR_FP_EVENTS_CLEAR();                                                \
       __raptor_fp *ma = __raptor_fprt_##FROM_TYPE##_to_ptr_checked(            \
           a, exponent, significand, mode, loc, scratch);                       \
       __raptor_fp *mc = __raptor_fprt_##FROM_TYPE##_new_intermediate(          \
@@ -328,19 +438,12 @@ void raptor_fprt_op_clear();
         mpfr_##MPFR_FUNC_NAME(mc->result, ma->result, ROUNDING_MODE);          \
         mc->excl_result = mpfr_get_##MPFR_GET(mc->result, ROUNDING_MODE);      \
       }                                                                        \
+      RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME);                                    \
       RAPTOR_DUMP_RESULT(mc, OP_TYPE, LLVM_OP_NAME);                           \
       double trunc = mpfr_get_##MPFR_GET(mc->result,                           \
                                          __RAPTOR_MPFR_DEFAULT_ROUNDING_MODE); \
       double err = __raptor_fprt_##FROM_TYPE##_abs_err(trunc, mc->shadow);     \
-      if (!opdata[loc].count)                                                  \
-        opdata[loc].op = #LLVM_OP_NAME;                                        \
-      if (trunc != 0 && err / trunc > SHADOW_ERR_REL) {                        \
-        ++opdata[loc].count_thresh;                                            \
-      } else if (trunc == 0 && err > SHADOW_ERR_ABS) {                         \
-        ++opdata[loc].count_thresh;                                            \
-      }                                                                        \
-      opdata[loc].l1_err += err;                                               \
-      ++opdata[loc].count;                                                     \
+      __raptor_fprt_record_shadow_err(loc, #LLVM_OP_NAME, trunc, err);         \
       return __raptor_fprt_ptr_to_##FROM_TYPE(mc);                             \
     } else {                                                                   \
       abort();                                                                 \
@@ -357,12 +460,17 @@ void raptor_fprt_op_clear();
       ARG1 a, ARG2 b, int64_t exponent, int64_t significand, int64_t mode,     \
       const char *loc, mpfr_t *scratch) {                                      \
     if (__raptor_fprt_is_op_mode(mode)) {                                      \
+      RAPTOR_FP_EVENTS_CLEAR();                                                \
       __raptor_fprt_trunc_count(exponent, significand, mode, loc, scratch);    \
       mpfr_set_##MPFR_SET_ARG1(scratch[0], a, ROUNDING_MODE);                  \
-      mpfr_##MPFR_FUNC_NAME(scratch[2], scratch[0], b, ROUNDING_MODE);         \
+      mpfr_ptr mres = RAPTOR_SR_RESULT(scratch[2]);                            \
+      mpfr_##MPFR_FUNC_NAME(mres, scratch[0], b, ROUNDING_MODE);               \
+      RAPTOR_SR_ROUND(scratch[2], mres);                                       \
       RET c = mpfr_get_##MPFR_GET(scratch[2], ROUNDING_MODE);                  \
+      RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME);                                    \
       return c;                                                                \
     } else if (__raptor_fprt_is_mem_mode(mode)) {                              \
+      RAPTOR_FP_EVENTS_CLEAR();                                                \
       __raptor_fprt_trunc_count(exponent, significand, mode, loc, scratch);    \
       __raptor_fp *ma = __raptor_fprt_##FROM_TYPE##_to_ptr_checked(            \
           a, exponent, significand, mode, loc, scratch);                       \
@@ -371,6 +479,7 @@ void raptor_fprt_op_clear();
       RAPTOR_DUMP_INPUT(ma, OP_TYPE, LLVM_OP_NAME);                            \
       mpfr_##MPFR_FUNC_NAME(mc->result, ma->result, b, ROUNDING_MODE);         \
       mc->excl_result = mpfr_get_##MPFR_GET(mc->result, ROUNDING_MODE);        \
+      RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME);                                    \
       RAPTOR_DUMP_RESULT(mc, OP_TYPE, LLVM_OP_NAME);                           \
       return __raptor_fprt_ptr_to_##FROM_TYPE(mc);                             \
     } else {                                                                   \
@@ -389,14 +498,18 @@ void raptor_fprt_op_clear();
       ARG1 a, ARG2 b, int64_t exponent, int64_t significand, int64_t mode,     \
       const char *loc, mpfr_t *scratch) {                                      \
     if (__raptor_fprt_is_op_mode(mode)) {                                      \
+      RAPTOR_FP_EVENTS_CLEAR();                                                \
       __raptor_fprt_trunc_count(exponent, significand, mode, loc, scratch);    \
       mpfr_set_##MPFR_SET_ARG1(scratch[0], a, ROUNDING_MODE);                  \
       mpfr_set_##MPFR_SET_ARG2(scratch[1], b, ROUNDING_MODE);                  \
-      mpfr_##MPFR_FUNC_NAME(scratch[2], scratch[0], scratch[1],                \
-                            ROUNDING_MODE);                                    \
+      mpfr_ptr mres = RAPTOR_SR_RESULT(scratch[2]);                            \
+      mpfr_##MPFR_FUNC_NAME(mres, scratch[0], scratch[1], ROUNDING_MODE);      \
+      RAPTOR_SR_ROUND(scratch[2], mres);                                       \
       RET c = mpfr_get_##MPFR_GET(scratch[2], ROUNDING_MODE);                  \
+      RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME);                                    \
       return c;                                                                \
     } else if (__raptor_fprt_is_mem_mode(mode)) {                              \
+      RAPTOR_FP_EVENTS_CLEAR();                                                \
       __raptor_fp *ma = __raptor_fprt_##FROM_TYPE##_to_ptr_checked(            \
           a, exponent, significand, mode, loc, scratch);                       \
       __raptor_fp *mb = __raptor_fprt_##FROM_TYPE##_to_ptr_checked(            \
@@ -421,19 +534,12 @@ void raptor_fprt_op_clear();
                               ROUNDING_MODE);                                  \
         mc->excl_result = mpfr_get_##MPFR_GET(mc->result, ROUNDING_MODE);      \
       }                                                                        \
+      RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME);                                    \
       RAPTOR_DUMP_RESULT(mc, OP_TYPE, LLVM_OP_NAME);                           \
       double trunc = mpfr_get_##MPFR_GET(mc->result,                           \
                                          __RAPTOR_MPFR_DEFAULT_ROUNDING_MODE); \
       double err = __raptor_fprt_##FROM_TYPE##_abs_err(trunc, mc->shadow);     \
-      if (!opdata[loc].count)                                                  \
-        opdata[loc].op = #LLVM_OP_NAME;                                        \
-      if (trunc != 0 && err / trunc > SHADOW_ERR_REL) {                        \
-        ++opdata[loc].count_thresh;                                            \
-      } else if (trunc == 0 && err > SHADOW_ERR_ABS) {                         \
-        ++opdata[loc].count_thresh;                                            \
-      }                                                                        \
-      opdata[loc].l1_err += err;                                               \
-      ++opdata[loc].count;                                                     \
+      __raptor_fprt_record_shadow_err(loc, #LLVM_OP_NAME, trunc, err);         \
       return __raptor_fprt_ptr_to_##FROM_TYPE(mc);                             \
     } else {                                                                   \
       abort();                                                                 \
@@ -451,15 +557,21 @@ void raptor_fprt_op_clear();
       TYPE a, TYPE b, TYPE c, int64_t exponent, int64_t significand,                       \
       int64_t mode, const char *loc, mpfr_t *scratch) {                                    \
     if (__raptor_fprt_is_op_mode(mode)) {                                                  \
+      RAPTOR_FP_EVENTS_CLEAR();                                                            \
       __raptor_fprt_trunc_count(exponent, significand, mode, loc, scratch);                \
       mpfr_set_##MPFR_TYPE(scratch[0], a, ROUNDING_MODE);                                  \
       mpfr_set_##MPFR_TYPE(scratch[1], b, ROUNDING_MODE);                                  \
       mpfr_set_##MPFR_TYPE(scratch[2], c, ROUNDING_MODE);                                  \
-      mpfr_mul(scratch[0], scratch[0], scratch[1], ROUNDING_MODE);                         \
-      mpfr_add(scratch[0], scratch[0], scratch[2], ROUNDING_MODE);                         \
+      mpfr_ptr mres = RAPTOR_SR_RESULT(scratch[0]);                                        \
+      mpfr_mul(mres, scratch[0], scratch[1], ROUNDING_MODE);                               \
+      RAPTOR_SR_ROUND(scratch[0], mres);                                                   \
+      mpfr_add(mres, scratch[0], scratch[2], ROUNDING_MODE);                               \
+      RAPTOR_SR_ROUND(scratch[0], mres);                                                   \
       TYPE res = mpfr_get_##MPFR_TYPE(scratch[0], ROUNDING_MODE);                          \
+      RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME);                                                \
       return res;                                                                          \
     } else if (__raptor_fprt_is_mem_mode(mode)) {                                          \
+      RAPTOR_FP_EVENTS_CLEAR();                                                            \
       __raptor_fp *ma = __raptor_fprt_##FROM_TYPE##_to_ptr_checked(                        \
           a, exponent, significand, mode, loc, scratch);                                   \
       __raptor_fp *mb = __raptor_fprt_##FROM_TYPE##_to_ptr_checked(                        \
@@ -490,20 +602,13 @@ void raptor_fprt_op_clear();
         mpfr_clear(mmul);                                                                  \
         madd->excl_result = mpfr_get_##MPFR_TYPE(madd->result, ROUNDING_MODE);             \
       }                                                                                    \
+      RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME);                                                \
       RAPTOR_DUMP_RESULT(__raptor_fprt_##FROM_TYPE##_to_ptr(madd), OP_TYPE,                \
                          LLVM_OP_NAME);                                                    \
       double trunc = mpfr_get_##MPFR_TYPE(                                                 \
           madd->result, __RAPTOR_MPFR_DEFAULT_ROUNDING_MODE);                              \
       double err = __raptor_fprt_##FROM_TYPE##_abs_err(trunc, madd->shadow);               \
-      if (!opdata[loc].count)                                                              \
-        opdata[loc].op = #LLVM_OP_NAME;                                                    \
-      if (trunc != 0 && err / trunc > SHADOW_ERR_REL) {                                    \
-        ++opdata[loc].count_thresh;                                                        \
-      } else if (trunc == 0 && err > SHADOW_ERR_ABS) {                                     \
-        ++opdata[loc].count_thresh;                                                        \
-      }                                                                                    \
-      opdata[loc].l1_err += err;                                                           \
-      ++opdata[loc].count;                                                                 \
+      __raptor_fprt_record_shadow_err(loc, #LLVM_OP_NAME, trunc, err);                     \
       return __raptor_fprt_ptr_to_##FROM_TYPE(madd);                                       \
     } else {                                                                               \
       abort();                                                                             \
@@ -561,12 +666,17 @@ void raptor_fprt_op_clear();
       ARG1 a, int64_t exponent, int64_t significand, int64_t mode,             \
       const char *loc, mpfr_t *scratch) {                                      \
     if (__raptor_fprt_is_op_mode(mode)) {                                      \
+      RAPTOR_FP_EVENTS_CLEAR();                                                \
       __raptor_fprt_trunc_count(exponent, significand, mode, loc, scratch);    \
       mpfr_set_##MPFR_SET_ARG1(scratch[0], a, ROUNDING_MODE);                  \
-      mpfr_##MPFR_FUNC_NAME(scratch[2], scratch[0], ROUNDING_MODE);            \
+      mpfr_ptr mres = RAPTOR_SR_RESULT(scratch[2]);                            \
+      mpfr_##MPFR_FUNC_NAME(mres, scratch[0], ROUNDING_MODE);                  \
+      RAPTOR_SR_ROUND(scratch[2], mres);                                       \
       RET c = mpfr_get_##MPFR_GET(scratch[2], ROUNDING_MODE);                  \
+      RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME);                                    \
       return c;                                                                \
     } else if (__raptor_fprt_is_mem_mode(mode)) {                              \
+      RAPTOR_FP_EVENTS_CLEAR();                                                \
       __raptor_fprt_trunc_count(exponent, significand, mode, loc, scratch);    \
       __raptor_fp *ma = __raptor_fprt_##FROM_TYPE##_to_ptr_checked(            \
           a, exponent, significand, mode, loc, scratch);                       \
@@ -574,6 +684,7 @@ void raptor_fprt_op_clear();
           exponent, significand, mode, loc, scratch);                          \
       RAPTOR_DUMP_INPUT(ma, OP_TYPE, LLVM_OP_NAME);                            \
       mpfr_##MPFR_FUNC_NAME(mc->result, ma->result, ROUNDING_MODE);            \
+      RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME);                                    \
       RAPTOR_DUMP_RESULT(mc, OP_TYPE, LLVM_OP_NAME);                           \
       return __raptor_fprt_ptr_to_##FROM_TYPE(mc);                             \
     } else {                                                                   \
@@ -591,12 +702,17 @@ void raptor_fprt_op_clear();
       ARG1 a, ARG2 b, int64_t exponent, int64_t significand, int64_t mode,     \
       const char *loc, mpfr_t *scratch) {                                      \
     if (__raptor_fprt_is_op_mode(mode)) {                                      \
+      RAPTOR_FP_EVENTS_CLEAR();                                                \
       __raptor_fprt_trunc_count(exponent, significand, mode, loc, scratch);    \
       mpfr_set_##MPFR_SET_ARG1(scratch[0], a, ROUNDING_MODE);                  \
-      mpfr_##MPFR_FUNC_NAME(scratch[2], scratch[0], b, ROUNDING_MODE);         \
+      mpfr_ptr mres = RAPTOR_SR_RESULT(scratch[2]);                            \
+      mpfr_##MPFR_FUNC_NAME(mres, scratch[0], b, ROUNDING_MODE);               \
+      RAPTOR_SR_ROUND(scratch[2], mres);                                       \
       RET c = mpfr_get_##MPFR_GET(scratch[2], ROUNDING_MODE);                  \
+      RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME);                                    \
       return c;                                                                \
     } else if (__raptor_fprt_is_mem_mode(mode)) {                              \
+      RAPTOR_FP_EVENTS_CLEAR();                                                \
       __raptor_fprt_trunc_count(exponent, significand, mode, loc, scratch);    \
       __raptor_fp *ma = __raptor_fprt_##FROM_TYPE##_to_ptr_checked(            \
           a, exponent, significand, mode, loc, scratch);                       \
@@ -604,6 +720,7 @@ void raptor_fprt_op_clear();
           exponent, significand, mode, loc, scratch);                          \
       RAPTOR_DUMP_INPUT(ma, OP_TYPE, LLVM_OP_NAME);                            \
       mpfr_##MPFR_FUNC_NAME(mc->result, ma->result, b, ROUNDING_MODE);         \
+      RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME);                                    \
       RAPTOR_DUMP_RESULT(mc, OP_TYPE, LLVM_OP_NAME);                           \
       return __raptor_fprt_ptr_to_##FROM_TYPE(mc);                             \
     } else {                                                                   \
@@ -619,14 +736,18 @@ void raptor_fprt_op_clear();
       ARG1 a, ARG2 b, int64_t exponent, int64_t significand, int64_t mode,     \
       const char *loc, mpfr_t *scratch) {                                      \
     if (__raptor_fprt_is_op_mode(mode)) {                                      \
+      RAPTOR_FP_EVENTS_CLEAR();                                                \
       __raptor_fprt_trunc_count(exponent, significand, mode, loc, scratch);    \
       mpfr_set_##MPFR_SET_ARG1(scratch[0], a, ROUNDING_MODE);                  \
       mpfr_set_##MPFR_SET_ARG2(scratch[1], b, ROUNDING_MODE);                  \
-      mpfr_##MPFR_FUNC_NAME(scratch[2], scratch[0], scratch[1],                \
-                            ROUNDING_MODE);                                    \
+      mpfr_ptr mres = RAPTOR_SR_RESULT(scratch[2]);                            \
+      mpfr_##MPFR_FUNC_NAME(mres, scratch[0], scratch[1], ROUNDING_MODE);      \
+      RAPTOR_SR_ROUND(scratch[2], mres);                                       \
       RET c = mpfr_get_##MPFR_GET(scratch[2], ROUNDING_MODE);                  \
+      RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME);                                    \
       return c;                                                                \
     } else if (__raptor_fprt_is_mem_mode(mode)) {                              \
+      RAPTOR_FP_EVENTS_CLEAR();                                                \
       __raptor_fprt_trunc_count(exponent, significand, mode, loc, scratch);    \
       __raptor_fp *ma = __raptor_fprt_##FROM_TYPE##_to_ptr_checked(            \
           a, exponent, significand, mode, loc, scratch);                       \
@@ -638,6 +759,7 @@ void raptor_fprt_op_clear();
       RAPTOR_DUMP_INPUT(mb, OP_TYPE, LLVM_OP_NAME);                            \
       mpfr_##MPFR_FUNC_NAME(mc->result, ma->result, mb->result,                \
                             ROUNDING_MODE);                                    \
+      RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME);                                    \
       RAPTOR_DUMP_RESULT(mc, OP_TYPE, LLVM_OP_NAME);                           \
       return __raptor_fprt_ptr_to_##FROM_TYPE(mc);                             \
     } else {                                                                   \
@@ -652,13 +774,18 @@ void raptor_fprt_op_clear();
       TYPE a, TYPE b, TYPE c, int64_t exponent, int64_t significand,           \
       int64_t mode, const char *loc, mpfr_t *scratch) {                        \
     if (__raptor_fprt_is_op_mode(mode)) {                                      \
+      RAPTOR_FP_EVENTS_CLEAR();                                                \
       __raptor_fprt_trunc_count(exponent, significand, mode, loc, scratch);    \
       mpfr_set_##MPFR_TYPE(scratch[0], a, ROUNDING_MODE);                      \
       mpfr_set_##MPFR_TYPE(scratch[1], b, ROUNDING_MODE);                      \
       mpfr_set_##MPFR_TYPE(scratch[2], c, ROUNDING_MODE);                      \
-      mpfr_mul(scratch[0], scratch[0], scratch[1], ROUNDING_MODE);             \
-      mpfr_add(scratch[0], scratch[0], scratch[2], ROUNDING_MODE);             \
+      mpfr_ptr mres = RAPTOR_SR_RESULT(scratch[0]);                            \
+      mpfr_mul(mres, scratch[0], scratch[1], ROUNDING_MODE);                   \
+      RAPTOR_SR_ROUND(scratch[0], mres);                                       \
+      mpfr_add(mres, scratch[0], scratch[2], ROUNDING_MODE);                   \
+      RAPTOR_SR_ROUND(scratch[0], mres);                                       \
       TYPE res = mpfr_get_##MPFR_TYPE(scratch[0], ROUNDING_MODE);              \
+      RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME);                                    \
       return res;                                                              \
     } else if (__raptor_fprt_is_mem_mode(mode)) {                              \
       __raptor_fp *ma = __raptor_fprt_##FROM_TYPE##_to_ptr_checked(            \
@@ -712,6 +839,57 @@ void raptor_fprt_op_clear();
   }
 #endif // RAPTOR_FPRT_ENABLE_SHADOW_RESIDUALS
 
+// Accumulations (fadd and fsub in a reduction, fmuladd and fma) when the
+// truncation has an accumulator format. Op mode only, the pass does not
+// emit them in mem mode.
+#define __RAPTOR_MPFR_ACC_BIN(OP_TYPE, LLVM_OP_NAME, MPFR_FUNC_NAME,           \
+                              FROM_TYPE, TYPE, MPFR_TYPE, ROUNDING_MODE)       \
+  __RAPTOR_MPFR_ATTRIBUTES                                                     \
+  TYPE __raptor_fprt_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME##_acc(           \
+      TYPE a, TYPE b, int64_t acc_exponent, int64_t acc_significand,           \
+      int64_t exponent, int64_t significand, int64_t mode, const char *loc,    \
+      mpfr_t *scratch) {                                                       \
+    if (!__raptor_fprt_is_op_mode(mode))                                       \
+      abort();                                                                 \
+    RAPTOR_FP_EVENTS_CLEAR();                                                  \
+    __raptor_fprt_trunc_count(exponent, significand, mode, loc, scratch);      \
+    __raptor_fprt_acc_scope acc(acc_exponent, acc_significand);                \
+    mpfr_set_##MPFR_TYPE(acc.reg, a, ROUNDING_MODE);                           \
+    mpfr_ptr mres = RAPTOR_SR_RESULT(acc.reg);                                 \
+    mpfr_##MPFR_FUNC_NAME##_##MPFR_TYPE(mres, acc.reg, b, ROUNDING_MODE);      \
+    RAPTOR_SR_ROUND(acc.reg, mres);                                            \
+    TYPE res = mpfr_get_##MPFR_TYPE(acc.reg, ROUNDING_MODE);                   \
+    RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME##_acc);                                \
+    return res;                                                                \
+  }
+
+#define __RAPTOR_MPFR_ACC_FMULADD(OP_TYPE, LLVM_OP_NAME, FROM_TYPE, TYPE,      \
+                                  MPFR_TYPE, LLVM_TYPE, ROUNDING_MODE)         \
+  __RAPTOR_MPFR_ATTRIBUTES                                                     \
+  TYPE                                                                         \
+      __raptor_fprt_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME##_##LLVM_TYPE##_acc( \
+          TYPE a, TYPE b, TYPE c, int64_t acc_exponent,                        \
+          int64_t acc_significand, int64_t exponent, int64_t significand,      \
+          int64_t mode, const char *loc, mpfr_t *scratch) {                    \
+    if (!__raptor_fprt_is_op_mode(mode))                                       \
+      abort();                                                                 \
+    RAPTOR_FP_EVENTS_CLEAR();                                                  \
+    __raptor_fprt_trunc_count(exponent, significand, mode, loc, scratch);      \
+    mpfr_set_##MPFR_TYPE(scratch[0], a, ROUNDING_MODE);                        \
+    mpfr_set_##MPFR_TYPE(scratch[1], b, ROUNDING_MODE);                        \
+    mpfr_ptr mres = RAPTOR_SR_RESULT(scratch[0]);                              \
+    mpfr_mul(mres, scratch[0], scratch[1], ROUNDING_MODE);                     \
+    RAPTOR_SR_ROUND(scratch[0], mres);                                         \
+    __raptor_fprt_acc_scope acc(acc_exponent, acc_significand);                \
+    mpfr_set_##MPFR_TYPE(acc.reg, c, ROUNDING_MODE);                           \
+    mres = RAPTOR_SR_RESULT(acc.reg);                                          \
+    mpfr_add(mres, acc.reg, scratch[0], ROUNDING_MODE);                        \
+    RAPTOR_SR_ROUND(acc.reg, mres);                                            \
+    TYPE res = mpfr_get_##MPFR_TYPE(acc.reg, ROUNDING_MODE);                   \
+    RAPTOR_FP_EVENTS_CHECK(LLVM_OP_NAME##_acc);                                \
+    return res;                                                                \
+  }
+
 #define __RAPTOR_MPFR_ISCLASS(FROM_TYPE, TYPE, LLVM_TYPE)                         \
   __RAPTOR_MPFR_ORIGINAL_ATTRIBUTES bool                                          \
       __raptor_fprt_original_##FROM_TYPE##_intr_llvm_is_fpclass_##LLVM_TYPE(      \
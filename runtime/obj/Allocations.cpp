@@ -0,0 +1,295 @@
+//===- Allocations.cpp - Per-allocation memory traffic -------------------===//
+//
+//                             Raptor Project
+//
+// Part of the Raptor Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Heap blocks are registered either by the pass (-raptor-track-allocations
+// wraps malloc, calloc, realloc, free, new and delete) or by the user through
+// __raptor_alloc_register, which also gives the array a name. The floating
+// point accesses are attributed to the block they fall in and reported per
+// allocation site, or per name for user registered arrays. -raptor-track-
+// allocations passes every access to __raptor_fprt_alloc_access, unless
+// -raptor-truncate-access-trace is on, whose hook attributes them as well.
+//
+// Set RAPTOR_ALLOC_REPORT=<path> to write the report there instead of stderr.
+//
+//===----------------------------------------------------------------------===//
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+#include "raptor/Allocations.h"
+#include "raptor/Common.h"
+
+std::atomic<bool> raptor_fprt_alloc_tracking = false;
+
+namespace {
+
+struct AllocSiteStats {
+  std::atomic<uint64_t> allocations = 0;
+  std::atomic<uint64_t> allocated_bytes = 0;
+  std::atomic<uint64_t> accesses = 0;
+  std::atomic<uint64_t> load_bytes = 0;
+  std::atomic<uint64_t> store_bytes = 0;
+
+  void access(int64_t size, bool is_store) {
+    accesses.fetch_add(1, std::memory_order_relaxed);
+    (is_store ? store_bytes : load_bytes)
+        .fetch_add(size, std::memory_order_relaxed);
+  }
+};
+
+struct Allocation {
+  uintptr_t end;
+  AllocSiteStats *site;
+};
+
+// The last allocation a thread hit. Accesses to the same array tend to come
+// in long runs so this saves most of the map lookups. It is dropped whenever
+// the set of allocations changes.
+struct AllocCacheTy {
+  uintptr_t begin = 0;
+  uintptr_t end = 0;
+  AllocSiteStats *site = nullptr;
+  uint64_t generation = 0;
+};
+
+thread_local AllocCacheTy AllocCache;
+
+// The locations the pass gives are uniqued strings that never go away, so
+// every thread keeps the sites it saw last and only takes the lock to look up
+// the others. Allocations may happen in static destructors, after the thread
+// locals were destroyed, so this is a plain direct mapped array, not a map.
+struct AllocSiteCacheTy {
+  static constexpr unsigned Bits = 6;
+  struct {
+    const char *loc;
+    AllocSiteStats *site;
+  } entries[1u << Bits];
+
+  auto &operator[](const char *loc) {
+    return entries[((uintptr_t)loc * 0x9e3779b97f4a7c15ull) >> (64 - Bits)];
+  }
+};
+
+thread_local AllocSiteCacheTy AllocSiteCache;
+
+// Sums of the counters of all sites with the same name, for the report.
+struct AllocSiteTotals {
+  uint64_t allocations = 0;
+  uint64_t allocated_bytes = 0;
+  uint64_t accesses = 0;
+  uint64_t load_bytes = 0;
+  uint64_t store_bytes = 0;
+
+  void add(const AllocSiteStats &s) {
+    allocations += s.allocations.load(std::memory_order_relaxed);
+    allocated_bytes += s.allocated_bytes.load(std::memory_order_relaxed);
+    accesses += s.accesses.load(std::memory_order_relaxed);
+    load_bytes += s.load_bytes.load(std::memory_order_relaxed);
+    store_bytes += s.store_bytes.load(std::memory_order_relaxed);
+  }
+};
+
+class AllocRegistryTy {
+  std::shared_mutex lock;
+  std::map<uintptr_t, Allocation> allocs;
+  // Starts at 1 so that a zero initialized cache is never valid.
+  std::atomic<uint64_t> generation = 1;
+
+  std::mutex sitesLock;
+  // Sites of the pass by their uniqued location, arrays the user registered
+  // by a copy of their name.
+  std::unordered_map<const char *, std::unique_ptr<AllocSiteStats>> sites;
+  std::map<std::string, AllocSiteStats> names;
+  AllocSiteStats unattributed;
+
+  AllocSiteStats *getSite(const char *loc) {
+    auto &entry = AllocSiteCache[loc];
+    if (entry.loc == loc)
+      return entry.site;
+    std::lock_guard<std::mutex> guard(sitesLock);
+    auto &site = sites[loc];
+    if (!site)
+      site = std::make_unique<AllocSiteStats>();
+    entry = {loc, site.get()};
+    return site.get();
+  }
+
+  void insert(const void *ptr, int64_t size, AllocSiteStats *stats) {
+    stats->allocations.fetch_add(1, std::memory_order_relaxed);
+    stats->allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    std::unique_lock<std::shared_mutex> guard(lock);
+    // Registering a block again, e.g. to name it, replaces the old entry.
+    allocs[(uintptr_t)ptr] = {(uintptr_t)ptr + (uintptr_t)size, stats};
+    generation.fetch_add(1, std::memory_order_release);
+    raptor_fprt_alloc_tracking.store(true, std::memory_order_relaxed);
+  }
+
+public:
+  void add(const void *ptr, int64_t size, const char *loc) {
+    if (ptr)
+      insert(ptr, size, getSite(loc ? loc : "unknown"));
+  }
+
+  void addNamed(const void *ptr, int64_t size, const char *name) {
+    if (!ptr)
+      return;
+    AllocSiteStats *stats;
+    {
+      std::lock_guard<std::mutex> guard(sitesLock);
+      stats = &names[name ? name : "unknown"];
+    }
+    insert(ptr, size, stats);
+  }
+
+  void remove(const void *ptr) {
+    if (!ptr)
+      return;
+    std::unique_lock<std::shared_mutex> guard(lock);
+    if (allocs.erase((uintptr_t)ptr))
+      generation.fetch_add(1, std::memory_order_release);
+  }
+
+  bool access(const void *ptr, int64_t size, bool is_store, uintptr_t *base) {
+    uintptr_t addr = (uintptr_t)ptr;
+    auto &cache = AllocCache;
+    uint64_t gen = generation.load(std::memory_order_acquire);
+    if (cache.generation != gen || addr < cache.begin || addr >= cache.end) {
+      std::shared_lock<std::shared_mutex> guard(lock);
+      gen = generation.load(std::memory_order_relaxed);
+      auto it = allocs.upper_bound(addr);
+      if (it == allocs.begin() || addr >= std::prev(it)->second.end) {
+        unattributed.access(size, is_store);
+        return false;
+      }
+      --it;
+      cache = {it->first, it->second.end, it->second.site, gen};
+    }
+    cache.site->access(size, is_store);
+    if (base)
+      *base = cache.begin;
+    return true;
+  }
+
+  void write(const char *path) {
+    std::lock_guard<std::mutex> guard(sitesLock);
+    if (sites.empty() && names.empty())
+      return;
+    // The same location may be uniqued once per module.
+    std::map<std::string, AllocSiteTotals> totals;
+    for (auto &it : sites)
+      totals[it.first].add(*it.second);
+    for (auto &it : names)
+      totals[it.first].add(it.second);
+    AllocSiteTotals rest;
+    rest.add(unattributed);
+
+    FILE *out = stderr;
+    if (path && !(out = fopen(path, "w"))) {
+      fprintf(stderr, "raptor: could not open allocation report '%s'\n", path);
+      out = stderr;
+    }
+    fprintf(out, "site,allocations,allocated_bytes,accesses,load_bytes,"
+                 "store_bytes\n");
+    auto print = [&](const char *name, const AllocSiteTotals &s) {
+      fprintf(out, "\"%s\",%llu,%llu,%llu,%llu,%llu\n", name,
+              (unsigned long long)s.allocations,
+              (unsigned long long)s.allocated_bytes,
+              (unsigned long long)s.accesses,
+              (unsigned long long)s.load_bytes,
+              (unsigned long long)s.store_bytes);
+    };
+    for (auto &it : totals)
+      print(it.first.c_str(), it.second);
+    print("unattributed", rest);
+    if (out != stderr)
+      fclose(out);
+  }
+};
+
+// Allocations may be registered from static constructors of other translation
+// units and freed from their destructors, so the registry is created on first
+// use and never destroyed.
+AllocRegistryTy &getAllocRegistry() {
+  static AllocRegistryTy *registry = new AllocRegistryTy;
+  return *registry;
+}
+
+struct AllocReportTy {
+  ~AllocReportTy() {
+    if (raptor_fprt_alloc_tracking)
+      getAllocRegistry().write(getenv("RAPTOR_ALLOC_REPORT"));
+  }
+};
+
+AllocReportTy AllocReport;
+
+} // namespace
+
+bool raptor_fprt_alloc_access(const void *ptr, int64_t size, bool is_store,
+                              uintptr_t *base) {
+  return getAllocRegistry().access(ptr, size, is_store, base);
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_fprt_alloc(void *ptr, int64_t size, const char *loc) {
+  getAllocRegistry().add(ptr, size, loc);
+}
+
+// Called after realloc returned new_ptr. A failed realloc leaves the old
+// block allocated.
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_fprt_realloc(void *old_ptr, void *new_ptr, int64_t size,
+                           const char *loc) {
+  if (!new_ptr)
+    return;
+  getAllocRegistry().remove(old_ptr);
+  getAllocRegistry().add(new_ptr, size, loc);
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_fprt_free(void *ptr) { getAllocRegistry().remove(ptr); }
+
+// Called before every floating point load and store with
+// -raptor-track-allocations.
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_fprt_alloc_access(void *ptr, int64_t size, int64_t is_store) {
+  if (raptor_fprt_alloc_tracking.load(std::memory_order_relaxed))
+    getAllocRegistry().access(ptr, size, is_store, nullptr);
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_alloc_register(void *ptr, int64_t size, const char *name) {
+  getAllocRegistry().addNamed(ptr, size, name);
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_alloc_unregister(void *ptr) { getAllocRegistry().remove(ptr); }
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_alloc_report_write(const char *path) {
+  getAllocRegistry().write(path);
+}
+
+// Fortran bindings, the name has to be null terminated.
+__RAPTOR_MPFR_ATTRIBUTES
+void f_raptor_alloc_register(void *ptr, int64_t size, const char *name) {
+  __raptor_alloc_register(ptr, size, name);
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void f_raptor_alloc_unregister(void *ptr) { __raptor_alloc_unregister(ptr); }
@@ -0,0 +1,399 @@
+//===- CacheSim.cpp - Cache model for narrower floating point storage ----===//
+//
+//                             Raptor Project
+//
+// Part of the Raptor Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Runtime side of -raptor-truncate-access-trace. Every floating point access
+// runs through two copies of a set-associative LRU cache hierarchy. The first
+// sees the addresses as they are, the second sees the data as if every element
+// was stored in RAPTOR_CACHE_TRUNCATE bits. At exit we report the misses and
+// write backs of both per function and level, i.e. how much narrower storage
+// would save.
+//
+// The narrowed run shrinks every array around its start, the registered
+// allocation it lies in (see obj/Allocations.cpp) or else the base pointer the
+// pass found for the access. Arrays thus keep their own addresses and never
+// overlap. A store dirties the line in every level it reaches and evicting a
+// dirty line counts as a write back from that level.
+//
+//   RAPTOR_CACHE_CONFIG=<path>    one "name size line_size ways" per line, sizes
+//                                 may use a k or m suffix, '#' starts a comment
+//                                 (default: L1 32k 64 8, L2 1m 64 16,
+//                                 LLC 32m 64 16)
+//   RAPTOR_CACHE_TRUNCATE=<bits>  storage width of the remapped run, default 16
+//   RAPTOR_CACHE_REPORT=<path>    write the CSV report there instead of stderr
+//
+// Only floating point accesses are traced, so the model ignores the cache
+// pressure of all other data. There is one hierarchy shared by all threads.
+// Threads buffer their accesses and replay them in batches, so the
+// interleaving of threads is coarser than on the hardware. Batches of threads
+// that are still running are replayed when the report is written.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "raptor/Allocations.h"
+#include "raptor/Common.h"
+
+namespace {
+
+struct CacheLevelConfig {
+  std::string name;
+  uint64_t size;
+  uint64_t line;
+  uint64_t ways;
+};
+
+class CacheLevel {
+  uint64_t sets;
+  unsigned lineShift = 0;
+  uint64_t clock = 0;
+  // sets * ways entries, a set occupies consecutive entries.
+  std::vector<uint64_t> tags;
+  std::vector<uint64_t> lastUse;
+  std::vector<bool> dirty;
+
+public:
+  const uint64_t ways;
+
+  CacheLevel(const CacheLevelConfig &config)
+      : sets(config.size / (config.line * config.ways)),
+        tags(sets * config.ways, ~0ull), lastUse(sets * config.ways, 0),
+        dirty(sets * config.ways, false), ways(config.ways) {
+    while ((1ull << lineShift) < config.line)
+      ++lineShift;
+  }
+
+  unsigned getLineShift() const { return lineShift; }
+
+  // Returns whether addr hit, fills the line on a miss. writeBack is set if
+  // that evicted a dirty line.
+  bool access(uint64_t addr, bool isStore, bool &writeBack) {
+    uint64_t line = addr >> lineShift;
+    uint64_t first = (line % sets) * ways;
+    ++clock;
+    writeBack = false;
+    uint64_t victim = first;
+    for (uint64_t w = first; w < first + ways; ++w) {
+      if (tags[w] == line) {
+        lastUse[w] = clock;
+        if (isStore)
+          dirty[w] = true;
+        return true;
+      }
+      if (lastUse[w] < lastUse[victim])
+        victim = w;
+    }
+    writeBack = tags[victim] != ~0ull && dirty[victim];
+    tags[victim] = line;
+    lastUse[victim] = clock;
+    dirty[victim] = isStore;
+    return false;
+  }
+};
+
+struct CacheStats {
+  uint64_t accesses = 0;
+  uint64_t bytes = 0;
+  // Misses and write backs per level, without and with remapping.
+  std::vector<uint64_t> misses[2];
+  std::vector<uint64_t> writeBacks[2];
+};
+
+class CacheHierarchy {
+  std::vector<CacheLevel> levels;
+
+public:
+  CacheHierarchy(const std::vector<CacheLevelConfig> &config) {
+    for (auto &c : config)
+      levels.emplace_back(c);
+  }
+
+  // Touch every line of the first level in [addr, addr + size). A line that
+  // misses in one level is looked up in the next.
+  void access(uint64_t addr, uint64_t size, bool isStore,
+              std::vector<uint64_t> &misses,
+              std::vector<uint64_t> &writeBacks) {
+    unsigned shift = levels[0].getLineShift();
+    uint64_t last = (addr + (size ? size : 1) - 1) >> shift;
+    for (uint64_t line = addr >> shift; line <= last; ++line) {
+      for (size_t l = 0; l < levels.size(); ++l) {
+        bool writeBack;
+        bool hit = levels[l].access(line << shift, isStore, writeBack);
+        if (writeBack)
+          ++writeBacks[l];
+        if (hit)
+          break;
+        ++misses[l];
+      }
+    }
+  }
+};
+
+bool parseSize(const char *str, uint64_t &res) {
+  char *end;
+  res = strtoull(str, &end, 0);
+  if (end == str)
+    return false;
+  if (*end == 'k' || *end == 'K')
+    res <<= 10;
+  else if (*end == 'm' || *end == 'M')
+    res <<= 20;
+  else if (*end != '\0')
+    return false;
+  return res > 0;
+}
+
+std::vector<CacheLevelConfig> parseCacheConfig(const char *path) {
+  std::vector<CacheLevelConfig> defaults = {{"L1", 32 << 10, 64, 8},
+                                            {"L2", 1 << 20, 64, 16},
+                                            {"LLC", 32 << 20, 64, 16}};
+  if (!path)
+    return defaults;
+  FILE *in = fopen(path, "r");
+  if (!in) {
+    fprintf(stderr, "raptor: could not open cache config '%s'\n", path);
+    return defaults;
+  }
+  std::vector<CacheLevelConfig> res;
+  char line[256];
+  unsigned lineno = 0;
+  while (fgets(line, sizeof(line), in)) {
+    ++lineno;
+    if (char *comment = strchr(line, '#'))
+      *comment = '\0';
+    char name[64], size[32], lineSize[32], ways[32];
+    int n = sscanf(line, "%63s %31s %31s %31s", name, size, lineSize, ways);
+    if (n <= 0)
+      continue;
+    CacheLevelConfig c;
+    c.name = name;
+    if (n != 4 || !parseSize(size, c.size) || !parseSize(lineSize, c.line) ||
+        !parseSize(ways, c.ways) || (c.line & (c.line - 1)) ||
+        c.size < c.line * c.ways) {
+      fprintf(stderr, "raptor: %s:%u: invalid cache level, expected "
+                      "\"name size line_size ways\"\n",
+              path, lineno);
+      continue;
+    }
+    res.push_back(c);
+  }
+  fclose(in);
+  if (res.empty()) {
+    fprintf(stderr, "raptor: %s: no cache levels, using the defaults\n", path);
+    return defaults;
+  }
+  return res;
+}
+
+struct CacheAccess {
+  uint64_t addr;
+  uint64_t size;
+  uint64_t elemBits;
+  // Start of the array the access falls in.
+  uint64_t base;
+  const char *func;
+  bool isStore;
+};
+
+struct CacheThreadTy;
+
+class CacheSimTy {
+  std::mutex lock;
+  std::vector<CacheLevelConfig> config;
+  CacheHierarchy caches[2];
+  uint64_t truncBits;
+  std::map<const char *, CacheStats> stats;
+  std::set<CacheThreadTy *> threads;
+
+  void replay(const CacheAccess &a);
+
+public:
+  CacheSimTy()
+      : config(parseCacheConfig(getenv("RAPTOR_CACHE_CONFIG"))),
+        caches{CacheHierarchy(config), CacheHierarchy(config)} {
+    const char *bits = getenv("RAPTOR_CACHE_TRUNCATE");
+    truncBits = bits ? strtoull(bits, nullptr, 0) : 16;
+    if (truncBits == 0 || truncBits % 8) {
+      fprintf(stderr, "raptor: invalid RAPTOR_CACHE_TRUNCATE, using 16\n");
+      truncBits = 16;
+    }
+  }
+
+  ~CacheSimTy() { write(getenv("RAPTOR_CACHE_REPORT")); }
+
+  void addThread(CacheThreadTy *thread) {
+    std::lock_guard<std::mutex> guard(lock);
+    threads.insert(thread);
+  }
+  void removeThread(CacheThreadTy *thread);
+  void replay(const std::vector<CacheAccess> &batch);
+  void write(const char *path);
+};
+
+CacheSimTy CacheSim;
+
+// The accesses of a thread are handed over to the simulation in batches. The
+// lock of the thread only guards its batch, so the thread never holds it while
+// it waits for the simulation and reports can take the batches of running
+// threads.
+struct CacheThreadTy {
+  static constexpr size_t capacity = 4096;
+  std::mutex lock;
+  std::vector<CacheAccess> accesses;
+
+  CacheThreadTy() {
+    accesses.reserve(capacity);
+    CacheSim.addThread(this);
+  }
+  ~CacheThreadTy() { CacheSim.removeThread(this); }
+
+  void access(const CacheAccess &a) {
+    std::vector<CacheAccess> full;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      accesses.push_back(a);
+      if (accesses.size() < capacity)
+        return;
+      full.swap(accesses);
+      accesses.reserve(capacity);
+    }
+    CacheSim.replay(full);
+  }
+
+  std::vector<CacheAccess> take() {
+    std::vector<CacheAccess> batch;
+    std::lock_guard<std::mutex> guard(lock);
+    batch.swap(accesses);
+    return batch;
+  }
+};
+
+thread_local CacheThreadTy CacheThread;
+
+void CacheSimTy::replay(const CacheAccess &a) {
+  auto &s = stats[a.func];
+  if (s.misses[0].empty()) {
+    for (unsigned t = 0; t < 2; ++t) {
+      s.misses[t].resize(config.size());
+      s.writeBacks[t].resize(config.size());
+    }
+  }
+  s.accesses++;
+  s.bytes += a.size;
+  caches[0].access(a.addr, a.size, a.isStore, s.misses[0], s.writeBacks[0]);
+  // Keep the elements of the array contiguous at the narrower stride.
+  uint64_t addr = a.addr, size = a.size;
+  if (a.elemBits > truncBits && a.elemBits % 8 == 0 && addr >= a.base) {
+    uint64_t elemBytes = a.elemBits / 8, truncBytes = truncBits / 8;
+    addr = a.base + (addr - a.base) / elemBytes * truncBytes;
+    size = size / elemBytes * truncBytes;
+  }
+  caches[1].access(addr, size, a.isStore, s.misses[1], s.writeBacks[1]);
+}
+
+void CacheSimTy::replay(const std::vector<CacheAccess> &batch) {
+  std::lock_guard<std::mutex> guard(lock);
+  for (auto &a : batch)
+    replay(a);
+}
+
+void CacheSimTy::removeThread(CacheThreadTy *thread) {
+  std::vector<CacheAccess> batch = thread->take();
+  std::lock_guard<std::mutex> guard(lock);
+  for (auto &a : batch)
+    replay(a);
+  threads.erase(thread);
+}
+
+void CacheSimTy::write(const char *path) {
+  std::lock_guard<std::mutex> guard(lock);
+  for (auto thread : threads)
+    for (auto &a : thread->take())
+      replay(a);
+  if (stats.empty())
+    return;
+  FILE *out = stderr;
+  if (path && !(out = fopen(path, "w"))) {
+    fprintf(stderr, "raptor: could not open cache report '%s'\n", path);
+    out = stderr;
+  }
+
+  // The same function may be traced in several translation units.
+  std::map<std::string, CacheStats> merged;
+  for (auto &it : stats) {
+    auto &m = merged[it.first];
+    m.accesses += it.second.accesses;
+    m.bytes += it.second.bytes;
+    for (unsigned t = 0; t < 2; ++t) {
+      m.misses[t].resize(config.size());
+      m.writeBacks[t].resize(config.size());
+      for (size_t l = 0; l < config.size(); ++l) {
+        m.misses[t][l] += it.second.misses[t][l];
+        m.writeBacks[t][l] += it.second.writeBacks[t][l];
+      }
+    }
+  }
+
+  fprintf(out, "function,accesses,bytes");
+  for (auto &c : config)
+    fprintf(out,
+            ",%s_misses,%s_misses_fp%llu,%s_reduction,%s_writebacks,"
+            "%s_writebacks_fp%llu",
+            c.name.c_str(), c.name.c_str(), (unsigned long long)truncBits,
+            c.name.c_str(), c.name.c_str(), c.name.c_str(),
+            (unsigned long long)truncBits);
+  fprintf(out, "\n");
+  for (auto &it : merged) {
+    auto &s = it.second;
+    fprintf(out, "\"%s\",%llu,%llu", it.first.c_str(),
+            (unsigned long long)s.accesses, (unsigned long long)s.bytes);
+    for (size_t l = 0; l < config.size(); ++l) {
+      fprintf(out, ",%llu,%llu,", (unsigned long long)s.misses[0][l],
+              (unsigned long long)s.misses[1][l]);
+      if (s.misses[0][l])
+        fprintf(out, "%.3f",
+                1.0 - (double)s.misses[1][l] / (double)s.misses[0][l]);
+      fprintf(out, ",%llu,%llu", (unsigned long long)s.writeBacks[0][l],
+              (unsigned long long)s.writeBacks[1][l]);
+    }
+    fprintf(out, "\n");
+  }
+
+  if (out != stderr)
+    fclose(out);
+}
+
+} // namespace
+
+// Called before every floating point load and store, see handleFlopTrace in
+// the pass. elem_bits is the width of the scalar type accessed and base the
+// object the pass found ptr to be derived from.
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_fprt_memory_trace(void *ptr, int64_t size, int64_t is_store,
+                                int64_t elem_bits, void *base,
+                                const char *func) {
+  uintptr_t allocBase = 0;
+  if (raptor_fprt_alloc_tracking.load(std::memory_order_relaxed) &&
+      raptor_fprt_alloc_access(ptr, size, is_store, &allocBase))
+    base = (void *)allocBase;
+  CacheThread.access({(uint64_t)ptr, (uint64_t)size, (uint64_t)elem_bits,
+                      (uint64_t)base, func, is_store != 0});
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_cache_report_write(const char *path) { CacheSim.write(path); }
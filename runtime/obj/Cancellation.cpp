@@ -0,0 +1,152 @@
+//===- Cancellation.cpp - Catastrophic cancellation counters -------------===//
+//
+//                             Raptor Project
+//
+// Part of the Raptor Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// With -raptor-cancellation-count=<n> the pass compares the exponent of every
+// fadd and fsub result with the larger exponent of its operands and calls
+// __raptor_fprt_cancellation when at least n leading bits cancelled. The check
+// is done inline on the exponent bits, so only the events reach the runtime.
+//
+// Events are counted per source location in buckets of the bits lost, 1,
+// 2-3, 4-7 and so on, and a last bucket for results that lost all of the
+// significand: results with an exponent field of 0, exact zeros from equal
+// operands and subnormals, and results more than the significand below. Set
+// RAPTOR_CANCELLATION_REPORT=<path> to write the CSV report at exit, or call
+// __raptor_cancellation_report_write. Sites are sorted by their most severe
+// events first.
+//
+//===----------------------------------------------------------------------===//
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "raptor/Common.h"
+
+namespace {
+
+// 1, 2-3, ..., 32-63 bits and all of the significand.
+constexpr unsigned CancellationBuckets = 7;
+
+struct CancellationSite {
+  const char *loc;
+  std::atomic<long long> counts[CancellationBuckets] = {};
+};
+
+struct CancellationGlobalTy {
+  std::mutex lock;
+  std::unordered_map<const char *, std::unique_ptr<CancellationSite>> sites;
+
+  CancellationSite *get(const char *loc) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto &site = sites[loc];
+    if (!site) {
+      site = std::make_unique<CancellationSite>();
+      site->loc = loc;
+    }
+    return site.get();
+  }
+
+  void write(const char *path);
+
+  ~CancellationGlobalTy() {
+    if (const char *path = getenv("RAPTOR_CANCELLATION_REPORT"))
+      write(path);
+  }
+};
+
+CancellationGlobalTy CancellationGlobal;
+
+// Sites never go away, so every thread can keep its own index of them and only
+// takes the lock the first time it sees one.
+thread_local std::unordered_map<const char *, CancellationSite *>
+    CancellationCache;
+
+// The pass reports zero and subnormal results with lost = significand + 1,
+// their exponent difference says nothing about the bits that are left.
+unsigned cancellationBucket(int64_t lost, int64_t significand) {
+  if (lost > significand)
+    return CancellationBuckets - 1;
+  unsigned bucket = 0;
+  while (lost >>= 1)
+    bucket++;
+  return std::min(bucket, CancellationBuckets - 2);
+}
+
+void CancellationGlobalTy::write(const char *path) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    fprintf(stderr, "raptor: could not open cancellation report '%s'\n",
+            path);
+    return;
+  }
+
+  struct Row {
+    const char *loc;
+    long long counts[CancellationBuckets];
+    long long events;
+  };
+  std::vector<Row> rows;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto &it : sites) {
+      Row row{it.first, {}, 0};
+      for (unsigned b = 0; b < CancellationBuckets; b++) {
+        row.counts[b] = it.second->counts[b].load(std::memory_order_relaxed);
+        row.events += row.counts[b];
+      }
+      rows.push_back(row);
+    }
+  }
+  // The most bits lost first, then the most events.
+  std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+    for (unsigned i = CancellationBuckets; i-- > 0;)
+      if (a.counts[i] != b.counts[i])
+        return a.counts[i] > b.counts[i];
+    return false;
+  });
+
+  fprintf(out, "site,events,bits_1,bits_2_3,bits_4_7,bits_8_15,bits_16_31,"
+               "bits_32_63,all_bits\n");
+  for (const Row &row : rows) {
+    fprintf(out, "\"%s\",%lld", row.loc, row.events);
+    for (unsigned b = 0; b < CancellationBuckets; b++)
+      fprintf(out, ",%lld", row.counts[b]);
+    fprintf(out, "\n");
+  }
+  fclose(out);
+}
+
+} // namespace
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_fprt_cancellation(int64_t lost, int64_t significand,
+                                const char *loc) {
+  CancellationSite *&site = CancellationCache[loc];
+  if (!site)
+    site = CancellationGlobal.get(loc);
+  site->counts[cancellationBucket(lost, significand)].fetch_add(
+      1, std::memory_order_relaxed);
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_cancellation_report_write(const char *path) {
+  CancellationGlobal.write(path);
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void f_raptor_cancellation_report_write(const char *path) {
+  __raptor_cancellation_report_write(path);
+}
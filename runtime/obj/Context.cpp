@@ -0,0 +1,259 @@
+//===- Context.cpp - Calling context sensitive error attribution ---------===//
+//
+//                             Raptor Project
+//
+// Part of the Raptor Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// With -raptor-context-depth=<n> the pass brackets every truncated function
+// with __raptor_fprt_ctx_enter/exit, which maintain a stack of the functions
+// entered per thread. The innermost n frames are compressed to a hash, and the
+// shadow errors of the ops are accumulated per (hash, source location) on top
+// of the per location totals, so an op in a shared helper is split by the
+// callers that reached it.
+//
+// Frames are hashed by the address of their name, which is only unique per
+// module without LTO. The report merges contexts with equal names, so this
+// only costs some extra table entries.
+//
+// Set RAPTOR_CONTEXT_REPORT=<path> to write the calling context tree at exit,
+// or call __raptor_context_report_write. Every node lists the errors of the
+// ops reached through it and the locations of the ops in its function, each
+// sorted by L1 error. The roots are the outermost of the n frames, so deeper
+// stacks show up under more than one root.
+//
+//===----------------------------------------------------------------------===//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "raptor/Common.h"
+#include "raptor/Context.h"
+
+thread_local uint64_t raptor_fprt_context_hash = 0;
+
+namespace {
+
+typedef std::pair<uint64_t, const char *> ContextSiteKey;
+
+uint64_t contextMix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+struct ContextThreadTy;
+
+struct ContextGlobalTy {
+  std::mutex lock;
+  // The frames of every context seen, outermost first.
+  std::unordered_map<uint64_t, std::vector<const char *>> contexts;
+  // Stats of threads that already exited.
+  std::map<ContextSiteKey, __raptor_op> stats;
+  std::set<ContextThreadTy *> threads;
+
+  void write(const char *path);
+
+  ~ContextGlobalTy() {
+    if (const char *path = getenv("RAPTOR_CONTEXT_REPORT"))
+      write(path);
+  }
+};
+
+ContextGlobalTy ContextGlobal;
+
+struct ContextThreadTy {
+  std::vector<const char *> frames;
+  std::vector<uint64_t> hashes;
+  std::unordered_set<uint64_t> known;
+  // Taken by the thread when it records an op and by reports written while
+  // it runs. Uncontended but for the reports, and the ops recorded are
+  // shadowed in MPFR anyway.
+  std::mutex lock;
+  std::map<ContextSiteKey, __raptor_op> stats;
+
+  ContextThreadTy() {
+    std::lock_guard<std::mutex> guard(ContextGlobal.lock);
+    ContextGlobal.threads.insert(this);
+  }
+
+  ~ContextThreadTy() {
+    raptor_fprt_context_hash = 0;
+    std::lock_guard<std::mutex> guard(ContextGlobal.lock);
+    for (auto &it : stats)
+      merge(ContextGlobal.stats[it.first], it.second);
+    ContextGlobal.threads.erase(this);
+  }
+
+  static void merge(__raptor_op &to, const __raptor_op &from) {
+    if (!to.count)
+      to.op = from.op;
+    to.l1_err += from.l1_err;
+    to.count_thresh += from.count_thresh;
+    to.count += from.count;
+    to.count_ignore += from.count_ignore;
+  }
+
+  int64_t enter(const char *func, int64_t depth) {
+    int64_t prev = frames.size();
+    frames.push_back(func);
+    size_t first = depth > 0 && (size_t)depth < frames.size()
+                       ? frames.size() - depth
+                       : 0;
+    uint64_t h = 0;
+    for (size_t i = first; i < frames.size(); i++)
+      h = contextMix(h ^ (uint64_t)(uintptr_t)frames[i]);
+    // 0 is reserved for no context.
+    h |= h == 0;
+    hashes.push_back(h);
+    raptor_fprt_context_hash = h;
+    if (known.insert(h).second) {
+      std::lock_guard<std::mutex> guard(ContextGlobal.lock);
+      ContextGlobal.contexts.emplace(
+          h, std::vector<const char *>(frames.begin() + first, frames.end()));
+    }
+    return prev;
+  }
+
+  void exit(int64_t prev) {
+    if (prev < 0 || (size_t)prev > frames.size()) {
+      fprintf(stderr, "raptor: __raptor_fprt_ctx_exit without matching "
+                      "enter\n");
+      return;
+    }
+    frames.resize(prev);
+    hashes.resize(prev);
+    raptor_fprt_context_hash = hashes.empty() ? 0 : hashes.back();
+  }
+};
+
+thread_local ContextThreadTy ContextThread;
+
+struct ContextNode {
+  __raptor_op total;
+  std::map<std::string, __raptor_op> sites;
+  std::map<std::string, ContextNode> children;
+};
+
+template <typename T, typename Err>
+std::vector<const std::pair<const std::string, T> *>
+sortedByError(const std::map<std::string, T> &m, Err err) {
+  std::vector<const std::pair<const std::string, T> *> res;
+  for (auto &it : m)
+    res.push_back(&it);
+  std::stable_sort(res.begin(), res.end(), [&](auto *a, auto *b) {
+    return err(a->second) > err(b->second);
+  });
+  return res;
+}
+
+double siteError(const __raptor_op &s) { return s.l1_err; }
+double nodeError(const ContextNode &n) { return n.total.l1_err; }
+
+void printStats(FILE *out, const __raptor_op &s) {
+  fprintf(out, "count %lld violations %lld l1_err %g\n", s.count,
+          s.count_thresh, s.l1_err);
+}
+
+void printNode(FILE *out, const std::string &name, const ContextNode &node,
+               unsigned indent) {
+  fprintf(out, "%*s%s ", indent, "", name.c_str());
+  printStats(out, node.total);
+  for (auto *it : sortedByError(node.sites, siteError)) {
+    fprintf(out, "%*sat %s %s ", indent + 2, "", it->first.c_str(),
+            it->second.op);
+    printStats(out, it->second);
+  }
+  for (auto *it : sortedByError(node.children, nodeError))
+    printNode(out, it->first, it->second, indent + 2);
+}
+
+void ContextGlobalTy::write(const char *path) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    fprintf(stderr, "raptor: could not open context report '%s'\n", path);
+    return;
+  }
+
+  ContextNode root;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    auto all = stats;
+    // Threads that are still alive, e.g. idle OpenMP workers at exit.
+    for (auto thread : threads) {
+      std::lock_guard<std::mutex> threadGuard(thread->lock);
+      for (auto &it : thread->stats)
+        ContextThreadTy::merge(all[it.first], it.second);
+    }
+
+    for (auto &it : all) {
+      auto ctx = contexts.find(it.first.first);
+      if (ctx == contexts.end())
+        continue;
+      ContextNode *node = &root;
+      ContextThreadTy::merge(node->total, it.second);
+      for (const char *frame : ctx->second) {
+        node = &node->children[frame];
+        ContextThreadTy::merge(node->total, it.second);
+      }
+      ContextThreadTy::merge(node->sites[it.first.second], it.second);
+    }
+  }
+
+  fprintf(out, "calling context tree of the shadow errors\n");
+  fprintf(out, "<all> ");
+  printStats(out, root.total);
+  for (auto *it : sortedByError(root.children, nodeError))
+    printNode(out, it->first, it->second, 2);
+  fclose(out);
+}
+
+} // namespace
+
+void raptor_fprt_context_record(const char *loc, const char *op,
+                                bool violation, double err) {
+  uint64_t hash = raptor_fprt_context_hash;
+  if (!hash)
+    return;
+  std::lock_guard<std::mutex> guard(ContextThread.lock);
+  auto &data = ContextThread.stats[{hash, loc}];
+  if (!data.count)
+    data.op = op;
+  if (violation)
+    ++data.count_thresh;
+  data.l1_err += err;
+  ++data.count;
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+int64_t __raptor_fprt_ctx_enter(const char *func, int64_t depth) {
+  return ContextThread.enter(func, depth);
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_fprt_ctx_exit(int64_t prev) { ContextThread.exit(prev); }
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_context_report_write(const char *path) {
+  ContextGlobal.write(path);
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void f_raptor_context_report_write(const char *path) {
+  __raptor_context_report_write(path);
+}
@@ -9,7 +9,9 @@
 #include <utility>
 #include <vector>
 
+#include "raptor/Allocations.h"
 #include "raptor/Common.h"
+#include "raptor/Region.h"
 #include "raptor/raptor.h"
 
 // Global variable to count truncated flops
@@ -18,6 +20,7 @@ std::atomic<long long> trunc_flop_counter = 0;
 std::atomic<long long> double_flop_counter = 0;
 std::atomic<long long> float_flop_counter = 0;
 std::atomic<long long> half_flop_counter = 0;
+std::atomic<long long> bfloat_flop_counter = 0;
 
 std::atomic<long long> trunc_load_counter = 0;
 std::atomic<long long> trunc_store_counter = 0;
@@ -41,6 +44,9 @@ long long __raptor_get_float_flop_count() { return float_flop_counter; }
 __RAPTOR_MPFR_ATTRIBUTES
 long long __raptor_get_half_flop_count() { return half_flop_counter; }
 
+__RAPTOR_MPFR_ATTRIBUTES
+long long __raptor_get_bfloat_flop_count() { return bfloat_flop_counter; }
+
 __RAPTOR_MPFR_ATTRIBUTES
 long long f_raptor_get_trunc_flop_count() {
   return __raptor_get_trunc_flop_count();
@@ -61,27 +67,47 @@ long long f_raptor_get_half_flop_count() {
   return __raptor_get_half_flop_count();
 }
 
+__RAPTOR_MPFR_ATTRIBUTES
+long long f_raptor_get_bfloat_flop_count() {
+  return __raptor_get_bfloat_flop_count();
+}
+
 __RAPTOR_MPFR_ATTRIBUTES
 void __raptor_fprt_trunc_count(int64_t exponent, int64_t significand,
                                int64_t mode, const char *loc, mpfr_t *scratch) {
 #ifndef RAPTOR_FPRT_DISABLE_TRUNC_FLOP_COUNT
   trunc_flop_counter.fetch_add(1, std::memory_order_relaxed);
+  if (auto *region = raptor_fprt_current_region)
+    region->trunc_flops++;
 #endif
 }
 
 __RAPTOR_MPFR_ATTRIBUTES
 void __raptor_fprt_ieee_64_count() {
   double_flop_counter.fetch_add(1, std::memory_order_relaxed);
+  if (auto *region = raptor_fprt_current_region)
+    region->double_flops++;
 }
 
 __RAPTOR_MPFR_ATTRIBUTES
 void __raptor_fprt_ieee_32_count() {
   float_flop_counter.fetch_add(1, std::memory_order_relaxed);
+  if (auto *region = raptor_fprt_current_region)
+    region->float_flops++;
 }
 
 __RAPTOR_MPFR_ATTRIBUTES
 void __raptor_fprt_ieee_16_count() {
   half_flop_counter.fetch_add(1, std::memory_order_relaxed);
+  if (auto *region = raptor_fprt_current_region)
+    region->half_flops++;
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_fprt_bf_16_count() {
+  bfloat_flop_counter.fetch_add(1, std::memory_order_relaxed);
+  if (auto *region = raptor_fprt_current_region)
+    region->bfloat_flops++;
 }
 
 __RAPTOR_MPFR_ATTRIBUTES
@@ -265,6 +291,29 @@ void __raptor_fprt_memory_access(void *ptr, int64_t size, int64_t is_store) {
     else
       original_load_counter.fetch_add(size, std::memory_order_relaxed);
   }
+  if (auto *region = raptor_fprt_current_region)
+    (is_store ? region->store_bytes : region->load_bytes) += size;
+  if (raptor_fprt_alloc_tracking.load(std::memory_order_relaxed))
+    raptor_fprt_alloc_access(ptr, size, is_store, nullptr);
+}
+
+// Called once per basic block with the floating point bytes the block loads
+// and stores, see handleFlopMemory in the pass.
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_fprt_memory_access_block(int64_t load_bytes,
+                                       int64_t store_bytes) {
+  auto &load_counter =
+      global_is_truncating ? trunc_load_counter : original_load_counter;
+  auto &store_counter =
+      global_is_truncating ? trunc_store_counter : original_store_counter;
+  if (load_bytes)
+    load_counter.fetch_add(load_bytes, std::memory_order_relaxed);
+  if (store_bytes)
+    store_counter.fetch_add(store_bytes, std::memory_order_relaxed);
+  if (auto *region = raptor_fprt_current_region) {
+    region->load_bytes += load_bytes;
+    region->store_bytes += store_bytes;
+  }
 }
 
 __RAPTOR_MPFR_ATTRIBUTES
@@ -0,0 +1,169 @@
+//===- FPEvents.cpp - Overflow, underflow and NaN counters ---------------===//
+//
+//                             Raptor Project
+//
+// Part of the Raptor Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Set RAPTOR_FP_EVENTS_REPORT=<path> to have the MPFR wrappers check the
+// overflow, underflow and NaN flags after every truncated op and count the
+// events per source location. The CSV report is written at exit, or with
+// __raptor_fp_events_report_write.
+//
+// The first event of each kind in the program is printed to stderr when it
+// happens and marked in the report, as it is usually the one that the others
+// follow from.
+//
+// In op mode the exponent range of the target format is in effect, so an
+// overflow is a result that became inf and an underflow one that was flushed
+// to zero. Mem mode keeps the full MPFR exponent range and in practice only
+// reports NaNs.
+//
+//===----------------------------------------------------------------------===//
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mpfr.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "raptor/Common.h"
+#include "raptor/FPEvents.h"
+
+const bool raptor_fprt_fp_events_enabled =
+    getenv("RAPTOR_FP_EVENTS_REPORT") != nullptr;
+
+namespace {
+
+enum FPEventKind { Overflow, Underflow, NaN, NumFPEventKinds };
+
+const char *FPEventNames[NumFPEventKinds] = {"overflow", "underflow", "nan"};
+
+struct FPEventSite {
+  const char *loc;
+  std::atomic<const char *> op{nullptr};
+  std::atomic<long long> counts[NumFPEventKinds] = {};
+};
+
+struct FPEventsGlobalTy {
+  std::mutex lock;
+  std::unordered_map<const char *, std::unique_ptr<FPEventSite>> sites;
+  std::atomic<FPEventSite *> first[NumFPEventKinds] = {};
+
+  FPEventSite *get(const char *loc) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto &site = sites[loc];
+    if (!site) {
+      site = std::make_unique<FPEventSite>();
+      site->loc = loc;
+    }
+    return site.get();
+  }
+
+  void record(FPEventSite *site, const char *op, FPEventKind kind) {
+    const char *noOp = nullptr;
+    site->op.compare_exchange_strong(noOp, op, std::memory_order_relaxed);
+    site->counts[kind].fetch_add(1, std::memory_order_relaxed);
+    if (first[kind].load(std::memory_order_relaxed))
+      return;
+    FPEventSite *none = nullptr;
+    if (first[kind].compare_exchange_strong(none, site))
+      fprintf(stderr, "raptor: first %s at %s (%s)\n", FPEventNames[kind],
+              site->loc, op);
+  }
+
+  void write(const char *path);
+
+  ~FPEventsGlobalTy() {
+    if (const char *path = getenv("RAPTOR_FP_EVENTS_REPORT"))
+      write(path);
+  }
+};
+
+FPEventsGlobalTy FPEventsGlobal;
+
+thread_local std::unordered_map<const char *, FPEventSite *> FPEventsCache;
+
+void FPEventsGlobalTy::write(const char *path) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    fprintf(stderr, "raptor: could not open fp events report '%s'\n", path);
+    return;
+  }
+
+  struct Row {
+    const char *loc;
+    const char *op;
+    long long counts[NumFPEventKinds];
+    std::string first;
+  };
+  std::vector<Row> rows;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto &it : sites) {
+      FPEventSite *site = it.second.get();
+      Row row{site->loc, site->op.load(std::memory_order_relaxed), {}, ""};
+      for (unsigned k = 0; k < NumFPEventKinds; k++) {
+        row.counts[k] = site->counts[k].load(std::memory_order_relaxed);
+        if (first[k].load(std::memory_order_relaxed) == site) {
+          if (!row.first.empty())
+            row.first += "|";
+          row.first += FPEventNames[k];
+        }
+      }
+      rows.push_back(std::move(row));
+    }
+  }
+  std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+    long long ea = 0, eb = 0;
+    for (unsigned k = 0; k < NumFPEventKinds; k++) {
+      ea += a.counts[k];
+      eb += b.counts[k];
+    }
+    return ea > eb;
+  });
+
+  fprintf(out, "site,op,overflow,underflow,nan,first\n");
+  for (const Row &row : rows)
+    fprintf(out, "\"%s\",%s,%lld,%lld,%lld,%s\n", row.loc,
+            row.op ? row.op : "", row.counts[Overflow], row.counts[Underflow],
+            row.counts[NaN], row.first.c_str());
+  fclose(out);
+}
+
+} // namespace
+
+void raptor_fprt_fp_events_check(const char *loc, const char *op) {
+  bool raised[NumFPEventKinds] = {(bool)mpfr_overflow_p(),
+                                  (bool)mpfr_underflow_p(),
+                                  (bool)mpfr_nanflag_p()};
+  if (!raised[Overflow] && !raised[Underflow] && !raised[NaN])
+    return;
+  mpfr_clear_flags();
+
+  FPEventSite *&site = FPEventsCache[loc];
+  if (!site)
+    site = FPEventsGlobal.get(loc);
+  for (unsigned k = 0; k < NumFPEventKinds; k++)
+    if (raised[k])
+      FPEventsGlobal.record(site, op, (FPEventKind)k);
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_fp_events_report_write(const char *path) {
+  FPEventsGlobal.write(path);
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void f_raptor_fp_events_report_write(const char *path) {
+  __raptor_fp_events_report_write(path);
+}
@@ -56,7 +56,7 @@ struct {
 
 } __raptor_mpfr_fps;
 
-#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY)                                     \
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME)                               \
   __RAPTOR_MPFR_ATTRIBUTES                                                     \
   CPP_TY __raptor_fprt_##FROM_TY##_get(CPP_TY _a, int64_t exponent,            \
                                        int64_t significand, int64_t mode,      \
@@ -0,0 +1,287 @@
+//===- PerfCounters.cpp - Hardware performance counters ------------------===//
+//
+//                             Raptor Project
+//
+// Part of the Raptor Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Optional hardware counters (cycles, instructions, LLC misses and, if the raw
+// event code is given, FP operations) read with perf_event_open around every
+// truncated function invocation and every __raptor_region_begin/end pair.
+// They are reported next to the RAPTOR flop counts so the emulation cost and
+// the real machine behaviour can be compared.
+//
+//   RAPTOR_PERF_COUNTERS=1          enable sampling
+//   RAPTOR_PERF_FP_EVENT=<hex>      raw PMU event code counting FP operations
+//                                   (e.g. 0x1fc7 for FP_ARITH_INST_RETIRED on
+//                                   recent Intel cores)
+//   RAPTOR_PERF_REPORT=<path>       write the report there instead of stderr
+//
+// If the counters cannot be opened (no permission, no PMU, not Linux) we warn
+// once and keep running without them.
+//
+//===----------------------------------------------------------------------===//
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "raptor/Common.h"
+#include "raptor/Perf.h"
+
+extern std::atomic<long long> trunc_flop_counter;
+extern std::atomic<long long> double_flop_counter;
+extern std::atomic<long long> float_flop_counter;
+extern std::atomic<long long> half_flop_counter;
+extern std::atomic<long long> bfloat_flop_counter;
+
+const bool raptor_fprt_perf_enabled = getenv("RAPTOR_PERF_COUNTERS") != nullptr;
+
+namespace {
+
+enum PerfEvent { Cycles, Instructions, FPOps, LLCMisses, NumPerfEvents };
+
+const char *PerfEventNames[NumPerfEvents] = {"cycles", "instructions",
+                                             "fp_ops", "llc_misses"};
+
+// Counters after a pop minus counters at the matching push.
+struct PerfSample {
+  long long events[NumPerfEvents] = {};
+  long long trunc_flops = 0;
+  long long flops = 0;
+};
+
+struct PerfStats {
+  std::string kind;
+  long long calls = 0;
+  PerfSample total;
+
+  void add(const PerfSample &s) {
+    calls++;
+    for (unsigned i = 0; i < NumPerfEvents; ++i)
+      total.events[i] += s.events[i];
+    total.trunc_flops += s.trunc_flops;
+    total.flops += s.flops;
+  }
+};
+
+typedef std::map<const char *, PerfStats> PerfStatsMap;
+
+struct PerfGlobalTy {
+  std::mutex lock;
+  PerfStatsMap stats;
+  // Which events could be opened at least once.
+  bool available[NumPerfEvents] = {};
+  std::atomic<bool> warned = false;
+  std::atomic<bool> broken = false;
+
+  void merge(PerfStatsMap &local) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto &it : local) {
+      auto &s = stats[it.first];
+      s.kind = it.second.kind;
+      s.calls += it.second.calls;
+      for (unsigned i = 0; i < NumPerfEvents; ++i)
+        s.total.events[i] += it.second.total.events[i];
+      s.total.trunc_flops += it.second.total.trunc_flops;
+      s.total.flops += it.second.total.flops;
+    }
+    local.clear();
+  }
+
+  void warn(const char *what) {
+    if (!warned.exchange(true))
+      fprintf(stderr,
+              "raptor: hardware performance counters unavailable (%s: %s), "
+              "continuing without them\n",
+              what, strerror(errno));
+  }
+
+  ~PerfGlobalTy();
+};
+
+PerfGlobalTy PerfGlobal;
+
+#ifdef __linux__
+int openEvent(uint32_t type, uint64_t config, int group) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = group == -1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return (int)syscall(SYS_perf_event_open, &attr, /*pid*/ 0, /*cpu*/ -1, group,
+                      /*flags*/ 0);
+}
+#endif
+
+struct PerfThreadTy {
+  int leader = -1;
+  std::vector<int> fds;
+  // Position of each event in the group read, -1 if not opened.
+  int slot[NumPerfEvents] = {-1, -1, -1, -1};
+  unsigned nopen = 0;
+  bool initialized = false;
+
+  struct Open {
+    const char *key;
+    PerfSample start;
+  };
+  std::vector<Open> stack;
+  PerfStatsMap stats;
+
+  void init() {
+    initialized = true;
+#ifdef __linux__
+    if (PerfGlobal.broken)
+      return;
+    leader = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (leader < 0) {
+      PerfGlobal.warn("cycles");
+      if (errno == EACCES || errno == EPERM || errno == ENOENT ||
+          errno == ENOSYS || errno == EOPNOTSUPP)
+        PerfGlobal.broken = true;
+      return;
+    }
+    fds.push_back(leader);
+    slot[Cycles] = nopen++;
+
+    auto add = [&](PerfEvent e, uint32_t type, uint64_t config) {
+      int fd = openEvent(type, config, leader);
+      if (fd < 0)
+        return;
+      fds.push_back(fd);
+      slot[e] = nopen++;
+    };
+    add(Instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    if (const char *fp = getenv("RAPTOR_PERF_FP_EVENT"))
+      add(FPOps, PERF_TYPE_RAW, strtoull(fp, nullptr, 0));
+    add(LLCMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+
+    {
+      std::lock_guard<std::mutex> guard(PerfGlobal.lock);
+      for (unsigned i = 0; i < NumPerfEvents; ++i)
+        PerfGlobal.available[i] |= slot[i] >= 0;
+    }
+
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+  }
+
+  PerfSample read() {
+    PerfSample s;
+    s.trunc_flops = trunc_flop_counter.load(std::memory_order_relaxed);
+    s.flops = double_flop_counter.load(std::memory_order_relaxed) +
+              float_flop_counter.load(std::memory_order_relaxed) +
+              half_flop_counter.load(std::memory_order_relaxed) +
+              bfloat_flop_counter.load(std::memory_order_relaxed);
+#ifdef __linux__
+    if (leader < 0)
+      return s;
+    uint64_t buf[1 + NumPerfEvents];
+    if (::read(leader, buf, sizeof(buf)) < (ssize_t)sizeof(uint64_t))
+      return s;
+    for (unsigned i = 0; i < NumPerfEvents; ++i)
+      if (slot[i] >= 0 && (uint64_t)slot[i] < buf[0])
+        s.events[i] = buf[1 + slot[i]];
+#endif
+    return s;
+  }
+
+  void push(const char *key, const char *kind) {
+    if (!initialized)
+      init();
+    stack.push_back({key, read()});
+    auto &s = stats[key];
+    if (s.kind.empty())
+      s.kind = kind;
+  }
+
+  void pop() {
+    if (stack.empty())
+      return;
+    PerfSample end = read();
+    auto &open = stack.back();
+    PerfSample delta;
+    for (unsigned i = 0; i < NumPerfEvents; ++i)
+      delta.events[i] = end.events[i] - open.start.events[i];
+    delta.trunc_flops = end.trunc_flops - open.start.trunc_flops;
+    delta.flops = end.flops - open.start.flops;
+    stats[open.key].add(delta);
+    stack.pop_back();
+  }
+
+  ~PerfThreadTy() {
+    PerfGlobal.merge(stats);
+#ifdef __linux__
+    for (int fd : fds)
+      close(fd);
+#endif
+  }
+};
+
+thread_local PerfThreadTy PerfThread;
+
+PerfGlobalTy::~PerfGlobalTy() {
+  if (!raptor_fprt_perf_enabled)
+    return;
+  // Thread locals, including the main thread's, have been destroyed and
+  // merged their samples by now.
+  FILE *out = stderr;
+  const char *path = getenv("RAPTOR_PERF_REPORT");
+  if (path && !(out = fopen(path, "w"))) {
+    fprintf(stderr, "raptor: could not open perf report '%s'\n", path);
+    out = stderr;
+  }
+
+  fprintf(out, "kind,name,calls");
+  for (unsigned i = 0; i < NumPerfEvents; ++i)
+    if (available[i])
+      fprintf(out, ",%s", PerfEventNames[i]);
+  fprintf(out, ",ipc,raptor_trunc_flops,raptor_flops\n");
+  for (auto &it : stats) {
+    auto &s = it.second;
+    fprintf(out, "%s,\"%s\",%lld", s.kind.c_str(), it.first, s.calls);
+    for (unsigned i = 0; i < NumPerfEvents; ++i)
+      if (available[i])
+        fprintf(out, ",%lld", s.total.events[i]);
+    fprintf(out, ",");
+    if (available[Instructions] && s.total.events[Cycles])
+      fprintf(out, "%.3f",
+              (double)s.total.events[Instructions] / s.total.events[Cycles]);
+    fprintf(out, ",%lld,%lld\n", s.total.trunc_flops, s.total.flops);
+  }
+
+  if (out != stderr)
+    fclose(out);
+}
+
+} // namespace
+
+void raptor_fprt_perf_push(const char *key, const char *kind) {
+  PerfThread.push(key, kind);
+}
+
+void raptor_fprt_perf_pop() { PerfThread.pop(); }
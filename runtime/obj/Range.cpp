@@ -0,0 +1,269 @@
+//===- Range.cpp - Dynamic range profile per function --------------------===//
+//
+//                             Raptor Project
+//
+// Part of the Raptor Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// With -raptor-range-profile the pass passes every floating-point value a
+// function loads or computes to __raptor_fprt_range_profile. Per function and
+// source format we record the smallest and largest binary exponent of the
+// nonzero finite values and how many significand bits each of them uses, i.e.
+// the bits up to its lowest set one.
+//
+// Set RAPTOR_RANGE_PROFILE=<path> to write the recommended format of every
+// function at exit, or call __raptor_range_profile_write. The file is a
+// truncation config for -raptor-truncate-config:
+//
+//   # _Z1fPd: 1200 values, 0 zero, 0 nonfinite, exp [-14, 9], bits 4/52
+//   _Z1fPd ieee(64)-mpfr(5,8)
+//
+// where the bits are the median and the maximum of the significand bits used.
+// Formats with a native type are named after it, e.g. ieee(16) for
+// mpfr(5,10), so the config truncates to the type instead of emulating it.
+//
+// The exponent width is the smallest whose normal range holds all of the
+// values. The significand is the smallest width that represents the fraction
+// RAPTOR_RANGE_QUANTILE (default 0.99) of them exactly. Results of inexact
+// operations use all bits, so it is a candidate to start a search from rather
+// than a bound. Functions that need all of their source format are listed
+// commented out.
+//
+//===----------------------------------------------------------------------===//
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+
+#include "raptor/Common.h"
+
+namespace {
+
+// Bits below the leading one of a double.
+constexpr unsigned RangeMaxBits = 52;
+
+struct RangeStats {
+  long long values = 0;
+  long long zeros = 0;
+  long long nonfinite = 0;
+  int min_exp = INT_MAX;
+  int max_exp = INT_MIN;
+  long long bits[RangeMaxBits + 1] = {};
+
+  void add(const RangeStats &other) {
+    values += other.values;
+    zeros += other.zeros;
+    nonfinite += other.nonfinite;
+    min_exp = std::min(min_exp, other.min_exp);
+    max_exp = std::max(max_exp, other.max_exp);
+    for (unsigned i = 0; i <= RangeMaxBits; i++)
+      bits[i] += other.bits[i];
+  }
+
+  void record(double v) {
+    values++;
+    if (v == 0) {
+      zeros++;
+      return;
+    }
+    if (!std::isfinite(v)) {
+      nonfinite++;
+      return;
+    }
+    int exp = std::ilogb(v);
+    min_exp = std::min(min_exp, exp);
+    max_exp = std::max(max_exp, exp);
+    uint64_t repr;
+    memcpy(&repr, &v, sizeof(repr));
+    uint64_t fraction = repr & ((1ULL << RangeMaxBits) - 1);
+    bits[fraction ? RangeMaxBits - __builtin_ctzll(fraction) : 0]++;
+  }
+};
+
+// Function name and the exponent and significand width of the source format.
+typedef std::tuple<std::string, int64_t, int64_t> RangeKey;
+
+struct RangeThreadTy;
+
+struct RangeGlobalTy {
+  std::mutex lock;
+  // Stats of threads that already exited.
+  std::map<RangeKey, RangeStats> stats;
+  std::set<RangeThreadTy *> threads;
+
+  std::map<RangeKey, RangeStats> collect();
+  void write(const char *path);
+
+  ~RangeGlobalTy() {
+    if (const char *path = getenv("RAPTOR_RANGE_PROFILE"))
+      write(path);
+  }
+};
+
+RangeGlobalTy RangeGlobal;
+
+struct RangeThreadTy {
+  struct Key {
+    const char *func;
+    int64_t exponent;
+    int64_t significand;
+    bool operator==(const Key &other) const {
+      return func == other.func && exponent == other.exponent &&
+             significand == other.significand;
+    }
+  };
+  struct KeyHash {
+    size_t operator()(const Key &key) const {
+      return std::hash<const char *>()(key.func) ^ key.significand;
+    }
+  };
+
+  // Taken by the thread for every value and by profiles written while it
+  // runs, otherwise uncontended.
+  std::mutex lock;
+  std::unordered_map<Key, RangeStats, KeyHash> stats;
+  // Consecutive values mostly come from the same function.
+  Key last = {nullptr, 0, 0};
+  RangeStats *lastStats = nullptr;
+
+  RangeThreadTy() {
+    std::lock_guard<std::mutex> guard(RangeGlobal.lock);
+    RangeGlobal.threads.insert(this);
+  }
+
+  ~RangeThreadTy() {
+    std::lock_guard<std::mutex> guard(RangeGlobal.lock);
+    mergeInto(RangeGlobal.stats);
+    RangeGlobal.threads.erase(this);
+  }
+
+  void mergeInto(std::map<RangeKey, RangeStats> &res) {
+    for (auto &it : stats)
+      res[{it.first.func, it.first.exponent, it.first.significand}].add(
+          it.second);
+  }
+
+  void record(double v, int64_t exponent, int64_t significand,
+              const char *func) {
+    Key key{func, exponent, significand};
+    std::lock_guard<std::mutex> guard(lock);
+    if (!lastStats || !(key == last)) {
+      last = key;
+      lastStats = &stats[key];
+    }
+    lastStats->record(v);
+  }
+};
+
+thread_local RangeThreadTy RangeThread;
+
+std::map<RangeKey, RangeStats> RangeGlobalTy::collect() {
+  std::lock_guard<std::mutex> guard(lock);
+  auto res = stats;
+  for (auto thread : threads) {
+    std::lock_guard<std::mutex> threadGuard(thread->lock);
+    thread->mergeInto(res);
+  }
+  return res;
+}
+
+std::string formatName(int64_t exponent, int64_t significand) {
+  if (exponent == 11 && significand == 52)
+    return "ieee(64)";
+  if (exponent == 8 && significand == 23)
+    return "ieee(32)";
+  if (exponent == 5 && significand == 10)
+    return "ieee(16)";
+  if (exponent == 8 && significand == 7)
+    return "bfloat";
+  return "mpfr(" + std::to_string(exponent) + "," +
+         std::to_string(significand) + ")";
+}
+
+// Smallest exponent width whose normal range, [2 - 2^(e-1), 2^(e-1) - 1],
+// holds [min_exp, max_exp].
+int64_t exponentWidth(const RangeStats &s, int64_t max) {
+  if (s.min_exp > s.max_exp)
+    return 2;
+  for (int64_t e = 2; e < max; e++) {
+    int64_t bias = (1LL << (e - 1)) - 1;
+    if (s.max_exp <= bias && s.min_exp >= 1 - bias)
+      return e;
+  }
+  return max;
+}
+
+// Smallest number of significand bits that represents the fraction quantile of
+// the nonzero finite values exactly.
+int64_t bitsQuantile(const RangeStats &s, double quantile) {
+  long long exact = s.values - s.zeros - s.nonfinite;
+  long long covered = 0;
+  for (unsigned b = 0; b <= RangeMaxBits; b++) {
+    covered += s.bits[b];
+    if (covered >= quantile * exact)
+      return b;
+  }
+  return RangeMaxBits;
+}
+
+void RangeGlobalTy::write(const char *path) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    fprintf(stderr, "raptor: could not open range profile '%s'\n", path);
+    return;
+  }
+  double quantile = 0.99;
+  if (const char *str = getenv("RAPTOR_RANGE_QUANTILE"))
+    quantile = atof(str);
+
+  fprintf(out, "# raptor range profile, significand quantile %g\n", quantile);
+  for (auto &it : collect()) {
+    auto &[func, exponent, significand] = it.first;
+    const RangeStats &s = it.second;
+    fprintf(out,
+            "# %s: %lld values, %lld zero, %lld nonfinite, exp [%d, %d], "
+            "bits %lld/%lld\n",
+            func.c_str(), s.values, s.zeros, s.nonfinite,
+            s.min_exp > s.max_exp ? 0 : s.min_exp,
+            s.min_exp > s.max_exp ? 0 : s.max_exp,
+            (long long)bitsQuantile(s, 0.5), (long long)bitsQuantile(s, 1));
+    int64_t e = exponentWidth(s, exponent);
+    int64_t m = std::clamp<int64_t>(bitsQuantile(s, quantile), 1, significand);
+    fprintf(out, "%s%s %s-%s\n",
+            e == exponent && m == significand ? "# " : "", func.c_str(),
+            formatName(exponent, significand).c_str(),
+            formatName(e, m).c_str());
+  }
+  fclose(out);
+}
+
+} // namespace
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_fprt_range_profile(double v, int64_t exponent,
+                                 int64_t significand, const char *func) {
+  RangeThread.record(v, exponent, significand, func);
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_range_profile_write(const char *path) {
+  RangeGlobal.write(path);
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void f_raptor_range_profile_write(const char *path) {
+  __raptor_range_profile_write(path);
+}
@@ -0,0 +1,198 @@
+//===- Region.cpp - User defined profiling regions -----------------------===//
+//
+//                             Raptor Project
+//
+// Part of the Raptor Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// __raptor_region_begin/end mark a named region of the user program. Every
+// thread keeps its own stack of open regions and the flop, memory traffic and
+// shadow error counters of the runtime are attributed to the innermost one, so
+// a region does not include the counts of the regions nested in it. Wall time
+// is reported both with and without nested regions.
+//
+// Regions must be properly nested per thread. Regions with the same name are
+// merged, also across threads. Set RAPTOR_REGION_REPORT=<path> to write the
+// CSV report at exit, or call __raptor_region_report_write.
+//
+//===----------------------------------------------------------------------===//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "raptor/Common.h"
+#include "raptor/Perf.h"
+#include "raptor/Region.h"
+
+thread_local __raptor_region_stats *raptor_fprt_current_region = nullptr;
+
+// Region names are copied so callers may pass temporary buffers (e.g. from
+// Fortran) and so that equal names share a single pointer key.
+static const char *internRegionName(const char *name) {
+  static std::mutex lock;
+  static std::unordered_set<std::string> names;
+  std::lock_guard<std::mutex> guard(lock);
+  return names.insert(name).first->c_str();
+}
+
+namespace {
+
+typedef std::chrono::steady_clock RegionClock;
+
+struct RegionThreadTy;
+
+struct RegionGlobalTy {
+  std::mutex lock;
+  // Regions of threads that already exited.
+  std::map<std::string, __raptor_region_stats> stats;
+  std::set<RegionThreadTy *> threads;
+
+  std::map<std::string, __raptor_region_stats> collect();
+  void write(const char *path);
+
+  ~RegionGlobalTy() {
+    if (const char *path = getenv("RAPTOR_REGION_REPORT"))
+      write(path);
+  }
+};
+
+RegionGlobalTy RegionGlobal;
+
+struct RegionThreadTy {
+  struct Frame {
+    __raptor_region_stats *stats;
+    RegionClock::time_point start;
+    double nested_seconds;
+  };
+
+  // Taken by the thread when it adds a region or its time and by reports
+  // written while it runs. The counters the other parts of the runtime add to
+  // the current region are read without it, a report may miss the last few.
+  std::mutex lock;
+  std::unordered_map<std::string, __raptor_region_stats> stats;
+  std::vector<Frame> stack;
+
+  RegionThreadTy() {
+    std::lock_guard<std::mutex> guard(RegionGlobal.lock);
+    RegionGlobal.threads.insert(this);
+  }
+
+  ~RegionThreadTy() {
+    raptor_fprt_current_region = nullptr;
+    std::lock_guard<std::mutex> guard(RegionGlobal.lock);
+    for (auto &it : stats)
+      RegionGlobal.stats[it.first].add(it.second);
+    RegionGlobal.threads.erase(this);
+  }
+
+  void begin(const char *name) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto &region = stats[name];
+    region.calls++;
+    stack.push_back({&region, RegionClock::now(), 0});
+    raptor_fprt_current_region = &region;
+  }
+
+  void end() {
+    if (stack.empty()) {
+      fprintf(stderr, "raptor: __raptor_region_end without matching begin\n");
+      return;
+    }
+    Frame &frame = stack.back();
+    double seconds =
+        std::chrono::duration<double>(RegionClock::now() - frame.start).count();
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      frame.stats->seconds += seconds;
+      frame.stats->self_seconds += seconds - frame.nested_seconds;
+    }
+    stack.pop_back();
+    if (stack.empty()) {
+      raptor_fprt_current_region = nullptr;
+    } else {
+      stack.back().nested_seconds += seconds;
+      raptor_fprt_current_region = stack.back().stats;
+    }
+  }
+};
+
+thread_local RegionThreadTy RegionThread;
+
+std::map<std::string, __raptor_region_stats> RegionGlobalTy::collect() {
+  std::lock_guard<std::mutex> guard(lock);
+  auto res = stats;
+  // Threads that are still alive, e.g. idle OpenMP workers at exit.
+  for (auto thread : threads) {
+    std::lock_guard<std::mutex> threadGuard(thread->lock);
+    for (auto &it : thread->stats)
+      res[it.first].add(it.second);
+  }
+  return res;
+}
+
+void RegionGlobalTy::write(const char *path) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    fprintf(stderr, "raptor: could not open region report '%s'\n", path);
+    return;
+  }
+  fprintf(out, "region,calls,seconds,self_seconds,trunc_flops,double_flops,"
+               "float_flops,half_flops,bfloat_flops,load_bytes,store_bytes,"
+               "shadow_count,shadow_violations,shadow_l1_err\n");
+  for (auto &it : collect()) {
+    auto &s = it.second;
+    fprintf(out,
+            "\"%s\",%lld,%g,%g,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,"
+            "%g\n",
+            it.first.c_str(), s.calls, s.seconds, s.self_seconds,
+            s.trunc_flops, s.double_flops, s.float_flops, s.half_flops,
+            s.bfloat_flops, s.load_bytes, s.store_bytes, s.shadow_count,
+            s.shadow_violations, s.shadow_l1_err);
+  }
+  fclose(out);
+}
+
+} // namespace
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_region_begin(const char *name) {
+  RegionThread.begin(name);
+  if (raptor_fprt_perf_enabled)
+    raptor_fprt_perf_push(internRegionName(name), "region");
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_region_end() {
+  if (raptor_fprt_perf_enabled)
+    raptor_fprt_perf_pop();
+  RegionThread.end();
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_region_report_write(const char *path) {
+  RegionGlobal.write(path);
+}
+
+// Fortran bindings, the name has to be passed null terminated, e.g.
+//   call f_raptor_region_begin("solver"//c_null_char)
+__RAPTOR_MPFR_ATTRIBUTES
+void f_raptor_region_begin(const char *name) { __raptor_region_begin(name); }
+
+__RAPTOR_MPFR_ATTRIBUTES
+void f_raptor_region_end() { __raptor_region_end(); }
+
+__RAPTOR_MPFR_ATTRIBUTES
+void f_raptor_region_report_write(const char *path) {
+  __raptor_region_report_write(path);
+}
@@ -0,0 +1,534 @@
+//===- Report.cpp - Arithmetic intensity (roofline) report ---------------===//
+//
+//                             Raptor Project
+//
+// Part of the Raptor Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Runtime side of -raptor-flop-report. The pass creates one record per function
+// and per outermost loop and, at the end of every basic block, adds the
+// statically known floating point operation and byte counts of that block to
+// the record. At exit we print flops, bytes and arithmetic intensity per
+// record, together with the bytes the same data would take at lower precision.
+//
+// Set RAPTOR_FLOP_REPORT=<path> to write the report at exit. Paths ending in
+// .csv produce CSV, everything else JSON.
+//
+// The same counters drive a "what if" runtime estimate. Given a machine
+// description and the formats the truncated code would run in on real
+// hardware, every record is timed with a roofline model before and after the
+// truncation:
+//
+//   RAPTOR_MACHINE=<path>           machine description, see below
+//   RAPTOR_ESTIMATE_TRUNCATE=<map>  e.g. "fp64:fp16,fp32:fp16"
+//   RAPTOR_ESTIMATE_SCOPE=all       apply the map to all code, not only to the
+//                                   code executed under truncation
+//   RAPTOR_ESTIMATE_REPORT=<path>   CSV output, stderr if not set
+//
+// The machine description has one "key = value" per line, '#' starts a
+// comment:
+//
+//   peak_fp64 = 9.7e12      # flop/s per format
+//   peak_fp32 = 19.5e12
+//   peak_fp16 = 78e12
+//   bandwidth = 1.5e12      # bytes/s
+//   cost_div = 8            # optional, flops per op of a class, defaults to
+//   cost_math = 20          # the FLOPS_PER_OP in ReportCounters.def
+//
+//===----------------------------------------------------------------------===//
+
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "raptor/Common.h"
+#include "raptor/Report.h"
+#include "raptor/raptor.h"
+
+// Layout must match createReportRecord in pass/RaptorLogic.cpp.
+struct __raptor_report_rec {
+  std::atomic<int64_t> registered;
+  const char *name;
+  __raptor_report_rec *parent;
+  // Indexed by whether we were truncating when the block executed.
+  std::atomic<int64_t> counters[2][RaptorReportNumCounters];
+};
+
+static const char *ReportFormatNames[] = {
+#define RAPTOR_REPORT_FORMAT(NAME, WIDTH) #NAME,
+#include "raptor/ReportCounters.def"
+};
+
+static const unsigned ReportFormatWidths[] = {
+#define RAPTOR_REPORT_FORMAT(NAME, WIDTH) WIDTH,
+#include "raptor/ReportCounters.def"
+};
+
+static const char *ReportOpClassNames[] = {
+#define RAPTOR_REPORT_OP_CLASS(NAME, FLOPS_PER_OP) #NAME,
+#include "raptor/ReportCounters.def"
+};
+
+static const int64_t ReportOpClassFlops[] = {
+#define RAPTOR_REPORT_OP_CLASS(NAME, FLOPS_PER_OP) FLOPS_PER_OP,
+#include "raptor/ReportCounters.def"
+};
+
+// The lower precisions we report the data volume for.
+static const unsigned ReportNarrowWidths[] = {32, 16};
+
+namespace {
+
+struct ReportRow {
+  const __raptor_report_rec *rec;
+  int64_t counters[2][RaptorReportNumCounters] = {};
+
+  int64_t flops(unsigned truncated, unsigned format) const {
+    int64_t total = 0;
+    for (unsigned c = 0; c < RaptorReportNumOpClasses; ++c)
+      total += counters[truncated][raptorReportOpCounter(format, c)] *
+               ReportOpClassFlops[c];
+    return total;
+  }
+
+  int64_t bytes(unsigned truncated, unsigned format) const {
+    return counters[truncated][raptorReportLoadCounter(format)] +
+           counters[truncated][raptorReportStoreCounter(format)];
+  }
+
+  int64_t totalFlops() const {
+    int64_t total = 0;
+    for (unsigned t = 0; t < 2; ++t)
+      for (unsigned f = 0; f < RaptorReportNumFormats; ++f)
+        total += flops(t, f);
+    return total;
+  }
+
+  // Bytes moved if every format wider than width was stored in width bits.
+  double bytesAt(unsigned width) const {
+    double total = 0;
+    for (unsigned t = 0; t < 2; ++t)
+      for (unsigned f = 0; f < RaptorReportNumFormats; ++f)
+        total += (double)bytes(t, f) *
+                 std::min(width, ReportFormatWidths[f]) / ReportFormatWidths[f];
+    return total;
+  }
+};
+
+// Symbol names may contain any byte, but JSON strings no control characters.
+std::string escape(const char *str) {
+  std::string res;
+  for (const char *c = str; *c; ++c) {
+    if ((unsigned char)*c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char)*c);
+      res += buf;
+      continue;
+    }
+    if (*c == '"' || *c == '\\')
+      res += '\\';
+    res += *c;
+  }
+  return res;
+}
+
+// Prints intensity or null if no bytes were moved.
+void printIntensity(FILE *out, double flops, double bytes) {
+  if (bytes > 0)
+    fprintf(out, "%g", flops / bytes);
+  else
+    fprintf(out, "%s", "null");
+}
+
+class ReportTy {
+private:
+  std::mutex lock;
+  std::vector<__raptor_report_rec *> records;
+
+  std::vector<ReportRow> collect() {
+    std::lock_guard<std::mutex> guard(lock);
+    std::vector<ReportRow> rows(records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+      rows[i].rec = records[i];
+      for (unsigned t = 0; t < 2; ++t)
+        for (unsigned c = 0; c < RaptorReportNumCounters; ++c)
+          rows[i].counters[t][c] =
+              records[i]->counters[t][c].load(std::memory_order_relaxed);
+    }
+    // Functions include the loops they contain.
+    for (auto &row : rows) {
+      if (!row.rec->parent)
+        continue;
+      for (auto &func : rows) {
+        if (func.rec != row.rec->parent)
+          continue;
+        for (unsigned t = 0; t < 2; ++t)
+          for (unsigned c = 0; c < RaptorReportNumCounters; ++c)
+            func.counters[t][c] += row.counters[t][c];
+      }
+    }
+    return rows;
+  }
+
+  void writeJSON(FILE *out, const std::vector<ReportRow> &rows) {
+    fprintf(out, "{\n  \"records\": [");
+    for (size_t i = 0; i < rows.size(); ++i) {
+      auto &row = rows[i];
+      fprintf(out, "%s\n    {\n", i ? "," : "");
+      fprintf(out, "      \"name\": \"%s\",\n", escape(row.rec->name).c_str());
+      fprintf(out, "      \"kind\": \"%s\",\n",
+              row.rec->parent ? "loop" : "function");
+      fprintf(out, "      \"function\": \"%s\",\n",
+              escape(row.rec->parent ? row.rec->parent->name : row.rec->name)
+                  .c_str());
+      for (unsigned t = 0; t < 2; ++t) {
+        fprintf(out, "      \"%s\": {", t ? "truncated" : "original");
+        for (unsigned f = 0; f < RaptorReportNumFormats; ++f) {
+          fprintf(out, "%s\n        \"%s\": { \"flops\": %lld", f ? "," : "",
+                  ReportFormatNames[f], (long long)row.flops(t, f));
+          for (unsigned c = 0; c < RaptorReportNumOpClasses; ++c)
+            fprintf(out, ", \"%s\": %lld", ReportOpClassNames[c],
+                    (long long)row.counters[t][raptorReportOpCounter(f, c)]);
+          fprintf(out, ", \"load_bytes\": %lld, \"store_bytes\": %lld }",
+                  (long long)row.counters[t][raptorReportLoadCounter(f)],
+                  (long long)row.counters[t][raptorReportStoreCounter(f)]);
+        }
+        fprintf(out, "\n      },\n");
+      }
+      double flops = row.totalFlops();
+      double bytes = row.bytesAt(64);
+      fprintf(out, "      \"flops\": %.0f,\n", flops);
+      fprintf(out, "      \"bytes\": %.0f,\n", bytes);
+      fprintf(out, "      \"intensity\": ");
+      printIntensity(out, flops, bytes);
+      for (unsigned width : ReportNarrowWidths) {
+        fprintf(out, ",\n      \"bytes_at_fp%u\": %.0f", width,
+                row.bytesAt(width));
+        fprintf(out, ",\n      \"intensity_at_fp%u\": ", width);
+        printIntensity(out, flops, row.bytesAt(width));
+      }
+      fprintf(out, "\n    }");
+    }
+    fprintf(out, "\n  ]\n}\n");
+  }
+
+  void writeCSV(FILE *out, const std::vector<ReportRow> &rows) {
+    fprintf(out, "name,kind,function");
+    for (unsigned t = 0; t < 2; ++t)
+      for (unsigned f = 0; f < RaptorReportNumFormats; ++f)
+        fprintf(out, ",%sflops_%s,%sbytes_%s", t ? "trunc_" : "",
+                ReportFormatNames[f], t ? "trunc_" : "", ReportFormatNames[f]);
+    fprintf(out, ",flops,bytes,intensity");
+    for (unsigned width : ReportNarrowWidths)
+      fprintf(out, ",bytes_at_fp%u,intensity_at_fp%u", width, width);
+    fprintf(out, "\n");
+
+    for (auto &row : rows) {
+      fprintf(out, "\"%s\",%s,\"%s\"", escape(row.rec->name).c_str(),
+              row.rec->parent ? "loop" : "function",
+              escape(row.rec->parent ? row.rec->parent->name : row.rec->name)
+                  .c_str());
+      for (unsigned t = 0; t < 2; ++t)
+        for (unsigned f = 0; f < RaptorReportNumFormats; ++f)
+          fprintf(out, ",%lld,%lld", (long long)row.flops(t, f),
+                  (long long)row.bytes(t, f));
+      double flops = row.totalFlops();
+      double bytes = row.bytesAt(64);
+      fprintf(out, ",%.0f,%.0f,", flops, bytes);
+      if (bytes > 0)
+        fprintf(out, "%g", flops / bytes);
+      for (unsigned width : ReportNarrowWidths) {
+        double narrow = row.bytesAt(width);
+        fprintf(out, ",%.0f,", narrow);
+        if (narrow > 0)
+          fprintf(out, "%g", flops / narrow);
+      }
+      fprintf(out, "\n");
+    }
+  }
+
+public:
+  ~ReportTy() {
+    if (const char *path = getenv("RAPTOR_FLOP_REPORT"))
+      write(path);
+    if (const char *machine = getenv("RAPTOR_MACHINE")) {
+      const char *scope = getenv("RAPTOR_ESTIMATE_SCOPE");
+      estimate(machine, getenv("RAPTOR_ESTIMATE_TRUNCATE"),
+               scope && strcmp(scope, "all") == 0,
+               getenv("RAPTOR_ESTIMATE_REPORT"));
+    }
+  }
+
+  void add(__raptor_report_rec *rec) {
+    std::lock_guard<std::mutex> guard(lock);
+    // Register the function before its loops so it is listed first.
+    for (auto r : {rec->parent, rec}) {
+      if (!r || r->registered.load(std::memory_order_relaxed))
+        continue;
+      records.push_back(r);
+      r->registered.store(1, std::memory_order_release);
+    }
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto rec : records)
+      for (unsigned t = 0; t < 2; ++t)
+        for (unsigned c = 0; c < RaptorReportNumCounters; ++c)
+          rec->counters[t][c].store(0, std::memory_order_relaxed);
+  }
+
+  void estimate(const char *machine, const char *truncation, bool all,
+                const char *path);
+
+  void write(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+      fprintf(stderr, "raptor: could not open flop report '%s'\n", path);
+      return;
+    }
+    auto rows = collect();
+    size_t len = strlen(path);
+    if (len >= 4 && strcmp(path + len - 4, ".csv") == 0)
+      writeCSV(out, rows);
+    else
+      writeJSON(out, rows);
+    fclose(out);
+  }
+};
+
+ReportTy Report;
+
+struct MachineTy {
+  double peak[RaptorReportNumFormats] = {};
+  double bandwidth = 0;
+  double cost[RaptorReportNumOpClasses];
+
+  MachineTy() {
+    for (unsigned c = 0; c < RaptorReportNumOpClasses; ++c)
+      cost[c] = ReportOpClassFlops[c];
+  }
+
+  bool parse(const char *path) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+      fprintf(stderr, "raptor: could not open machine description '%s'\n",
+              path);
+      return false;
+    }
+    char line[256];
+    unsigned lineno = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), in)) {
+      ++lineno;
+      if (char *comment = strchr(line, '#'))
+        *comment = '\0';
+      char key[64];
+      double value;
+      char eq;
+      int n = sscanf(line, " %63[a-z0-9_] %c %lf", key, &eq, &value);
+      if (n <= 0)
+        continue;
+      if (n != 3 || eq != '=' || !set(key, value)) {
+        fprintf(stderr, "raptor: %s:%u: cannot parse machine description\n",
+                path, lineno);
+        ok = false;
+      }
+    }
+    fclose(in);
+    if (bandwidth <= 0) {
+      fprintf(stderr, "raptor: %s: missing bandwidth\n", path);
+      ok = false;
+    }
+    return ok;
+  }
+
+  bool set(const char *key, double value) {
+    if (value <= 0)
+      return false;
+    if (strcmp(key, "bandwidth") == 0) {
+      bandwidth = value;
+      return true;
+    }
+    for (unsigned f = 0; f < RaptorReportNumFormats; ++f) {
+      if (strncmp(key, "peak_", 5) == 0 &&
+          strcmp(key + 5, ReportFormatNames[f]) == 0) {
+        peak[f] = value;
+        return true;
+      }
+    }
+    for (unsigned c = 0; c < RaptorReportNumOpClasses; ++c) {
+      if (strncmp(key, "cost_", 5) == 0 &&
+          strcmp(key + 5, ReportOpClassNames[c]) == 0) {
+        cost[c] = value;
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+int parseReportFormat(const char *name, size_t len) {
+  for (unsigned f = 0; f < RaptorReportNumFormats; ++f)
+    if (strlen(ReportFormatNames[f]) == len &&
+        strncmp(name, ReportFormatNames[f], len) == 0)
+      return f;
+  return -1;
+}
+
+// Parses "fp64:fp16,fp32:fp16" into a format to format map. Formats which are
+// not mentioned stay as they are.
+bool parseTruncation(const char *str, unsigned (&target)[RaptorReportNumFormats]) {
+  for (unsigned f = 0; f < RaptorReportNumFormats; ++f)
+    target[f] = f;
+  if (!str)
+    return true;
+  const char *c = str;
+  while (*c) {
+    const char *colon = strchr(c, ':');
+    if (!colon)
+      return false;
+    const char *end = colon + 1 + strcspn(colon + 1, ",");
+    int from = parseReportFormat(c, colon - c);
+    int to = parseReportFormat(colon + 1, end - colon - 1);
+    if (from < 0 || to < 0)
+      return false;
+    target[from] = to;
+    c = *end ? end + 1 : end;
+  }
+  return true;
+}
+
+struct Estimate {
+  double compute = 0;
+  double memory = 0;
+
+  double time() const { return std::max(compute, memory); }
+  const char *bound() const { return compute >= memory ? "compute" : "memory"; }
+};
+
+// Roofline time of a record if the counters of format f ran in target[f].
+// Which of the original/truncated counters are remapped is selected by remap.
+Estimate estimateRow(const ReportRow &row, const MachineTy &machine,
+                     const unsigned (&target)[RaptorReportNumFormats],
+                     const bool (&remap)[2]) {
+  Estimate res;
+  for (unsigned t = 0; t < 2; ++t) {
+    for (unsigned f = 0; f < RaptorReportNumFormats; ++f) {
+      unsigned to = remap[t] ? target[f] : f;
+      double flops = 0;
+      for (unsigned c = 0; c < RaptorReportNumOpClasses; ++c)
+        flops += row.counters[t][raptorReportOpCounter(f, c)] * machine.cost[c];
+      if (flops > 0)
+        res.compute += flops / machine.peak[to];
+      res.memory += (double)row.bytes(t, f) * ReportFormatWidths[to] /
+                    ReportFormatWidths[f] / machine.bandwidth;
+    }
+  }
+  return res;
+}
+
+void ReportTy::estimate(const char *machinePath, const char *truncation,
+                        bool all, const char *path) {
+  MachineTy machine;
+  if (!machine.parse(machinePath))
+    return;
+  unsigned target[RaptorReportNumFormats];
+  if (!parseTruncation(truncation, target)) {
+    fprintf(stderr, "raptor: cannot parse truncation '%s'\n", truncation);
+    return;
+  }
+
+  auto rows = collect();
+
+  // Every format we need a time for must have a peak.
+  const bool identity[2] = {false, false};
+  const bool remap[2] = {all, true};
+  for (auto &row : rows) {
+    for (unsigned t = 0; t < 2; ++t) {
+      for (unsigned f = 0; f < RaptorReportNumFormats; ++f) {
+        if (row.flops(t, f) == 0)
+          continue;
+        for (unsigned to : {f, remap[t] ? target[f] : f}) {
+          if (machine.peak[to] > 0)
+            continue;
+          fprintf(stderr, "raptor: %s: missing peak_%s\n", machinePath,
+                  ReportFormatNames[to]);
+          return;
+        }
+      }
+    }
+  }
+
+  FILE *out = stderr;
+  if (path && !(out = fopen(path, "w"))) {
+    fprintf(stderr, "raptor: could not open estimate report '%s'\n", path);
+    out = stderr;
+  }
+
+  fprintf(out, "name,kind,function,seconds_before,bound_before,seconds_after,"
+               "bound_after,speedup\n");
+  auto printSpeedup = [&](double before, double after) {
+    if (after > 0)
+      fprintf(out, "%.3f", before / after);
+    fprintf(out, "\n");
+  };
+
+  double totalBefore = 0, totalAfter = 0;
+  for (auto &row : rows) {
+    Estimate before = estimateRow(row, machine, target, identity);
+    Estimate after = estimateRow(row, machine, target, remap);
+    fprintf(out, "\"%s\",%s,\"%s\",%g,%s,%g,%s,",
+            escape(row.rec->name).c_str(), row.rec->parent ? "loop" : "function",
+            escape(row.rec->parent ? row.rec->parent->name : row.rec->name)
+                .c_str(),
+            before.time(), before.bound(), after.time(), after.bound());
+    printSpeedup(before.time(), after.time());
+    // Functions already include their loops.
+    if (row.rec->parent)
+      continue;
+    totalBefore += before.time();
+    totalAfter += after.time();
+  }
+  // Functions are assumed to run one after the other.
+  fprintf(out, "\"total\",total,,%g,,%g,,", totalBefore, totalAfter);
+  printSpeedup(totalBefore, totalAfter);
+
+  if (out != stderr)
+    fclose(out);
+}
+
+} // namespace
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_fprt_report_block(__raptor_report_rec *rec,
+                                const int64_t *counts) {
+  if (!rec->registered.load(std::memory_order_acquire))
+    Report.add(rec);
+  auto &counters = rec->counters[global_is_truncating ? 1 : 0];
+  for (unsigned i = 0; i < RaptorReportNumCounters; ++i)
+    if (counts[i])
+      counters[i].fetch_add(counts[i], std::memory_order_relaxed);
+}
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_flop_report_write(const char *path) { Report.write(path); }
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_flop_report_clear() { Report.clear(); }
+
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_flop_report_estimate(const char *machine, const char *truncation,
+                                   const char *path) {
+  Report.estimate(machine, truncation, /*all*/ false, path);
+}
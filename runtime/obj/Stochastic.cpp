@@ -0,0 +1,177 @@
+//===- Stochastic.cpp - Stochastic rounding of truncated ops -------------===//
+//
+//                             Raptor Project
+//
+// Part of the Raptor Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Truncating to type 2, e.g. __raptor_truncate_op_func(f, 64, 2, 8, 7), or to
+// mpfrsr(E,S) in a truncation config rounds the result of every op
+// stochastically: the op is computed to RAPTOR_SR_PRECISION bits and rounded
+// away from zero with probability equal to its distance to the value rounded
+// towards zero, in units of the last place of the target format.
+//
+// The random numbers come from a Philox4x32-10 generator per thread, keyed by
+// RAPTOR_SR_SEED (default 0) and counting up from 0 in a stream of its own, so
+// runs with the same seed and the same assignment of work to streams round
+// the same way. Threads of an OpenMP team use their omp_get_thread_num() as
+// the stream if no other thread has it, all other threads the smallest free
+// stream, so the first thread to round (usually the main thread) gets 0.
+// Threads that are not numbered by OpenMP can pick their stream with
+// __raptor_sr_set_stream before their first stochastic op.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <mpfr.h>
+#include <mutex>
+#include <unordered_set>
+
+#include "raptor/Common.h"
+#include "raptor/Stochastic.h"
+
+// Enough for the exact product of two doubles and to round 64 and 128 bit
+// formats with a negligible bias.
+#define RAPTOR_SR_PRECISION 256
+
+// Only used to number the threads of OpenMP programs.
+extern "C" int omp_get_thread_num() __attribute__((weak));
+
+namespace {
+
+const uint64_t SRSeed = [] {
+  const char *str = getenv("RAPTOR_SR_SEED");
+  return str ? strtoull(str, nullptr, 0) : 0;
+}();
+
+// Streams are never given back: a thread that took over the stream of one
+// that exited would repeat its random numbers.
+std::mutex SRLock;
+std::unordered_set<uint32_t> SRStreams;
+
+// Set by __raptor_sr_set_stream before the thread's first stochastic op.
+thread_local int64_t SRRequestedStream = -1;
+thread_local bool SRThreadStarted = false;
+
+uint32_t srClaimStream() {
+  std::lock_guard<std::mutex> guard(SRLock);
+  if (SRRequestedStream >= 0) {
+    SRStreams.insert(SRRequestedStream);
+    return SRRequestedStream;
+  }
+  uint32_t stream = 0;
+  int ompStream = omp_get_thread_num ? omp_get_thread_num() : -1;
+  if (ompStream >= 0 && !SRStreams.count(ompStream))
+    stream = ompStream;
+  else
+    while (SRStreams.count(stream))
+      ++stream;
+  SRStreams.insert(stream);
+  return stream;
+}
+
+// Counter based generator from Salmon et al., "Parallel random numbers: as
+// easy as 1, 2, 3", SC '11.
+struct Philox4x32 {
+  uint32_t key[2];
+  uint32_t thread;
+  uint64_t counter = 0;
+  uint32_t out[4];
+  unsigned avail = 0;
+
+  Philox4x32(uint64_t seed, uint32_t thread)
+      : key{(uint32_t)seed, (uint32_t)(seed >> 32)}, thread(thread) {}
+
+  void block() {
+    uint32_t c[4] = {(uint32_t)counter, (uint32_t)(counter >> 32), thread, 0};
+    uint32_t k[2] = {key[0], key[1]};
+    for (unsigned round = 0; round < 10; round++) {
+      uint64_t p0 = (uint64_t)0xD2511F53 * c[0];
+      uint64_t p1 = (uint64_t)0xCD9E8D57 * c[2];
+      uint32_t n[4] = {(uint32_t)(p1 >> 32) ^ c[1] ^ k[0], (uint32_t)p1,
+                       (uint32_t)(p0 >> 32) ^ c[3] ^ k[1], (uint32_t)p0};
+      c[0] = n[0];
+      c[1] = n[1];
+      c[2] = n[2];
+      c[3] = n[3];
+      k[0] += 0x9E3779B9;
+      k[1] += 0xBB67AE85;
+    }
+    for (unsigned i = 0; i < 4; i++)
+      out[i] = c[i];
+    counter++;
+    avail = 4;
+  }
+
+  // Uniform in [0, 1) with 53 random bits.
+  double uniform() {
+    if (avail < 2)
+      block();
+    uint64_t hi = out[--avail];
+    uint64_t lo = out[--avail];
+    return (double)((hi << 32 | lo) >> 11) * 0x1p-53;
+  }
+};
+
+struct SRThreadTy {
+  Philox4x32 rng;
+  mpfr_t extended;
+
+  SRThreadTy() : rng(SRSeed, srClaimStream()) {
+    mpfr_init2(extended, RAPTOR_SR_PRECISION);
+    SRThreadStarted = true;
+  }
+  ~SRThreadTy() { mpfr_clear(extended); }
+};
+
+thread_local SRThreadTy SRThread;
+
+} // namespace
+
+mpfr_ptr raptor_fprt_sr_extended() { return SRThread.extended; }
+
+// Restarts the thread's random numbers at the start of the given stream.
+__RAPTOR_MPFR_ATTRIBUTES
+void __raptor_sr_set_stream(int64_t stream) {
+  SRRequestedStream = stream;
+  if (!SRThreadStarted)
+    return;
+  {
+    std::lock_guard<std::mutex> guard(SRLock);
+    SRStreams.insert(stream);
+  }
+  SRThread.rng = Philox4x32(SRSeed, stream);
+}
+
+void raptor_fprt_sr_round(mpfr_ptr r, mpfr_ptr x) {
+  if (mpfr_set(r, x, MPFR_RNDZ) == 0)
+    return;
+  // Underflowed to zero, there is no last place to scale the distance by.
+  if (!mpfr_regular_p(r)) {
+    mpfr_set(r, x, MPFR_RNDN);
+    return;
+  }
+  // The distance is below the last place of r, which can be below the
+  // exponent range of the target format that op mode sets.
+  mpfr_exp_t emin = mpfr_get_emin();
+  mpfr_exp_t emax = mpfr_get_emax();
+  mpfr_set_emin(mpfr_get_emin_min());
+  mpfr_set_emax(mpfr_get_emax_max());
+  // Exact, r holds the leading bits of x.
+  mpfr_sub(x, x, r, MPFR_RNDN);
+  mpfr_mul_2si(x, x, mpfr_get_prec(r) - mpfr_get_exp(r), MPFR_RNDN);
+  double distance = std::fabs(mpfr_get_d(x, MPFR_RNDN));
+  mpfr_set_emin(emin);
+  mpfr_set_emax(emax);
+  if (SRThread.rng.uniform() < distance) {
+    if (mpfr_sgn(r) > 0)
+      mpfr_nextabove(r);
+    else
+      mpfr_nextbelow(r);
+  }
+}
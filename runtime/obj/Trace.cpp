@@ -20,6 +20,36 @@
 //
 // This file contains infrastructure for flop tracing
 //
+// It is built as the Raptor-RT-Trace library, which replaces Raptor-RT for
+// programs truncated in mem mode. Every flop appends a node with its result and
+// the local derivatives wrt its inputs to a tape, and the truncated program
+// carries the 32-bit ID of the node around instead of the value. The
+// derivatives come from the closed forms of ir/Derivatives.def, or from central
+// differences for the few ops without one. Zeroed memory decodes to ID 0, a
+// constant zero. The tape is not thread safe.
+//
+// __raptor_fprt_delete_all estimates how much truncating each op to float
+// would perturb the outputs, the values that were read back with get, with a
+// reverse sweep over the tape. It prints the sites with the largest
+// sensitivity to stderr and clears the tape.
+//
+//   RAPTOR_TRACE_TOP=<n>         report the n most sensitive sites, 0 for all,
+//                                default 10
+//   RAPTOR_TRACE_PER_OUTPUT=1    sweep every output on its own and rank the
+//                                sites by the output they affect most instead
+//                                of by their effect on all outputs together
+//   RAPTOR_TRACE_THREADS=<n>     threads for the per-output sweeps, default 1
+//
+// Long runs can spill the tape to disk instead, in the format of
+// TraceFormat.h, so memory is bounded by the window rather than by the length
+// of the run. __raptor_fprt_delete_all, or the exit of the program, then
+// completes the file and tools/raptor-trace-sweep does the sweep.
+//
+//   RAPTOR_TRACE_SPILL=<path>    spill the tape to <path>
+//   RAPTOR_TRACE_WINDOW=<nodes>  nodes kept in memory, rounded up to chunks of
+//                                2^20 nodes, default 16 chunks
+//   RAPTOR_TRACE_SPILL_FLOAT=1   store the derivatives as float
+//
 // It is implemented as a .cpp file and not as a header becaues we want to use
 // C++ features and still be able to use it in C code.
 //
@@ -27,363 +57,940 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <stdint.h>
-#include <stdlib.h>
+#include <string>
+#include <sys/mman.h>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <unistd.h>
+#include <utility>
+#include <vector>
 
 #include "raptor/Common.h"
+#include "raptor/TraceFormat.h"
 #include "raptor/raptor.h"
 
 #ifndef RAPTOR_FPRT_TRACE_PRINT
-#define RAPTOR_FPRT_TRACE_PRINT 1
+#define RAPTOR_FPRT_TRACE_PRINT 0
 #endif
 
 static constexpr unsigned fp_max_inputs = 3;
 static constexpr std::array<const char *, 3> arg_names = {"x", "y", "z"};
 static_assert(arg_names.size() == fp_max_inputs);
 
-extern "C" {
-typedef struct __raptor_fp {
-private:
+namespace {
+
+enum TraceNodeFlags : uint8_t {
+  TraceInput = __raptor_trace_input,
+  TraceConst = __raptor_trace_const,
+  TraceOutput = __raptor_trace_output,
+};
+
+struct TraceNode {
   double result;
-  unsigned char input_num;
-  const char *loc;
-  __raptor_fp *inputs[fp_max_inputs];
   double derivatives[fp_max_inputs];
-#if RAPTOR_FPRT_TRACE_PRINT
+  const char *loc;
   const char *name;
-#endif
+  uint32_t inputs[fp_max_inputs];
+  uint8_t input_num;
+  uint8_t flags;
+};
+
+constexpr unsigned TraceChunkBits = 20;
+constexpr uint32_t TraceChunkSize = 1u << TraceChunkBits;
+constexpr uint32_t TraceMaxNodes = std::numeric_limits<uint32_t>::max();
 
+[[noreturn]] void trace_fail(const char *what, const std::string &path) {
+  fprintf(stderr, "raptor: could not %s %s: %s\n", what, path.c_str(),
+          strerror(errno));
+  abort();
+}
+
+TraceNode *trace_alloc_chunk() {
+  auto *chunk = (TraceNode *)malloc(sizeof(TraceNode) * TraceChunkSize);
+  if (!chunk) {
+    fprintf(stderr, "raptor: could not allocate a chunk of the trace tape\n");
+    abort();
+  }
+  return chunk;
+}
+
+// Writes the chunks that leave the window of the tape to the spill file, in
+// the format of TraceFormat.h, on a background thread. The program may still
+// use the values of spilled nodes, so their results also go to an unlinked,
+// memory mapped file that the kernel pages in and out as needed.
+class TraceSpill {
 public:
-  size_t id;
+  // Chunks queued for writing beyond the one being written.
+  static constexpr size_t MaxQueued = 2;
+
+  TraceSpill(const char *path, bool floats) : path(path), floats(floats) {
+    std::string values_path = this->path + ".values";
+    values_fd = open(values_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (values_fd < 0)
+      trace_fail("open", values_path);
+    unlink(values_path.c_str());
+    values = (double *)mmap(nullptr, sizeof(double) * (size_t)TraceMaxNodes,
+                            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE,
+                            values_fd, 0);
+    if (values == MAP_FAILED)
+      trace_fail("map", values_path);
+    writer = std::thread([this] { run(); });
+  }
+
+  ~TraceSpill() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    cv.notify_all();
+    writer.join();
+    for (TraceNode *chunk : free_chunks)
+      free(chunk);
+    munmap(values, sizeof(double) * (size_t)TraceMaxNodes);
+    close(values_fd);
+  }
 
-  double getDerivative(unsigned no) const { return derivatives[no]; }
-  void setDerivative(unsigned no, double d) { derivatives[no] = d; }
+  double value(uint32_t id) const { return values[id]; }
 
-  __raptor_fp *getInput(unsigned no) const { return inputs[no]; }
-  void setInput(unsigned no, __raptor_fp *i) { inputs[no] = i; }
+  TraceNode *chunk() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!free_chunks.empty()) {
+        TraceNode *chunk = free_chunks.back();
+        free_chunks.pop_back();
+        return chunk;
+      }
+    }
+    return trace_alloc_chunk();
+  }
 
-  unsigned char getInputNum() const { return input_num; }
-  void setInputNum(unsigned char i) { input_num = i; }
+  // Queue the first num nodes of chunk, the writer takes ownership of it.
+  void write(TraceNode *chunk, uint32_t first_id, uint32_t num) {
+    size_t bytes = sizeof(double) * ((size_t)first_id + num);
+    if (bytes > values_size) {
+      values_size = sizeof(double) * ((size_t)first_id + TraceChunkSize);
+      if (ftruncate(values_fd, values_size))
+        trace_fail("grow", path + ".values");
+    }
+    for (uint32_t i = 0; i < num; i++)
+      values[first_id + i] = chunk[i].result;
 
-  double getResult() const { return result; }
-  void setResult(double r) { result = r; }
+    std::unique_lock<std::mutex> lock(mutex);
+    // Wait for the writer rather than let memory grow with the run.
+    cv.wait(lock, [&] { return queue.size() < MaxQueued; });
+    queue.push_back({chunk, first_id, num});
+    cv.notify_all();
+  }
 
-  const char *getLoc() const { return loc; }
-  void setLoc(const char *l) { loc = l; }
+  // Every output is recorded once, however often it is read back, also after
+  // its node left the window and its flags with it.
+  void output(uint32_t id) {
+    if (id >= is_output.size())
+      is_output.resize(std::max<size_t>(id + 1, 2 * is_output.size()));
+    if (is_output[id])
+      return;
+    is_output[id] = true;
+    outputs.push_back(id);
+  }
 
-#if RAPTOR_FPRT_TRACE_PRINT
-  const char *getName() const { return name; }
-  void setName(const char *l) { name = l; }
-#endif
+  // Wait for the writer and complete the file with its index.
+  void finish(uint32_t num_nodes) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&] { return queue.empty() && !busy; });
+    }
+    open_file();
+
+    std::sort(outputs.begin(), outputs.end());
+    __raptor_trace_trailer trailer;
+    trailer.index_offset = offset;
+    trailer.num_nodes = num_nodes;
+    trailer.num_segments = segment_offsets.size();
+    trailer.num_outputs = outputs.size();
+    trailer.num_sites = sites.size();
+    memcpy(trailer.magic, RAPTOR_TRACE_MAGIC, sizeof(trailer.magic));
+
+    std::vector<uint8_t> index;
+    auto append = [&](const void *data, size_t size) {
+      index.insert(index.end(), (const uint8_t *)data,
+                   (const uint8_t *)data + size);
+    };
+    append(segment_offsets.data(), sizeof(uint64_t) * segment_offsets.size());
+    append(outputs.data(), sizeof(uint32_t) * outputs.size());
+    for (auto &site : sites) {
+      for (const char *str : {site.second, site.first}) {
+        uint32_t length = str ? strlen(str) : 0;
+        append(&length, sizeof(length));
+        append(str, length);
+      }
+    }
+    append(&trailer, sizeof(trailer));
+    write_all(index.data(), index.size());
+    close(fd);
+    fd = -1;
+    fprintf(stderr, "raptor: wrote the trace of %u nodes to %s\n", num_nodes,
+            path.c_str());
+
+    segment_offsets.clear();
+    outputs.clear();
+    is_output.clear();
+    sites.clear();
+    site_ids.clear();
+    last_loc = last_name = nullptr;
+    last_site = 0;
+    values_size = 0;
+    if (ftruncate(values_fd, 0))
+      trace_fail("truncate", path + ".values");
+  }
+
+private:
+  struct Job {
+    TraceNode *chunk;
+    uint32_t first_id;
+    uint32_t num;
+  };
+
+  void run() {
+    for (;;) {
+      Job job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return stop || !queue.empty(); });
+        if (queue.empty())
+          return;
+        job = queue.front();
+        queue.pop_front();
+        busy = true;
+      }
+      cv.notify_all();
+      write_segment(job);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        free_chunks.push_back(job.chunk);
+        busy = false;
+      }
+      cv.notify_all();
+    }
+  }
 
-} __raptor_fp;
+  uint32_t site(const TraceNode &node) {
+    if (node.loc == last_loc && node.name == last_name)
+      return last_site;
+    if (sites.empty())
+      sites.push_back({nullptr, nullptr});
+    auto [it, inserted] =
+        site_ids.try_emplace({node.loc, node.name}, (uint32_t)sites.size());
+    if (inserted)
+      sites.push_back({node.loc, node.name});
+    last_loc = node.loc;
+    last_name = node.name;
+    return last_site = it->second;
+  }
+
+  void write_segment(const Job &job) {
+    open_file();
+    buffer.resize(sizeof(__raptor_trace_segment_header) +
+                  (size_t)job.num * __raptor_trace_max_node_bytes);
+    uint8_t *start = buffer.data() + sizeof(__raptor_trace_segment_header);
+    uint8_t *p = start;
+    uint32_t prev_site = 0;
+    for (uint32_t i = 0; i < job.num; i++) {
+      const TraceNode &node = job.chunk[i];
+      __raptor_trace_node encoded;
+      encoded.result = node.result;
+      encoded.site = site(node);
+      encoded.flags = node.flags;
+      encoded.input_num = node.input_num;
+      for (unsigned k = 0; k < node.input_num; k++) {
+        encoded.inputs[k] = node.inputs[k];
+        encoded.derivatives[k] = node.derivatives[k];
+      }
+      p = __raptor_trace_encode(p, job.first_id + i, encoded, prev_site,
+                                floats);
+    }
+    __raptor_trace_segment_header header;
+    header.magic = RAPTOR_TRACE_SEGMENT_MAGIC;
+    header.num_nodes = job.num;
+    header.first_id = job.first_id;
+    header.reserved = 0;
+    header.bytes = p - start;
+    memcpy(buffer.data(), &header, sizeof(header));
+    segment_offsets.push_back(offset);
+    write_all(buffer.data(), p - buffer.data());
+  }
+
+  void open_file() {
+    if (fd >= 0)
+      return;
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      trace_fail("open", path);
+    offset = 0;
+    __raptor_trace_file_header header;
+    memcpy(header.magic, RAPTOR_TRACE_MAGIC, sizeof(header.magic));
+    header.version = RAPTOR_TRACE_VERSION;
+    header.flags = floats ? __raptor_trace_float : 0;
+    write_all(&header, sizeof(header));
+  }
+
+  void write_all(const void *data, size_t size) {
+    auto *p = (const char *)data;
+    while (size) {
+      ssize_t written = ::write(fd, p, size);
+      if (written < 0) {
+        if (errno == EINTR)
+          continue;
+        trace_fail("write", path);
+      }
+      p += written;
+      size -= written;
+      offset += written;
+    }
+  }
+
+  std::string path;
+  bool floats;
+  int fd = -1;
+  uint64_t offset = 0;
+  std::vector<uint64_t> segment_offsets;
+  std::vector<uint8_t> buffer;
+  std::vector<uint32_t> outputs;
+  std::vector<bool> is_output;
+
+  struct SiteKeyHash {
+    size_t operator()(const std::pair<const char *, const char *> &k) const {
+      return std::hash<const char *>()(k.first) * 31 +
+             std::hash<const char *>()(k.second);
+    }
+  };
+  std::vector<std::pair<const char *, const char *>> sites;
+  std::unordered_map<std::pair<const char *, const char *>, uint32_t,
+                     SiteKeyHash>
+      site_ids;
+  const char *last_loc = nullptr;
+  const char *last_name = nullptr;
+  uint32_t last_site = 0;
+
+  int values_fd;
+  double *values;
+  size_t values_size = 0;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Job> queue;
+  std::vector<TraceNode *> free_chunks;
+  bool busy = false;
+  bool stop = false;
+  std::thread writer;
+};
+
+// Nodes live in fixed size chunks, so growing the tape neither copies nor
+// moves the nodes recorded so far. With RAPTOR_TRACE_SPILL only the last
+// RAPTOR_TRACE_WINDOW nodes stay in memory.
+class TraceTape {
+public:
+  static constexpr unsigned ChunkBits = TraceChunkBits;
+  static constexpr uint32_t ChunkSize = TraceChunkSize;
+  static constexpr uint32_t MaxNodes = TraceMaxNodes;
+
+  TraceTape() {
+    if (char *C = getenv("RAPTOR_TRACE_SPILL")) {
+      bool floats = false;
+      if (char *F = getenv("RAPTOR_TRACE_SPILL_FLOAT"))
+        floats = atoi(F);
+      size_t window = 16 * (size_t)ChunkSize;
+      if (char *W = getenv("RAPTOR_TRACE_WINDOW"))
+        window = strtoull(W, nullptr, 10);
+      window_chunks = std::max<size_t>(1, (window + ChunkSize - 1) / ChunkSize);
+      spill = std::make_unique<TraceSpill>(C, floats);
+    }
+    clear();
+  }
+  ~TraceTape() {
+    // Programs that never call __raptor_fprt_delete_all still get the file.
+    if (spill && num_nodes > 1)
+      flush();
+    for (TraceNode *chunk : chunks)
+      free(chunk);
+  }
+
+  uint32_t size() const { return num_nodes; }
+  bool spilling() const { return spill != nullptr; }
+
+  TraceNode &operator[](uint32_t id) {
+    return chunks[id >> ChunkBits][id & (ChunkSize - 1)];
+  }
+
+  double result(uint32_t id) {
+    if ((id >> ChunkBits) < first_resident)
+      return spill->value(id);
+    return (*this)[id].result;
+  }
+
+  void mark_output(uint32_t id) {
+    if ((id >> ChunkBits) >= first_resident) {
+      uint8_t &flags = (*this)[id].flags;
+      if (flags & TraceOutput)
+        return;
+      flags |= TraceOutput;
+    }
+    if (spill)
+      spill->output(id);
+  }
+
+  uint32_t push(double result, const char *name, const char *loc,
+                uint8_t flags) {
+    if (num_nodes == MaxNodes) {
+      fprintf(stderr, "raptor: the trace tape is full (%u nodes)\n",
+              num_nodes);
+      abort();
+    }
+    if ((num_nodes >> ChunkBits) == chunks.size()) {
+      if (spill && chunks.size() - first_resident == window_chunks) {
+        spill->write(chunks[first_resident], first_resident << ChunkBits,
+                     ChunkSize);
+        chunks[first_resident++] = nullptr;
+      }
+      chunks.push_back(spill ? spill->chunk() : trace_alloc_chunk());
+    }
+    uint32_t id = num_nodes++;
+    TraceNode &node = (*this)[id];
+    node.result = result;
+    std::fill_n(node.derivatives, fp_max_inputs, 0.0);
+    node.loc = loc;
+    node.name = name;
+    std::fill_n(node.inputs, fp_max_inputs, 0);
+    node.input_num = 0;
+    node.flags = flags;
+    return id;
+  }
+
+  // Write the nodes still in memory and complete the spill file.
+  void flush() {
+    for (size_t c = first_resident; c < chunks.size(); c++) {
+      uint32_t first = c << ChunkBits;
+      spill->write(chunks[c], first, std::min(ChunkSize, num_nodes - first));
+      chunks[c] = nullptr;
+    }
+    first_resident = chunks.size();
+    spill->finish(num_nodes);
+  }
+
+  // Drop all nodes. Without spilling the first chunk is kept around for the
+  // next trace, with spilling all chunks went to the writer in flush.
+  void clear() {
+    if (spill) {
+      chunks.clear();
+      first_resident = 0;
+    } else {
+      for (size_t i = 1; i < chunks.size(); i++)
+        free(chunks[i]);
+      chunks.resize(std::min<size_t>(chunks.size(), 1));
+    }
+    num_nodes = 0;
+    push(0, "const", "<zero>", TraceConst);
+  }
+
+private:
+  std::vector<TraceNode *> chunks;
+  uint32_t num_nodes = 0;
+  // Chunks before first_resident were spilled.
+  size_t first_resident = 0;
+  size_t window_chunks = 0;
+  std::unique_ptr<TraceSpill> spill;
+};
+
+TraceTape Tape;
+
+template <typename T>
+using TraceBitsTy =
+    std::conditional_t<sizeof(T) == sizeof(uint64_t), uint64_t, uint32_t>;
+
+template <typename T>
+constexpr bool trace_can_encode =
+    sizeof(T) == sizeof(uint64_t) || sizeof(T) == sizeof(uint32_t);
+
+[[noreturn]] void trace_unsupported(const char *type) {
+  fprintf(stderr, "raptor: %s values cannot hold a trace node ID\n", type);
+  abort();
+}
+
+template <typename T> T trace_encode(uint32_t id) {
+  return checked_raptor_bitcast<T>(TraceBitsTy<T>(id));
+}
+
+template <typename T> uint32_t trace_decode(T a) {
+  auto bits = checked_raptor_bitcast<TraceBitsTy<T>>(a);
+  if (bits >= Tape.size()) {
+    fprintf(stderr, "raptor: %a is not a traced value\n", (double)a);
+    abort();
+  }
+  return (uint32_t)bits;
 }
 
+} // namespace
+
+#if RAPTOR_FPRT_TRACE_PRINT
 static void print_raptor_fp_derivatives(std::ostream &out,
-                                        const __raptor_fp *fp) {
+                                        const TraceNode &node) {
   auto seen = false;
-  for (unsigned i = 0; i < fp->getInputNum(); i++) {
+  for (unsigned i = 0; i < node.input_num; i++) {
     if (seen)
       out << ", ";
     seen = true;
-    out << "d" << arg_names[i] << " = " << fp->getDerivative(i);
+    out << "d" << arg_names[i] << " = " << node.derivatives[i];
   }
 }
-static void print_raptor_fp_value(std::ostream &out, const __raptor_fp *fp) {
-  out << "[" << fp << ": " << fp->getResult() << "]";
+static void print_raptor_fp_value(std::ostream &out, uint32_t id) {
+  out << "[" << id << ": " << Tape.result(id) << "]";
 }
-static void print_raptor_fp_function(std::ostream &out, const __raptor_fp *fp) {
-  std::cerr << fp->getName() << "(";
+static void print_raptor_fp_function(std::ostream &out, const char *name,
+                                     const uint32_t *inputs, unsigned num) {
+  out << name << "(";
   bool seen = false;
-  for (unsigned i = 0; i < fp->getInputNum(); i++) {
+  for (unsigned i = 0; i < num; i++) {
     if (seen)
-      std::cerr << ", ";
+      out << ", ";
     seen = true;
-    __raptor_fp *fpinput = fp->getInput(i);
-    print_raptor_fp_value(std::cerr, fpinput);
+    print_raptor_fp_value(out, inputs[i]);
   }
-  std::cerr << ")";
+  out << ")";
 }
-static void print_raptor_fp(std::ostream &out, const __raptor_fp *fp) {
-  print_raptor_fp_function(out, fp);
+static void print_raptor_fp(std::ostream &out, uint32_t id) {
+  const TraceNode &node = Tape[id];
+  print_raptor_fp_function(out, node.name, node.inputs, node.input_num);
   out << " -> ";
-  print_raptor_fp_value(out, fp);
+  print_raptor_fp_value(out, id);
   out << " ";
-  print_raptor_fp_derivatives(out, fp);
-  out << " at " << fp->getLoc();
+  print_raptor_fp_derivatives(out, node);
+  out << " at " << node.loc;
   out << std::endl;
 }
+#endif
+
+// Central difference wrt input I, with the step scaled to the input.
+template <typename T, size_t N, typename Fn>
+static double __raptor_fprt_trace_derivative(Fn fn, std::array<T, N> x,
+                                             unsigned i) {
+  T h = std::cbrt(std::numeric_limits<T>::epsilon()) *
+        std::max<T>(1, std::abs(x[i]));
+  std::array<T, N> xp = x, xm = x;
+  xp[i] += h;
+  xm[i] -= h;
+  return ((double)std::apply(fn, xp) - (double)std::apply(fn, xm)) /
+         ((double)xp[i] - (double)xm[i]);
+}
+
+// The rules of Derivatives.def. Each is a functor that fills in the local
+// derivatives of an op from its inputs and result, except for the numeric ones,
+// which fall back to __raptor_fprt_trace_derivative.
+namespace trace_rules {
+struct Numeric {};
+
+#define RAPTOR_DERIVATIVE_1(NAME, DX)                                          \
+  struct NAME {                                                                \
+    template <typename T>                                                      \
+    void operator()(const T *in, double r, double *d) const {                  \
+      [[maybe_unused]] double x = in[0];                                       \
+      d[0] = DX;                                                               \
+    }                                                                          \
+  };
+#define RAPTOR_DERIVATIVE_2(NAME, DX, DY)                                      \
+  struct NAME {                                                                \
+    template <typename T>                                                      \
+    void operator()(const T *in, double r, double *d) const {                  \
+      [[maybe_unused]] double x = in[0], y = in[1];                            \
+      d[0] = DX;                                                               \
+      d[1] = DY;                                                               \
+    }                                                                          \
+  };
+#define RAPTOR_DERIVATIVE_3(NAME, DX, DY, DZ)                                  \
+  struct NAME {                                                                \
+    template <typename T>                                                      \
+    void operator()(const T *in, double r, double *d) const {                  \
+      [[maybe_unused]] double x = in[0], y = in[1], z = in[2];                 \
+      d[0] = DX;                                                               \
+      d[1] = DY;                                                               \
+      d[2] = DZ;                                                               \
+    }                                                                          \
+  };
+#define RAPTOR_DERIVATIVE_INT(NAME, DX)                                        \
+  struct NAME {                                                                \
+    int64_t n;                                                                 \
+    template <typename T>                                                      \
+    void operator()(const T *in, double r, double *d) const {                  \
+      [[maybe_unused]] double x = in[0];                                       \
+      d[0] = DX;                                                               \
+    }                                                                          \
+  };
+#define RAPTOR_DERIVATIVE_NUMERIC(NAME)                                        \
+  struct NAME : Numeric {};
+#include "../ir/Derivatives.def"
+} // namespace trace_rules
 
-template <typename T, unsigned NumInputs>
-static void __raptor_fprt_trace_no_res_flop(std::array<T, NumInputs> inputs,
-                                            const char *name, const char *loc) {
-  __raptor_fp fp;
-  fp.setInputNum(NumInputs);
-  fp.setLoc(loc);
-  for (unsigned i = 0; i < inputs.size(); i++) {
-    __raptor_fp *inputfp = __raptor_fprt_ieee_64_to_ptr(inputs[i]);
-    fp.setInput(i, inputfp);
+template <typename T, size_t N>
+static std::array<T, N> __raptor_fprt_trace_inputs(std::array<T, N> args,
+                                                   uint32_t *ids) {
+  std::array<T, N> vals;
+  for (unsigned i = 0; i < N; i++) {
+    ids[i] = trace_decode(args[i]);
+    vals[i] = (T)Tape.result(ids[i]);
   }
+  return vals;
+}
 
+template <typename T, size_t N>
+static void __raptor_fprt_trace_no_res_flop(std::array<T, N> args,
+                                            const char *name,
+                                            const char *loc) {
+  uint32_t ids[N > 0 ? N : 1];
+  __raptor_fprt_trace_inputs(args, ids);
 #if RAPTOR_FPRT_TRACE_PRINT
-  fp.setName(name);
-  print_raptor_fp_function(std::cerr, &fp);
+  print_raptor_fp_function(std::cerr, name, ids, N);
   std::cerr << " at " << loc << std::endl;
 #endif
 }
 
-namespace {
-template <typename T, unsigned NumInputs, unsigned Input> class Derivative {
-public:
-  __attribute__((always_inline)) static T get(void *fn,
-                                              std::array<T, NumInputs> inputs) {
-    return 0;
-  }
-};
-template <typename T> class Derivative<T, 1, 0> {
-public:
-  __attribute__((always_inline)) static T get(void *fn,
-                                              std::array<T, 1> inputs) {
-    typedef double (*fty)(double);
-    return __raptor_fwddiff<T>((fty)fn, raptor_dup, inputs[0], 1.0);
-  }
-};
-template <typename T> class Derivative<T, 2, 0> {
-public:
-  __attribute__((always_inline)) static T get(void *fn,
-                                              std::array<T, 2> inputs) {
-    typedef double (*fty)(double);
-    return __raptor_fwddiff<T>((fty)fn, raptor_dup, inputs[0], 1.0,
-                               raptor_const, inputs[1]);
-  }
-};
-template <typename T> class Derivative<T, 2, 1> {
-public:
-  __attribute__((always_inline)) static T get(void *fn,
-                                              std::array<T, 2> inputs) {
-    typedef double (*fty)(double);
-    return __raptor_fwddiff<T>((fty)fn, raptor_const, inputs[0], raptor_dup,
-                               inputs[1], 1.0);
-  }
-};
-template <typename T> class Derivative<T, 3, 0> {
-public:
-  __attribute__((always_inline)) static T get(void *fn,
-                                              std::array<T, 3> inputs) {
-    typedef double (*fty)(double);
-    // clang-format off
-    return __raptor_fwddiff<T>((fty)fn,
-                               raptor_dup, inputs[0], 1.0,
-                               raptor_const, inputs[1],
-                               raptor_const, inputs[2]
-                               );
-    // clang-format on
-  }
-};
-template <typename T> class Derivative<T, 3, 1> {
-public:
-  __attribute__((always_inline)) static T get(void *fn,
-                                              std::array<T, 3> inputs) {
-    typedef double (*fty)(double);
-    // clang-format off
-    return __raptor_fwddiff<T>((fty)fn,
-                               raptor_const, inputs[0],
-                               raptor_dup, inputs[1], 1.0,
-                               raptor_const, inputs[2]
-                               );
-    // clang-format on
-  }
-};
-template <typename T> class Derivative<T, 3, 2> {
-public:
-  __attribute__((always_inline)) static T get(void *fn,
-                                              std::array<T, 3> inputs) {
-    typedef double (*fty)(double);
-    // clang-format off
-    return __raptor_fwddiff<T>((fty)fn,
-                               raptor_const, inputs[0],
-                               raptor_const, inputs[1],
-                               raptor_dup, inputs[2], 1.0
-                               );
-    // clang-format on
-  }
-};
-} // namespace
-
-template <typename T, unsigned NumInputs>
-__attribute__((always_inline)) static void
-__raptor_fprt_trace_flop(std::array<T, NumInputs> _inputs, T output_val,
-                         __raptor_fp *outfp, void *fn, const char *name,
-                         const char *loc) {
-  std::array<__raptor_fp *, NumInputs> inputs;
-  std::array<T, NumInputs> input_vals;
-  for (unsigned i = 0; i < _inputs.size(); i++) {
-    __raptor_fp *inputfp = __raptor_fprt_ieee_64_to_ptr(_inputs[i]);
-    inputs[i] = inputfp;
-    input_vals[i] = inputfp->getResult();
-  }
-
-  outfp->setResult(output_val);
-  outfp->setInputNum(inputs.size());
-  outfp->setLoc(loc);
-  for (unsigned i = 0; i < inputs.size(); i++) {
-    outfp->setInput(i, inputs[i]);
-    T d;
-    static_assert(inputs.size() <= fp_max_inputs);
-    if (i == 0)
-      d = Derivative<T, NumInputs, 0>::get(fn, input_vals);
-    else if (i == 1)
-      d = Derivative<T, NumInputs, 1>::get(fn, input_vals);
-    else if (i == 2)
-      d = Derivative<T, NumInputs, 2>::get(fn, input_vals);
-    else
-      llvm_unreachable("impossible");
-    outfp->setDerivative(i, d);
+template <typename T, size_t N, typename Fn, typename Rule>
+static T __raptor_fprt_trace_flop(Fn fn, Rule rule, std::array<T, N> args,
+                                  const char *name, const char *loc) {
+  static_assert(N <= fp_max_inputs);
+  uint32_t ids[N];
+  std::array<T, N> vals = __raptor_fprt_trace_inputs(args, ids);
+  T res = std::apply(fn, vals);
+  uint32_t id = Tape.push(res, name, loc, 0);
+  TraceNode &node = Tape[id];
+  node.input_num = N;
+  for (unsigned i = 0; i < N; i++)
+    node.inputs[i] = ids[i];
+  if constexpr (std::is_base_of_v<trace_rules::Numeric, Rule>) {
+    for (unsigned i = 0; i < N; i++)
+      node.derivatives[i] = __raptor_fprt_trace_derivative(fn, vals, i);
+  } else {
+    rule(vals.data(), (double)res, node.derivatives);
   }
+#if RAPTOR_FPRT_TRACE_PRINT
+  print_raptor_fp(std::cerr, id);
+#endif
+  return trace_encode<T>(id);
+}
 
+template <typename T>
+static T __raptor_fprt_trace_leaf(T a, uint8_t flags, const char *name,
+                                  const char *loc) {
+  uint32_t id = Tape.push(a, name, loc, flags);
 #if RAPTOR_FPRT_TRACE_PRINT
-  outfp->setName(name);
-  print_raptor_fp(std::cerr, outfp);
+  print_raptor_fp(std::cerr, id);
 #endif
+  return trace_encode<T>(id);
 }
 
-// TODO ultimately we probably want a linked list of arrays or something like
-// that for this (std::list probably is that but we may want our own impl)
-struct {
-  std::list<__raptor_fp> all;
-  std::list<__raptor_fp *> outputs;
-  std::list<__raptor_fp *> inputs;
-  std::list<__raptor_fp *> consts;
-  void clear() {
-    all.clear();
-    outputs.clear();
-    inputs.clear();
-  }
-} FPs;
+#define RAPTOR_FLOAT_TYPE(CPP_TY, FROM_TY, NAME)                               \
+  __RAPTOR_MPFR_ATTRIBUTES                                                     \
+  CPP_TY __raptor_fprt_##FROM_TY##_get(CPP_TY _a, int64_t exponent,            \
+                                       int64_t significand, int64_t mode,      \
+                                       const char *loc, void *scratch) {       \
+    if constexpr (trace_can_encode<CPP_TY>) {                                  \
+      uint32_t id = trace_decode(_a);                                          \
+      Tape.mark_output(id);                                                    \
+      __raptor_fprt_trace_no_res_flop<CPP_TY, 1>({_a}, "get", loc);            \
+      return (CPP_TY)Tape.result(id);                                          \
+    } else {                                                                   \
+      trace_unsupported(#NAME);                                                \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  __RAPTOR_MPFR_ATTRIBUTES                                                     \
+  CPP_TY __raptor_fprt_##FROM_TY##_new(CPP_TY _a, int64_t exponent,            \
+                                       int64_t significand, int64_t mode,      \
+                                       const char *loc, void *scratch) {       \
+    if constexpr (trace_can_encode<CPP_TY>)                                    \
+      return __raptor_fprt_trace_leaf(_a, TraceInput, "new", loc);             \
+    else                                                                       \
+      trace_unsupported(#NAME);                                                \
+  }                                                                            \
+                                                                               \
+  /* TODO This should really be called only once for an appearance in the */  \
+  /* code, currently it is called every time a flop uses a constant. */        \
+  __RAPTOR_MPFR_ATTRIBUTES                                                     \
+  CPP_TY __raptor_fprt_##FROM_TY##_const(CPP_TY _a, int64_t exponent,          \
+                                         int64_t significand, int64_t mode,    \
+                                         const char *loc, void *scratch) {     \
+    if constexpr (trace_can_encode<CPP_TY>)                                    \
+      return __raptor_fprt_trace_leaf(_a, TraceConst, "const", loc);           \
+    else                                                                       \
+      trace_unsupported(#NAME);                                                \
+  }                                                                            \
+                                                                               \
+  /* Nodes stay on the tape until __raptor_fprt_delete_all. */                 \
+  __RAPTOR_MPFR_ATTRIBUTES                                                     \
+  void __raptor_fprt_##FROM_TY##_delete(CPP_TY a, int64_t exponent,            \
+                                        int64_t significand, int64_t mode,     \
+                                        const char *loc, void *scratch) {      \
+    if constexpr (trace_can_encode<CPP_TY>)                                    \
+      __raptor_fprt_trace_no_res_flop<CPP_TY, 1>({a}, "delete", loc);          \
+  }                                                                            \
+                                                                               \
+  __RAPTOR_MPFR_ATTRIBUTES                                                     \
+  void *__raptor_fprt_##FROM_TY##_get_scratch(int64_t to_e, int64_t to_m,      \
+                                              int64_t mode, const char *loc,   \
+                                              void *scratch) {                 \
+    return nullptr;                                                            \
+  }                                                                            \
+                                                                               \
+  __RAPTOR_MPFR_ATTRIBUTES                                                     \
+  void __raptor_fprt_##FROM_TY##_free_scratch(int64_t to_e, int64_t to_m,      \
+                                              int64_t mode, const char *loc,   \
+                                              void *scratch) {}                \
+                                                                               \
+  __RAPTOR_MPFR_ATTRIBUTES                                                     \
+  void __raptor_fprt_##FROM_TY##_trunc_change(                                 \
+      int64_t is_push, int64_t to_e, int64_t to_m, int64_t mode,               \
+      const char *loc, void *scratch) {}
 
 extern "C" {
+#include "raptor/FloatTypes.def"
+}
 
-__raptor_fp *__raptor_fprt_ieee_64_new_intermediate(int64_t exponent,
-                                                    int64_t significand,
-                                                    int64_t mode,
-                                                    const char *loc) {
-  size_t id = FPs.all.size();
-  FPs.all.push_back({});
-  __raptor_fp *a = &FPs.all.back();
-  a->id = id;
-  return a;
+// Below sensitivity computation is taken frmo ADAPT
+static double __raptor_estimate_truncation_error(double a) {
+  return std::fabs(a - (float)a);
 }
 
-double __raptor_fprt_ieee_64_get(double _a, int64_t exponent,
-                                 int64_t significand, int64_t mode,
-                                 const char *loc) {
-  __raptor_fp *a = __raptor_fprt_ieee_64_to_ptr(_a);
-  FPs.outputs.push_back(a);
-  __raptor_fprt_trace_no_res_flop<double, 1>({_a}, "get", loc);
-  return a->getResult();
+namespace {
+
+// The truncated ops at one source location, identified by the uniqued
+// location string and the op name.
+struct TraceSite {
+  const char *loc;
+  const char *name;
+  uint64_t count = 0;
+  double sensitivity = 0;
+  double max = 0;
+  uint32_t output = 0;
+};
+
+struct TraceSiteKeyHash {
+  size_t operator()(const std::pair<const char *, const char *> &k) const {
+    return std::hash<const char *>()(k.first) * 31 +
+           std::hash<const char *>()(k.second);
+  }
+};
+
+} // namespace
+
+// Site 0 stands for the inputs and consts, which are never truncated.
+static std::vector<TraceSite>
+__raptor_fprt_trace_sites(std::vector<uint32_t> &site_of) {
+  std::vector<TraceSite> sites(1);
+  std::unordered_map<std::pair<const char *, const char *>, uint32_t,
+                     TraceSiteKeyHash>
+      ids;
+  uint32_t size = Tape.size();
+  site_of.assign(size, 0);
+  for (uint32_t i = 1; i < size; i++) {
+    const TraceNode &node = Tape[i];
+    if (node.flags & (TraceInput | TraceConst))
+      continue;
+    auto [it, inserted] =
+        ids.try_emplace({node.loc, node.name}, (uint32_t)sites.size());
+    if (inserted) {
+      sites.emplace_back();
+      sites.back().loc = node.loc;
+      sites.back().name = node.name;
+    }
+    site_of[i] = it->second;
+    sites[it->second].count++;
+  }
+  return sites;
 }
 
-double __raptor_fprt_ieee_64_new(double _a, int64_t exponent,
-                                 int64_t significand, int64_t mode,
-                                 const char *loc) {
-  __raptor_fp *a =
-      __raptor_fprt_ieee_64_new_intermediate(exponent, significand, mode, loc);
-  FPs.inputs.push_back(a);
-  __raptor_fprt_trace_flop<double, 0>({}, _a, a, nullptr, "new", loc);
-  auto ret = __raptor_fprt_ptr_to_double(a);
-  return ret;
+// Reverse sweep from node `last`. With the outputs of interest seeded to 1,
+// adj[j] ends up as the sum over all paths from j to them of the products of
+// the absolute local derivatives, i.e. the factor by which an error in j shows
+// up in the outputs. Inputs always have a lower ID than their users.
+static void __raptor_fprt_trace_sweep(double *adj, uint32_t last) {
+  for (uint32_t j = last; j > 0; j--) {
+    double a = adj[j];
+    if (a == 0)
+      continue;
+    const TraceNode &node = Tape[j];
+    for (unsigned k = 0; k < node.input_num; k++)
+      adj[node.inputs[k]] += std::fabs(node.derivatives[k]) * a;
+  }
 }
 
-double __raptor_fprt_ieee_64_const(double _a, int64_t exponent,
-                                   int64_t significand, int64_t mode,
-                                   const char *loc) {
-  // TODO This should really be called only once for an appearance in the code,
-  // currently it is called every time a flop uses a constant.
-  __raptor_fp *a =
-      __raptor_fprt_ieee_64_new_intermediate(exponent, significand, mode, loc);
-  FPs.consts.push_back(a);
-  __raptor_fprt_trace_flop<double, 0>({}, _a, a, nullptr, "const", loc);
-  auto ret = __raptor_fprt_ptr_to_double(a);
-  return ret;
+// One sweep seeded with all outputs at once: the sensitivity of a site is
+// what its ops contribute to the sum of the output errors.
+static void __raptor_fprt_trace_all_outputs(
+    std::vector<TraceSite> &sites, const std::vector<uint32_t> &site_of,
+    const std::vector<uint32_t> &outputs) {
+  std::vector<double> adj(Tape.size());
+  for (uint32_t o : outputs)
+    adj[o] = 1;
+  __raptor_fprt_trace_sweep(adj.data(), outputs.back());
+  for (uint32_t j = 1; j <= outputs.back(); j++) {
+    if (!site_of[j])
+      continue;
+    TraceSite &site = sites[site_of[j]];
+    double s = __raptor_estimate_truncation_error(Tape[j].result) * adj[j];
+    site.sensitivity += s;
+    site.max = std::max(site.max, s);
+  }
 }
 
-void __raptor_fprt_ieee_64_delete(double a, int64_t exponent,
-                                  int64_t significand, int64_t mode,
-                                  const char *loc) {
-  // TODO
-  __raptor_fprt_trace_no_res_flop<double, 1>({a}, "delete", loc);
+// One sweep per output, over the cone of nodes below it: the sensitivity of a
+// site is its contribution to the output it affects most. The sweeps are
+// independent, so they are spread over `threads` threads.
+static void __raptor_fprt_trace_per_output(
+    std::vector<TraceSite> &sites, const std::vector<uint32_t> &site_of,
+    const std::vector<uint32_t> &outputs, unsigned threads) {
+  std::atomic<size_t> next(0);
+  std::vector<std::vector<TraceSite>> results(threads, sites);
+  auto worker = [&](std::vector<TraceSite> &best) {
+    std::vector<double> adj(outputs.back() + 1);
+    std::vector<double> cur(sites.size());
+    std::vector<double> cur_max(sites.size());
+    for (size_t i; (i = next++) < outputs.size();) {
+      uint32_t o = outputs[i];
+      std::fill(adj.begin(), adj.begin() + o + 1, 0.0);
+      std::fill(cur.begin(), cur.end(), 0.0);
+      std::fill(cur_max.begin(), cur_max.end(), 0.0);
+      adj[o] = 1;
+      __raptor_fprt_trace_sweep(adj.data(), o);
+      for (uint32_t j = 1; j <= o; j++) {
+        if (!site_of[j])
+          continue;
+        double s = __raptor_estimate_truncation_error(Tape[j].result) * adj[j];
+        cur[site_of[j]] += s;
+        cur_max[site_of[j]] = std::max(cur_max[site_of[j]], s);
+      }
+      for (size_t s = 1; s < sites.size(); s++) {
+        if (cur[s] > best[s].sensitivity ||
+            (cur[s] == best[s].sensitivity && cur[s] > 0 &&
+             o < best[s].output)) {
+          best[s].sensitivity = cur[s];
+          best[s].output = o;
+        }
+        best[s].max = std::max(best[s].max, cur_max[s]);
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; t++)
+    pool.emplace_back(worker, std::ref(results[t]));
+  worker(results[0]);
+  for (auto &t : pool)
+    t.join();
+
+  for (auto &best : results) {
+    for (size_t s = 1; s < sites.size(); s++) {
+      if (best[s].sensitivity > sites[s].sensitivity ||
+          (best[s].sensitivity == sites[s].sensitivity &&
+           best[s].sensitivity > 0 && best[s].output < sites[s].output)) {
+        sites[s].sensitivity = best[s].sensitivity;
+        sites[s].output = best[s].output;
+      }
+      sites[s].max = std::max(sites[s].max, best[s].max);
+    }
+  }
 }
 
-// Below sensitivity computation is taken frmo ADAPT
-static double __raptor_estimate_truncation_error(double a) {
-  return abs(a - (float)a);
+static void __raptor_fprt_trace_report(const std::vector<TraceSite> &sites,
+                                       size_t outputs, uint64_t ops,
+                                       size_t top, bool per_output) {
+  std::vector<uint32_t> order;
+  for (uint32_t s = 1; s < sites.size(); s++)
+    order.push_back(s);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return sites[a].sensitivity > sites[b].sensitivity;
+  });
+  if (top == 0 || top > order.size())
+    top = order.size();
+
+  fprintf(stderr,
+          "raptor: sensitivity of %zu outputs to truncating %llu ops from "
+          "double to float, top %zu of %zu sites\n",
+          outputs, (unsigned long long)ops, top, order.size());
+  fprintf(stderr, "rank sensitivity max ops op location\n");
+  for (size_t r = 0; r < top; r++) {
+    const TraceSite &site = sites[order[r]];
+    fprintf(stderr, "%zu %e %e %llu %s at %s", r + 1, site.sensitivity,
+            site.max, (unsigned long long)site.count, site.name, site.loc);
+    if (per_output && site.output)
+      fprintf(stderr, " wrt output %u at %s", site.output,
+              Tape[site.output].loc);
+    fprintf(stderr, "\n");
+  }
 }
 
+__RAPTOR_MPFR_ATTRIBUTES
 void __raptor_fprt_delete_all() {
-  size_t size = FPs.all.size();
-  size_t i = 0;
-  for (auto it = FPs.all.begin(); it != FPs.all.end(); i++, it++) {
-    // Do not truncate inputs
-    if (std::find(FPs.inputs.begin(), FPs.inputs.end(), &*it) !=
-        FPs.inputs.end())
-      continue;
-    // Or consts
-    if (std::find(FPs.consts.begin(), FPs.consts.end(), &*it) !=
-        FPs.consts.end())
-      continue;
+  if (Tape.spilling()) {
+    Tape.flush();
+    Tape.clear();
+    return;
+  }
 
-    // Zero out all errors
-    // TODO is it faster to calloc each time or should we pre-allocate and
-    // memset?
-    double *errors = (double *)std::calloc(size, sizeof(*errors));
-    // Introduce truncation error into the current op
-    // TODO we can probably re-run the original operation in the truncated
-    // precision thus get the real error and not an estimation
-    errors[i] = __raptor_estimate_truncation_error(it->getResult());
+  size_t top = 10;
+  if (char *C = getenv("RAPTOR_TRACE_TOP"))
+    top = strtoull(C, nullptr, 10);
+  bool per_output = false;
+  if (char *C = getenv("RAPTOR_TRACE_PER_OUTPUT"))
+    per_output = atoi(C);
+  unsigned threads = 1;
+  if (char *C = getenv("RAPTOR_TRACE_THREADS"))
+    threads = std::max(1, atoi(C));
 
-    size_t j = i;
-    for (auto jt = it; jt != FPs.all.end(); j++, jt++)
-      for (unsigned char k = 0; k < jt->getInputNum(); k++)
-        errors[j] += abs(jt->getDerivative(k) * errors[jt->getInput(k)->id]);
+  std::vector<uint32_t> outputs;
+  for (uint32_t j = 1; j < Tape.size(); j++)
+    if (Tape[j].flags & TraceOutput)
+      outputs.push_back(j);
 
-#if RAPTOR_FPRT_TRACE_PRINT
-    std::cerr << "For instance ";
-    print_raptor_fp_value(std::cerr, &*it);
-    std::cerr << " when truncated from double to float:" << std::endl;
-
-    for (__raptor_fp *output : FPs.outputs) {
-      std::cerr << "    wrt output ";
-      print_raptor_fp_value(std::cerr, output);
-      std::cerr << " at " << output->getLoc()
-                << ", sensitivity = " << errors[output->id] << std::endl;
-    }
-#endif
+  std::vector<uint32_t> site_of;
+  std::vector<TraceSite> sites = __raptor_fprt_trace_sites(site_of);
+  uint64_t ops = 0;
+  for (const TraceSite &site : sites)
+    ops += site.count;
+
+  if (!outputs.empty()) {
+    if (per_output)
+      __raptor_fprt_trace_per_output(sites, site_of, outputs, threads);
+    else
+      __raptor_fprt_trace_all_outputs(sites, site_of, outputs);
   }
-  FPs.clear();
+  __raptor_fprt_trace_report(sites, outputs.size(), ops, top, per_output);
+  Tape.clear();
 }
 
 #define __RAPTOR_MPFR_SINGOP(OP_TYPE, LLVM_OP_NAME, MPFR_FUNC_NAME, FROM_TYPE, \
                              RET, MPFR_GET, ARG1, MPFR_SET_ARG1,               \
                              ROUNDING_MODE)                                    \
-  __RAPTOR_MPFR_ATTRIBUTES                                                     \
+  __RAPTOR_MPFR_ORIGINAL_ATTRIBUTES                                            \
   RET __raptor_fprt_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME(ARG1 a); \
   __RAPTOR_MPFR_ATTRIBUTES                                                     \
   RET __raptor_fprt_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME(                  \
       ARG1 a, int64_t exponent, int64_t significand, int64_t mode,             \
-      const char *loc) {                                                       \
-    auto originalfn =                                                          \
-        __raptor_fprt_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME;       \
-    RET res = originalfn(__raptor_fprt_ieee_64_to_ptr(a)->getResult());        \
-    __raptor_fp *intermediate = __raptor_fprt_ieee_64_new_intermediate(        \
-        exponent, significand, mode, loc);                                     \
-    intermediate->setResult(res);                                              \
-    double ret = __raptor_fprt_ptr_to_double(intermediate);                    \
-    __raptor_fprt_trace_flop<RET, 1>({a}, res, intermediate,                   \
-                                     (void *)originalfn, #LLVM_OP_NAME, loc);  \
-    return ret;                                                                \
+      const char *loc, void *scratch) {                                        \
+    return __raptor_fprt_trace_flop<RET, 1>(                                   \
+        __raptor_fprt_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME,       \
+        trace_rules::MPFR_FUNC_NAME{}, {a}, #LLVM_OP_NAME, loc);               \
   }
 
 // TODO this is a bit sketchy if the user cast their float to int before calling
@@ -394,21 +1001,16 @@ void __raptor_fprt_delete_all() {
   __RAPTOR_MPFR_ORIGINAL_ATTRIBUTES                                            \
   RET __raptor_fprt_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME(ARG1 a,  \
                                                                       ARG2 b); \
-  __RAPTOR_MPFR_ATTRIBUTES RET                                                 \
-      __raptor_fprt_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME(                  \
-          ARG1 a, ARG2 b, int64_t exponent, int64_t significand, int64_t mode, \
-          const char *loc) {                                                   \
-    auto originalfn =                                                          \
-        __raptor_fprt_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME;       \
-    RET res = originalfn(__raptor_fprt_ieee_64_to_ptr(a)->getResult(),         \
-                         __raptor_fprt_ieee_64_to_ptr(b)->getResult());        \
-    __raptor_fp *intermediate = __raptor_fprt_ieee_64_new_intermediate(        \
-        exponent, significand, mode, loc);                                     \
-    intermediate->setResult(res);                                              \
-    double ret = __raptor_fprt_ptr_to_double(intermediate);                    \
-    __raptor_fprt_trace_flop<RET, 1>({a}, res, intermediate,                   \
-                                     (void *)originalfn, #LLVM_OP_NAME, loc);  \
-    return ret;                                                                \
+  __RAPTOR_MPFR_ATTRIBUTES                                                     \
+  RET __raptor_fprt_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME(                  \
+      ARG1 a, ARG2 b, int64_t exponent, int64_t significand, int64_t mode,     \
+      const char *loc, void *scratch) {                                        \
+    auto fn = [b](ARG1 x) {                                                    \
+      return __raptor_fprt_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME(  \
+          x, b);                                                               \
+    };                                                                         \
+    return __raptor_fprt_trace_flop<RET, 1>(fn, trace_rules::MPFR_FUNC_NAME{b}, \
+                                            {a}, #LLVM_OP_NAME, loc);          \
   }
 
 #define __RAPTOR_MPFR_BIN(OP_TYPE, LLVM_OP_NAME, MPFR_FUNC_NAME, FROM_TYPE,    \
@@ -420,41 +1022,25 @@ void __raptor_fprt_delete_all() {
   __RAPTOR_MPFR_ATTRIBUTES                                                     \
   RET __raptor_fprt_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME(                  \
       ARG1 a, ARG2 b, int64_t exponent, int64_t significand, int64_t mode,     \
-      const char *loc) {                                                       \
-    auto originalfn =                                                          \
-        __raptor_fprt_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME;       \
-    RET res = originalfn(__raptor_fprt_ieee_64_to_ptr(a)->getResult(),         \
-                         __raptor_fprt_ieee_64_to_ptr(b)->getResult());        \
-    __raptor_fp *intermediate = __raptor_fprt_ieee_64_new_intermediate(        \
-        exponent, significand, mode, loc);                                     \
-    intermediate->setResult(res);                                              \
-    double ret = __raptor_fprt_ptr_to_double(intermediate);                    \
-    __raptor_fprt_trace_flop<RET, 2>({a, b}, res, intermediate,                \
-                                     (void *)originalfn, #LLVM_OP_NAME, loc);  \
-    return ret;                                                                \
-  }
-
-#define __RAPTOR_MPFR_FMULADD(LLVM_OP_NAME, FROM_TYPE, TYPE, MPFR_TYPE,         \
-                              LLVM_TYPE, ROUNDING_MODE)                         \
-  __RAPTOR_MPFR_ORIGINAL_ATTRIBUTES                                             \
-  TYPE __raptor_fprt_original_##FROM_TYPE##_intr_##LLVM_OP_NAME##_##LLVM_TYPE(  \
-      TYPE a, TYPE b, TYPE c);                                                  \
-  __RAPTOR_MPFR_ATTRIBUTES                                                      \
-  TYPE __raptor_fprt_##FROM_TYPE##_intr_##LLVM_OP_NAME##_##LLVM_TYPE(           \
-      TYPE a, TYPE b, TYPE c, int64_t exponent, int64_t significand,            \
-      int64_t mode, const char *loc) {                                          \
-    auto originalfn =                                                           \
-        __raptor_fprt_original_##FROM_TYPE##_intr_##LLVM_OP_NAME##_##LLVM_TYPE; \
-    TYPE res = originalfn(__raptor_fprt_ieee_64_to_ptr(a)->getResult(),         \
-                          __raptor_fprt_ieee_64_to_ptr(b)->getResult(),         \
-                          __raptor_fprt_ieee_64_to_ptr(c)->getResult());        \
-    __raptor_fp *intermediate = __raptor_fprt_ieee_64_new_intermediate(         \
-        exponent, significand, mode, loc);                                      \
-    intermediate->setResult(res);                                               \
-    double ret = __raptor_fprt_ptr_to_double(intermediate);                     \
-    __raptor_fprt_trace_flop<TYPE, 3>({a, b, c}, res, intermediate,             \
-                                      (void *)originalfn, #LLVM_OP_NAME, loc);  \
-    return ret;                                                                 \
+      const char *loc, void *scratch) {                                        \
+    return __raptor_fprt_trace_flop<RET, 2>(                                   \
+        __raptor_fprt_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME,       \
+        trace_rules::MPFR_FUNC_NAME{}, {a, b}, #LLVM_OP_NAME, loc);            \
+  }
+
+#define __RAPTOR_MPFR_FMULADD(OP_TYPE, LLVM_OP_NAME, FROM_TYPE, TYPE,          \
+                              MPFR_TYPE, LLVM_TYPE, ROUNDING_MODE)             \
+  __RAPTOR_MPFR_ORIGINAL_ATTRIBUTES                                            \
+  TYPE                                                                         \
+  __raptor_fprt_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME##_##LLVM_TYPE( \
+      TYPE a, TYPE b, TYPE c);                                                 \
+  __RAPTOR_MPFR_ATTRIBUTES                                                     \
+  TYPE __raptor_fprt_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME##_##LLVM_TYPE(   \
+      TYPE a, TYPE b, TYPE c, int64_t exponent, int64_t significand,           \
+      int64_t mode, const char *loc, void *scratch) {                          \
+    return __raptor_fprt_trace_flop<TYPE, 3>(                                  \
+        __raptor_fprt_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME##_##LLVM_TYPE, \
+        trace_rules::fma{}, {a, b, c}, #LLVM_OP_NAME, loc);                    \
   }
 
 #define __RAPTOR_MPFR_FCMP_IMPL(NAME, ORDERED, CMP, FROM_TYPE, TYPE, MPFR_GET, \
@@ -464,25 +1050,45 @@ void __raptor_fprt_delete_all() {
   __RAPTOR_MPFR_ATTRIBUTES                                                     \
   bool __raptor_fprt_##FROM_TYPE##_fcmp_##NAME(                                \
       TYPE a, TYPE b, int64_t exponent, int64_t significand, int64_t mode,     \
-      const char *loc) {                                                       \
-    bool res = __raptor_fprt_original_##FROM_TYPE##_fcmp_##NAME(               \
-        __raptor_fprt_ieee_64_to_ptr(a)->getResult(),                          \
-        __raptor_fprt_ieee_64_to_ptr(b)->getResult());                         \
+      const char *loc, void *scratch) {                                        \
     __raptor_fprt_trace_no_res_flop<TYPE, 2>({a, b}, "fcmp_" #NAME, loc);      \
-    return res;                                                                \
-  }
-
-__RAPTOR_MPFR_ORIGINAL_ATTRIBUTES
-bool __raptor_fprt_original_ieee_64_intr_llvm_is_fpclass_f64(double a,
-                                                             int32_t tests);
-__RAPTOR_MPFR_ATTRIBUTES bool __raptor_fprt_ieee_64_intr_llvm_is_fpclass_f64(
-    double a, int32_t tests, int64_t exponent, int64_t significand,
-    int64_t mode, const char *loc) {
-  __raptor_fprt_trace_no_res_flop<double, 1>({a}, "llvm_is_fpclass_f64", loc);
-  return __raptor_fprt_original_ieee_64_intr_llvm_is_fpclass_f64(
-      __raptor_fprt_ieee_64_to_ptr(a)->getResult(), tests);
-}
+    return __raptor_fprt_original_##FROM_TYPE##_fcmp_##NAME(                   \
+        (TYPE)Tape.result(trace_decode(a)),                                    \
+        (TYPE)Tape.result(trace_decode(b)));                                   \
+  }
+
+#define __RAPTOR_MPFR_ISCLASS(FROM_TYPE, TYPE, LLVM_TYPE)                      \
+  __RAPTOR_MPFR_ORIGINAL_ATTRIBUTES bool                                       \
+      __raptor_fprt_original_##FROM_TYPE##_intr_llvm_is_fpclass_##LLVM_TYPE(   \
+          TYPE a, int32_t tests);                                              \
+  __RAPTOR_MPFR_ATTRIBUTES bool                                                \
+      __raptor_fprt_##FROM_TYPE##_intr_llvm_is_fpclass_##LLVM_TYPE(            \
+          TYPE a, int32_t tests, int64_t exponent, int64_t significand,        \
+          int64_t mode, const char *loc, void *scratch) {                      \
+    __raptor_fprt_trace_no_res_flop<TYPE, 1>(                                  \
+        {a}, "llvm_is_fpclass_" #LLVM_TYPE, loc);                              \
+    return __raptor_fprt_original_##FROM_TYPE##_intr_llvm_is_fpclass_##LLVM_TYPE( \
+        (TYPE)Tape.result(trace_decode(a)), tests);                            \
+  }
+
+#define __RAPTOR_MPFR_LROUND(OP_TYPE, LLVM_OP_NAME, FROM_TYPE, RET, ARG1,      \
+                             MPFR_SET_ARG1, ROUNDING_MODE)                     \
+  __RAPTOR_MPFR_ORIGINAL_ATTRIBUTES                                            \
+  RET __raptor_fprt_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME(ARG1 a); \
+  __RAPTOR_MPFR_ATTRIBUTES                                                     \
+  RET __raptor_fprt_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME(                  \
+      ARG1 a, int64_t exponent, int64_t significand, int64_t mode,             \
+      const char *loc, void *scratch) {                                        \
+    __raptor_fprt_trace_no_res_flop<ARG1, 1>({a}, #LLVM_OP_NAME, loc);         \
+    return __raptor_fprt_original_##FROM_TYPE##_##OP_TYPE##_##LLVM_OP_NAME(    \
+        (ARG1)Tape.result(trace_decode(a)));                                   \
+  }
 
-#include <raptor/fprt/flops.def>
+// The pass only emits accumulations with a separate accumulator format in op
+// mode.
+#define __RAPTOR_MPFR_ACC_BIN(...)
+#define __RAPTOR_MPFR_ACC_FMULADD(...)
 
+extern "C" {
+#include "../ir/Flops.def"
 } // extern "C"
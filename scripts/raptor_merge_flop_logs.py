@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""
+Merge the per-thread flop logs written with RAPTOR_FLOP_LOG_PER_THREAD=1.
+
+The files <log>.t<tag> are concatenated in tag order into <log> (or the -o
+output), so the result does not depend on how the threads were scheduled.
+An index <output>.threads lists the range of records of every thread.
+"""
+import argparse
+import glob
+import os
+import re
+import sys
+
+TYPE_SIZES = {'half': 2, 'bfloat': 2, 'float': 4, 'double': 8}
+
+CHUNK_SIZE = 1 << 24
+
+
+def thread_files(log):
+    """The per-thread files of log, sorted by tag."""
+    files = []
+    for path in glob.glob(glob.escape(log) + '.t*'):
+        m = re.fullmatch(re.escape(log) + r'\.t(\d+)', path)
+        if m:
+            files.append((int(m.group(1)), path))
+    return sorted(files)
+
+
+def record_size(log):
+    """
+    Size of a record of log. Logs written with RAPTOR_FLOP_LOG_SITES=1 state
+    it in their site table, otherwise it is the size of the type in the name.
+    """
+    try:
+        with open(log + '.sites') as f:
+            for line in f:
+                m = re.match(r'# record (\d+) bytes', line)
+                if m:
+                    return int(m.group(1))
+    except FileNotFoundError:
+        pass
+    suffix = log.rsplit('.', 1)[-1]
+    if suffix not in TYPE_SIZES:
+        raise ValueError(f"Cannot tell the record size of '{log}', "
+                         "use --record-size")
+    return TYPE_SIZES[suffix]
+
+
+def merge(log, output, size, remove):
+    files = thread_files(log)
+    if not files:
+        raise ValueError(f"No per-thread logs '{log}.t<tag>' found")
+
+    index = []
+    first = 0
+    with open(output, 'wb') as out:
+        for tag, path in files:
+            length = os.path.getsize(path)
+            if length % size:
+                print(f"warning: '{path}' ends in a partial record, "
+                      "ignoring it", file=sys.stderr)
+            records = length // size
+            with open(path, 'rb') as f:
+                left = records * size
+                while left:
+                    chunk = f.read(min(CHUNK_SIZE, left))
+                    if not chunk:
+                        break
+                    out.write(chunk)
+                    left -= len(chunk)
+            index.append((tag, first, records))
+            first += records
+
+    with open(output + '.threads', 'w') as f:
+        f.write("# thread first_record records\n")
+        for tag, start, records in index:
+            f.write(f"{tag} {start} {records}\n")
+
+    if remove:
+        for _, path in files:
+            os.remove(path)
+    return index
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Merge per-thread flop logs in thread order.")
+    parser.add_argument("log", help="Path of the log, e.g. <prefix>.double")
+    parser.add_argument("-o", "--output",
+                        help="Merged log (default: the log path itself)")
+    parser.add_argument("--record-size", type=int,
+                        help="Bytes per record (default: from the site table "
+                             "or the type in the file name)")
+    parser.add_argument("--remove", action="store_true",
+                        help="Remove the per-thread files after merging")
+    args = parser.parse_args()
+
+    size = args.record_size or record_size(args.log)
+    index = merge(args.log, args.output or args.log, size, args.remove)
+    for tag, start, records in index:
+        print(f"thread {tag}: {records} records")
+
+
+if __name__ == "__main__":
+    main()
@@ -3,62 +3,129 @@ import argparse
 import numpy as np
 import matplotlib.pyplot as plt
 
+DTYPE_INFO = {
+    'float16': {'bits': 16, 'exp_bits': 5, 'bias': 15},
+    'bfloat16': {'bits': 16, 'exp_bits': 8, 'bias': 127},
+    'float32': {'bits': 32, 'exp_bits': 8, 'bias': 127},
+    'float64': {'bits': 64, 'exp_bits': 11, 'bias': 1023},
+}
+
+HISTOGRAM_HEADER = "# raptor flop histogram v1"
+
+HISTOGRAM_DTYPES = {'half': 'float16', 'bfloat': 'bfloat16',
+                    'float': 'float32', 'double': 'float64'}
+
+
+def is_histogram_file(filename):
+    """Whether filename was written by RAPTOR_FLOP_LOG_MODE=histogram."""
+    with open(filename, 'rb') as f:
+        return f.read(len(HISTOGRAM_HEADER)) == HISTOGRAM_HEADER.encode()
+
+
+def load_raw(filename, dtype):
+    """
+    Count the biased exponent fields of a raw binary file of floats.
+
+    This reads the whole file into memory. For large logs, reduce them to a
+    histogram file with `raptor-log-analyze -o` first and plot that.
+
+    Returns the dtype and a dict mapping biased exponent to count.
+    """
+    if dtype not in DTYPE_INFO:
+        raise ValueError(f"Unsupported dtype '{dtype}'. Must be one of {list(DTYPE_INFO.keys())}")
+
+    info = DTYPE_INFO[dtype]
+    bits = info['bits']
+    exp_bits = info['exp_bits']
+
+    # Load binary data as unsigned integers, numpy has no bfloat16
+    int_view = np.fromfile(
+        filename, dtype={16: np.uint16, 32: np.uint32, 64: np.uint64}[bits])
+    if int_view.size == 0:
+        raise ValueError("No data found in file or file empty.")
+
+    # Extract exponent bits
+    mantissa_bits = bits - exp_bits - 1
+    exponent_mask = ((1 << exp_bits) - 1) << mantissa_bits
+    exponents = ((int_view & exponent_mask) >> mantissa_bits).astype(int)
+
+    values, counts = np.unique(exponents, return_counts=True)
+    return dtype, dict(zip(values.tolist(), counts.tolist())), {}
+
+
+def load_histogram(filename):
+    """
+    Read a histogram file written by RAPTOR_FLOP_LOG_MODE=histogram.
+
+    Returns the dtype, a dict mapping biased exponent to count and a dict
+    mapping the number of trailing zero mantissa bits to count.
+    """
+    dtype = None
+    exponents = {}
+    trailing_zeros = {}
+    with open(filename) as f:
+        for line in f:
+            fields = line.split()
+            if not fields or fields[0].startswith('#'):
+                continue
+            if fields[0] == 'type':
+                dtype = HISTOGRAM_DTYPES.get(fields[1])
+            elif fields[0] == 'exponent':
+                exponents[int(fields[1])] = int(fields[2])
+            elif fields[0] == 'trailing_zeros':
+                trailing_zeros[int(fields[1])] = int(fields[2])
+    if dtype is None:
+        raise ValueError(f"Unsupported or missing type in '{filename}'.")
+    return dtype, exponents, trailing_zeros
+
+
 def plot_exponent_distribution(filename, dtype='float32', output_file='exponent_hist.png'):
     """
-    Plot histograms of exponent field usage in a raw binary file of floating-point numbers.
+    Plot histograms of exponent field usage in a raw binary file of floating-point numbers,
+    or in a histogram file written with RAPTOR_FLOP_LOG_MODE=histogram.
     Generates two subplots:
       1. Histogram of used exponent range (min to max of actual data)
       2. Histogram over the full possible exponent range
+    and a third one with the trailing zero bits of the mantissa if the
+    histogram file contains them.
 
     Parameters
     ----------
     filename : str
-        Path to the binary file.
+        Path to the binary or histogram file.
     dtype : str
-        Data type of the floats in the file. One of: 'float16', 'float32', 'float64'.
+        Data type of the floats in a binary file. One of: 'float16', 'bfloat16',
+        'float32', 'float64'.
+        Histogram files record their type.
     output_file : str
         Output filename to save the plot (e.g., 'plot.png' or 'plot.pdf').
     """
-    dtype_info = {
-        'float16': {'bits': 16, 'exp_bits': 5, 'bias': 15},
-        'float32': {'bits': 32, 'exp_bits': 8, 'bias': 127},
-        'float64': {'bits': 64, 'exp_bits': 11, 'bias': 1023},
-    }
+    if is_histogram_file(filename):
+        dtype, exponent_counts, trailing_zeros = load_histogram(filename)
+    else:
+        dtype, exponent_counts, trailing_zeros = load_raw(filename, dtype)
 
-    if dtype not in dtype_info:
-        raise ValueError(f"Unsupported dtype '{dtype}'. Must be one of {list(dtype_info.keys())}")
-
-    info = dtype_info[dtype]
-    bits = info['bits']
+    info = DTYPE_INFO[dtype]
     exp_bits = info['exp_bits']
     bias = info['bias']
 
-    # Load binary data
-    data = np.fromfile(filename, dtype=dtype)
-    if data.size == 0:
-        raise ValueError("No data found in file or file empty.")
-
-    # View data as unsigned integer
-    int_view = data.view({16: np.uint16, 32: np.uint32, 64: np.uint64}[bits])
-
-    # Extract exponent bits
-    mantissa_bits = bits - exp_bits - 1
-    exponent_mask = ((1 << exp_bits) - 1) << mantissa_bits
-    exponents = ((int_view & exponent_mask) >> mantissa_bits).astype(int)
-
     # Mask out special exponents (0 or all ones)
-    normal_mask = (exponents != 0) & (exponents != (1 << exp_bits) - 1)
-    exponents_normal = exponents[normal_mask]
+    normal = {e: c for e, c in exponent_counts.items()
+              if e != 0 and e != (1 << exp_bits) - 1}
+    if not normal:
+        raise ValueError("No normal values found.")
 
     # Convert to unbiased exponent values
-    unbiased_exponents = exponents_normal - bias
+    unbiased_exponents = np.array(list(normal.keys())) - bias
+    weights = np.array(list(normal.values()))
 
     # Prepare plots
-    fig, axes = plt.subplots(2, 1, figsize=(10, 8), constrained_layout=True)
+    nplots = 3 if trailing_zeros else 2
+    fig, axes = plt.subplots(nplots, 1, figsize=(10, 4 * nplots), constrained_layout=True)
 
     # --- Subplot 1: Only used exponent range ---
     bins_used = np.arange(unbiased_exponents.min() - 1, unbiased_exponents.max() + 2)
-    axes[0].hist(unbiased_exponents, bins=bins_used, edgecolor='black', alpha=0.7)
+    axes[0].hist(unbiased_exponents, bins=bins_used, weights=weights, edgecolor='black', alpha=0.7)
     axes[0].set_title(f"Exponent Distribution (Used Range)\n{dtype}, File: {filename}")
     axes[0].set_xlabel("Unbiased Exponent Value")
     axes[0].set_ylabel("Frequency")
@@ -69,13 +136,22 @@ def plot_exponent_distribution(filename, dtype='float32', output_file='exponent_
     exp_max_possible = (1 << exp_bits) - 2 - bias  # Largest normal exponent
     bins_full = np.arange(exp_min_possible - 0.5, exp_max_possible + 1.5)
 
-    axes[1].hist(unbiased_exponents, bins=bins_full, edgecolor='black', alpha=0.7)
+    axes[1].hist(unbiased_exponents, bins=bins_full, weights=weights, edgecolor='black', alpha=0.7)
     axes[1].set_xlim(exp_min_possible - 1, exp_max_possible + 1)
     axes[1].set_title(f"Exponent Distribution (Full Range)\n{dtype}")
     axes[1].set_xlabel("Unbiased Exponent Value (All Possible)")
     axes[1].set_ylabel("Frequency")
     axes[1].grid(True, linestyle='--', alpha=0.5)
 
+    # --- Subplot 3: Trailing zero bits of the mantissa ---
+    if trailing_zeros:
+        axes[2].bar(list(trailing_zeros.keys()), list(trailing_zeros.values()),
+                    edgecolor='black', alpha=0.7)
+        axes[2].set_title(f"Trailing Zero Mantissa Bits of Normal Values\n{dtype}")
+        axes[2].set_xlabel("Trailing Zero Bits")
+        axes[2].set_ylabel("Frequency")
+        axes[2].grid(True, linestyle='--', alpha=0.5)
+
     # Save to file
     plt.savefig(output_file)
     plt.close()
@@ -84,14 +160,15 @@ def plot_exponent_distribution(filename, dtype='float32', output_file='exponent_
 
 def main():
     parser = argparse.ArgumentParser(
-        description="Plot histogram of exponent field usage in a raw binary float file."
+        description="Plot histogram of exponent field usage in a raw binary float file "
+                    "or in a RAPTOR_FLOP_LOG_MODE=histogram file."
     )
-    parser.add_argument("filename", help="Path to the binary input file")
+    parser.add_argument("filename", help="Path to the binary or histogram input file")
     parser.add_argument(
         "--dtype",
-        choices=["float16", "float32", "float64"],
+        choices=list(DTYPE_INFO.keys()),
         default="float32",
-        help="Data type of floats in the file (default: float32)",
+        help="Data type of floats in a binary file (default: float32)",
     )
     parser.add_argument(
         "--output",
@@ -0,0 +1,53 @@
+// clang-format off
+// RUN: %clang -O2 -g %s -o %t.a.out %linkRaptorRT %loadClangPluginRaptor -mllvm --raptor-track-allocations -lm && RAPTOR_ALLOC_REPORT=%t.csv %t.a.out && FileCheck %s < %t.csv
+
+// The failed realloc keeps the malloc'ed block registered.
+// CHECK: site,allocations,allocated_bytes,accesses,load_bytes,store_bytes
+// CHECK-NEXT: "{{.*}}allocations.cpp:[[@LINE+27]]{{.*}}",1,800,{{[0-9]+}},800,800
+// CHECK-NEXT: "{{.*}}allocations.cpp:[[@LINE+33]]{{.*}}",1,1600,{{[0-9]+}},1600,1600
+// CHECK-NEXT: "named",1,400,{{[0-9]+}},400,400
+// CHECK-NEXT: "unattributed",0,0,
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+extern "C" void __raptor_alloc_register(void *ptr, int64_t size, const char *name);
+extern "C" void __raptor_alloc_unregister(void *ptr);
+
+__attribute__((noinline))
+void fill(double *a, int n) {
+    for (int i = 0; i < n; i++)
+        a[i] = i;
+}
+__attribute__((noinline))
+double sum(double *a, int n) {
+    double s = 0;
+    for (int i = 0; i < n; i++)
+        s += a[i];
+    return s;
+}
+
+int main() {
+    int n = 100;
+    double *a = (double *)malloc(n * sizeof(double));
+    fill(a, n);
+    double *failed = (double *)realloc(a, SIZE_MAX / 2);
+    if (failed)
+        return 1;
+    double s = sum(a, n);
+
+    a = (double *)realloc(a, 2 * n * sizeof(double));
+    fill(a, 2 * n);
+    s += sum(a, 2 * n);
+
+    double named[50];
+    __raptor_alloc_register(named, sizeof(named), "named");
+    fill(named, 50);
+    s += sum(named, 50);
+    __raptor_alloc_unregister(named);
+
+    free(a);
+    printf("%f\n", s);
+    return 0;
+}
@@ -0,0 +1,30 @@
+// clang-format off
+// Without excess precision clang keeps the arithmetic in half instead of
+// promoting it to float.
+// RUN: %clang -O2 -g -ffloat16-excess-precision=none %s -o %t.a.out %loadClangPluginRaptor -mllvm --raptor-cancellation-count=4 %linkRaptorRT -lm && RAPTOR_CANCELLATION_REPORT=%t.csv %t.a.out && FileCheck %s < %t.csv
+
+// x - x is zero even though x has an exponent field below 11.
+// CHECK: site,events,bits_1,bits_2_3,bits_4_7,bits_8_15,bits_16_31,bits_32_63,all_bits
+// CHECK-NEXT: "{{.*}}cancellation.cpp:[[@LINE+9]]{{.*}}",1,0,0,0,0,0,0,1
+// CHECK-NEXT: "{{.*}}cancellation.cpp:[[@LINE+13]]{{.*}}",1,0,0,0,1,0,0,0
+
+#include <cstdio>
+
+typedef _Float16 half;
+
+__attribute__((noinline))
+half same(half x) {
+    return x - x;
+}
+
+__attribute__((noinline))
+half diff(half x, half y) {
+    return x - y;
+}
+
+int main() {
+    // 2^-5 and 1 + 2^-10, 10 bits lost.
+    half r = same((half)0.03125f) + diff((half)1.0009765625f, (half)1.0f);
+    printf("%f\n", (float)r);
+    return 0;
+}
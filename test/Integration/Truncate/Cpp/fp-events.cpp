@@ -0,0 +1,39 @@
+// clang-format off
+// RUN: %clang -O2 -g %s -o %t.a.out %linkRaptorRT %loadClangPluginRaptor -lm && RAPTOR_FP_EVENTS_REPORT=%t.csv %t.a.out 2> %t.err && FileCheck %s < %t.csv && FileCheck %s --check-prefix=STDERR < %t.err
+
+// CHECK: site,op,overflow,underflow,nan,first
+// CHECK-NEXT: "{{.*}}fp-events.cpp:[[@LINE+16]]{{.*}}",fmul,3,0,0,overflow
+// CHECK-NEXT: "{{.*}}fp-events.cpp:[[@LINE+20]]{{.*}}",fmul,0,2,0,underflow
+// CHECK-NEXT: "{{.*}}fp-events.cpp:[[@LINE+23]]{{.*}}",fdiv,0,0,1,nan
+
+// STDERR: raptor: first overflow at {{.*}}fp-events.cpp:[[@LINE+12]]{{.*}} (fmul)
+// STDERR: raptor: first underflow at {{.*}}fp-events.cpp:[[@LINE+16]]{{.*}} (fmul)
+// STDERR: raptor: first nan at {{.*}}fp-events.cpp:[[@LINE+19]]{{.*}} (fdiv)
+
+#define FROM 64
+#define TO 1, 5, 10
+
+template <typename fty> fty *__raptor_truncate_op_func(fty *, int, int, int, int);
+
+// Out of the range of mpfr(5, 10), whose largest finite value is 65504.
+__attribute__((noinline))
+double overflow(double a, double b) {
+    return a * b;
+}
+// Below the smallest subnormal.
+__attribute__((noinline))
+double underflow(double a, double b) {
+    return a * b;
+}
+__attribute__((noinline))
+double invalid(double a, double b) {
+    return a / b;
+}
+
+int main() {
+    for (int i = 0; i < 3; i++)
+        __raptor_truncate_op_func(overflow, FROM, TO)(1e3, 1e3);
+    for (int i = 0; i < 2; i++)
+        __raptor_truncate_op_func(underflow, FROM, TO)(1e-5, 1e-5);
+    __raptor_truncate_op_func(invalid, FROM, TO)(0, 0);
+}
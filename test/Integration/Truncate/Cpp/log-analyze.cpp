@@ -0,0 +1,58 @@
+// RUN: %clang -O2 %s -o %t.a.out && %t.a.out %t.double
+// RUN: %raptorLogAnalyze -j 2 -p 80 -p 100 -o %t.hist -c %t.csv %t.double | FileCheck %s
+// RUN: FileCheck %s --check-prefix=HIST < %t.hist
+// RUN: FileCheck %s --check-prefix=CSV < %t.csv
+
+// CHECK: # {{.*}}.double: double, 11 values
+// CHECK-NEXT: zero,subnormal,inf,nan,min_exponent,max_exponent
+// CHECK-NEXT: 1,1,1,1,-1024,2
+// CHECK-NEXT: percent,exponent_bits,mantissa_bits,format
+// CHECK-NEXT: 80,3,1,mpfr(3,1)
+// CHECK-NEXT: 100,11,2,mpfr(11,2)
+
+// HIST: type double
+// HIST: count 11
+// HIST-NEXT: zero 1
+// HIST-NEXT: subnormal 1
+// HIST-NEXT: inf 1
+// HIST-NEXT: nan 1
+// HIST-NEXT: exponent 0 2
+// HIST-NEXT: exponent 1021 1
+// HIST-NEXT: exponent 1022 1
+// HIST-NEXT: exponent 1023 2
+// HIST-NEXT: exponent 1024 2
+// HIST-NEXT: exponent 1025 1
+// HIST-NEXT: exponent 2047 2
+// HIST-NEXT: trailing_zeros 50 1
+// HIST-NEXT: trailing_zeros 51 3
+// HIST-NEXT: trailing_zeros 52 3
+
+// CSV: kind,bin,count,cumulative_fraction
+// CSV-NEXT: exponent,-1024,1,0.222222222
+// CSV: exponent,-3,0,0.222222222
+// CSV-NEXT: exponent,-2,1,0.333333333
+// CSV-NEXT: exponent,-1,1,0.444444444
+// CSV-NEXT: exponent,0,2,0.666666667
+// CSV-NEXT: exponent,1,2,0.888888889
+// CSV-NEXT: exponent,2,1,1
+// CSV-NEXT: mantissa_bits,0,3,0.428571429
+// CSV-NEXT: mantissa_bits,1,3,0.857142857
+// CSV-NEXT: mantissa_bits,2,1,1
+// CSV-NEXT: mantissa_bits,3,0,1
+
+// Writes a raw double log, as RAPTOR_FLOP_LOG_PREFIX does.
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+
+int main(int argc, char **argv) {
+    double vals[] = {0.0, 1.0,    1.5,         2.0,      3.0, 0.75,
+                     -4.0, 0.3125, DBL_MIN / 4, INFINITY, NAN};
+    FILE *out = fopen(argv[1], "wb");
+    if (!out)
+        return 1;
+    fwrite(vals, sizeof(double), sizeof(vals) / sizeof(vals[0]), out);
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,32 @@
+// Without excess precision clang keeps the arithmetic in half instead of
+// promoting it to float.
+// RUN: %clang -O3 -ffloat16-excess-precision=none %s -o %t.a.out %loadClangRaptor %linkRaptorRT %includeRaptorRT -lm
+// RUN: RAPTOR_FLOP_LOG_PREFIX=%t %t.a.out && xxd %t.half | FileCheck %s
+// RUN: RAPTOR_FLOP_LOG_PREFIX=%t RAPTOR_FLOP_LOG_MODE=histogram %t.a.out && FileCheck %s --check-prefix=HIST < %t.half.hist
+
+// CHECK: 00000000: 003c 0040 0042 0040
+// CHECK-NOT: 00000010
+
+// HIST: type half
+// HIST-NEXT: exponent_bits 5
+// HIST-NEXT: mantissa_bits 10
+// HIST-NEXT: bias 15
+// HIST-NEXT: count 4
+// HIST: exponent 15 1
+// HIST-NEXT: exponent 16 3
+
+#include "raptor/raptor.h"
+#include <cstdio>
+
+// The header does not take the name.
+typedef _Float16 half;
+
+half simple_add(half a, half b) { return 2 * (a + b); }
+
+template <typename fty> fty *__raptor_log_flops(fty *);
+
+int main() {
+  half res = __raptor_log_flops(simple_add)(1, 2);
+  printf("A1 %f\n", (float)res);
+  return 0;
+}
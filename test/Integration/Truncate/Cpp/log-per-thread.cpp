@@ -0,0 +1,30 @@
+// RUN: %clang -O3 %s -o %t.a.out %loadClangRaptor %linkRaptorRT %includeRaptorRT -lm -lpthread && RAPTOR_FLOP_LOG_PER_THREAD=1 RAPTOR_FLOP_LOG_PREFIX=%t.flop_log %t.a.out && xxd %t.flop_log.double.t0 | FileCheck %s --check-prefix=T0 && xxd %t.flop_log.double.t1 | FileCheck %s --check-prefix=T1
+
+// T0: 00000000: 0000 0000 0000 f03f 0000 0000 0000 0040
+// T0: 00000010: 0000 0000 0000 0840 0000 0000 0000 0040
+// T0-NOT: 00000020
+
+// T1: 00000000: 0000 0000 0000 0840 0000 0000 0000 1040
+// T1: 00000010: 0000 0000 0000 1c40 0000 0000 0000 0040
+// T1-NOT: 00000020
+
+#include "raptor/raptor.h"
+#include <cstdio>
+#include <thread>
+
+double simple_add(double a, double b) { return 2 * (a + b); }
+
+template <typename fty> fty *__raptor_log_flops(fty *);
+
+int main() {
+  double trunc;
+
+  // The first thread to log is tagged t0.
+  trunc = __raptor_log_flops(simple_add)(1, 2);
+  printf("A1 %f\n", trunc);
+  std::thread thread([&] { trunc = __raptor_log_flops(simple_add)(3, 4); });
+  thread.join();
+  printf("A2 %f\n", trunc);
+
+  return 0;
+}
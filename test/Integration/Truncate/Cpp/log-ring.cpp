@@ -0,0 +1,35 @@
+// RUN: %clang -O3 %s -o %t.a.out %loadClangRaptor %linkRaptorRT %includeRaptorRT -lm
+// RUN: RAPTOR_FLOP_LOG_SHM=%t.ring RAPTOR_FLOP_LOG_SHM_SIZE=4096 %t.a.out
+// RUN: %raptorLogd -o %t.report %t.ring.double && FileCheck %s --check-prefix=ALL < %t.report
+// RUN: RAPTOR_FLOP_LOG_SHM=%t.ring RAPTOR_FLOP_LOG_SHM_SIZE=128 RAPTOR_FLOP_LOG_SHM_POLICY=drop %t.a.out
+// RUN: %raptorLogd -o %t.report %t.ring.double && FileCheck %s --check-prefix=DROP < %t.report
+
+// Every call logs the four operands a, b, a + b and 2. Nothing consumes the
+// ring while the program runs, so the 40 values fit into a ring of 4096 bytes
+// but only the first 16 into one of 128 bytes, the rest are dropped.
+
+// ALL: # {{.*}}.ring.double: double, dropped 0
+// ALL-NEXT: type,records,zero,subnormal,inf,nan,min_exponent,max_exponent
+// ALL-NEXT: double,40,1,0,0,0,0,3
+
+// DROP: # {{.*}}.ring.double: double, dropped 24
+// DROP-NEXT: type,records,zero,subnormal,inf,nan,min_exponent,max_exponent
+// DROP-NEXT: double,16,1,0,0,0,0,2
+
+#include "raptor/raptor.h"
+#include <cstdio>
+
+__attribute__((noinline))
+double simple_add(double a, double b) {
+    return 2 * (a + b);
+}
+
+template <typename fty> fty *__raptor_log_flops(fty *);
+
+int main() {
+    double sum = 0;
+    for (int i = 0; i < 10; i++)
+        sum += __raptor_log_flops(simple_add)(i, 1);
+    printf("sum %f\n", sum);
+    return 0;
+}
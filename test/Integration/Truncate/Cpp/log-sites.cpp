@@ -0,0 +1,32 @@
+// RUN: %clang -O3 -g %s -o %t.a.out %loadClangRaptor %linkRaptorRT %includeRaptorRT -lm && RAPTOR_FLOP_LOG_SITES=1 RAPTOR_FLOP_LOG_PREFIX=%t.flop_log %t.a.out && xxd %t.flop_log.double | FileCheck %s && FileCheck %s --check-prefix=SITES < %t.flop_log.double.sites
+
+// Records are value, site, op (fadd = 1, fmul = 3) and operand index.
+// CHECK: 00000000: 0000 0000 0000 f03f 0100 0000 0100 0000
+// CHECK: 00000010: 0000 0000 0000 0040 0100 0000 0101 0000
+// CHECK: 00000020: 0000 0000 0000 0840 0200 0000 0300 0000
+// CHECK: 00000030: 0000 0000 0000 0040 0200 0000 0301 0000
+// CHECK: 00000040: 0000 0000 0000 1c40 0100 0000 0100 0000
+
+// SITES: # record 16 bytes: double value
+// SITES: # op 1 fadd
+// SITES: # op 3 fmul
+// SITES: 1	{{.*}}log-sites.cpp:[[@LINE+6]]:
+// SITES-NEXT: 2	{{.*}}log-sites.cpp:[[@LINE+5]]:
+
+#include "raptor/raptor.h"
+#include <cstdio>
+
+double simple_add(double a, double b) { return 2 * (a + b); }
+
+template <typename fty> fty *__raptor_log_flops(fty *);
+
+int main() {
+  double trunc;
+
+  trunc = __raptor_log_flops(simple_add)(1, 2);
+  printf("A1 %f\n", trunc);
+  trunc = __raptor_log_flops(simple_add)(3, 4);
+  printf("A2 %f\n", trunc);
+
+  return 0;
+}
@@ -0,0 +1,32 @@
+// RUN: %clang -O3 %s -o %t.a.out %loadClangRaptor %linkRaptorRT %includeRaptorRT -lm
+// RUN: RAPTOR_FLOP_LOG_PAUSED=1 RAPTOR_FLOP_LOG_PREFIX=%t.window %t.a.out && xxd %t.window.double | FileCheck %s
+// RUN: RAPTOR_FLOP_LOG_PAUSED=1 RAPTOR_FLOP_LOG_SAMPLE=2 RAPTOR_FLOP_LOG_PREFIX=%t.sample %t.a.out && xxd %t.sample.double | FileCheck %s --check-prefix=SAMPLE
+
+// CHECK: 00000000: 0000 0000 0000 0840 0000 0000 0000 1040
+// CHECK: 00000010: 0000 0000 0000 1c40 0000 0000 0000 0040
+// CHECK-NOT: 00000020
+
+// SAMPLE: 00000000: 0000 0000 0000 1040 0000 0000 0000 0040
+// SAMPLE-NOT: 00000010
+
+#include "raptor/raptor.h"
+#include <cstdio>
+
+double simple_add(double a, double b) { return 2 * (a + b); }
+
+template <typename fty> fty *__raptor_log_flops(fty *);
+
+int main() {
+  double trunc;
+
+  trunc = __raptor_log_flops(simple_add)(1, 2);
+  printf("A1 %f\n", trunc);
+  __raptor_flop_log_start();
+  trunc = __raptor_log_flops(simple_add)(3, 4);
+  printf("A2 %f\n", trunc);
+  __raptor_flop_log_stop();
+  trunc = __raptor_log_flops(simple_add)(5, 6);
+  printf("A3 %f\n", trunc);
+
+  return 0;
+}
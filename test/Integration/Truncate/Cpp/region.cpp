@@ -0,0 +1,57 @@
+// clang-format off
+// RUN: %clang -O2 %s -o %t.a.out %linkRaptorRT %loadClangPluginRaptor -mllvm --raptor-truncate-count -lm && RAPTOR_REGION_REPORT=%t.csv %t.a.out && FileCheck %s < %t.csv
+
+// CHECK: region,calls,seconds,self_seconds,trunc_flops,double_flops,float_flops,half_flops,bfloat_flops,load_bytes,store_bytes,shadow_count,shadow_violations,shadow_l1_err
+// CHECK-NEXT: "inner",1,{{[^,]+}},{{[^,]+}},70,0,0,0,0,
+// CHECK-NEXT: "outer",1,{{[^,]+}},{{[^,]+}},0,70,0,0,0,
+
+#include <cstdio>
+#include <cmath>
+
+#include "../../test_utils.h"
+
+#define floatty double
+#define FROM 64
+#define TO 1, 8, 23
+
+template <typename fty> fty *__raptor_truncate_op_func(fty *, int, int, int, int);
+
+extern "C" void __raptor_region_begin(const char *name);
+extern "C" void __raptor_region_end();
+
+#define N 10
+
+__attribute__((noinline))
+floatty simple_add(floatty a, floatty b) {
+    return a + b;
+}
+__attribute__((noinline))
+floatty intrinsics(floatty a, floatty b) {
+    return sin(a) * cos(b);
+}
+__attribute__((noinline))
+floatty compute(floatty *A, floatty *B, floatty *C, int n) {
+    for (int i = 0; i < n; i++) {
+        C[i] = A[i] / 2 + intrinsics(A[i], simple_add(B[i] * 10000, 0.000001));
+    }
+    return C[0];
+}
+
+int main() {
+    floatty A[N];
+    floatty B[N];
+    floatty C[N];
+
+    for (int i = 0; i < N; i++) {
+        A[i] = 1 + i % 5;
+        B[i] = 1 + i % 3;
+    }
+
+    __raptor_region_begin("outer");
+    compute(A, B, C, N);
+    // Counted only in the innermost region.
+    __raptor_region_begin("inner");
+    __raptor_truncate_op_func(compute, FROM, TO)(A, B, C, N);
+    __raptor_region_end();
+    __raptor_region_end();
+}
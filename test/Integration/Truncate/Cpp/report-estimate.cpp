@@ -0,0 +1,62 @@
+// RUN: %clang -O2 %s -o %t.a.out %linkRaptorRT -lm -lmpfr
+// RUN: echo "peak_fp64 = 1e9 # flop/s" > %t.machine
+// RUN: echo "peak_fp32 = 4e9" >> %t.machine
+// RUN: echo "bandwidth = 1e9" >> %t.machine
+// RUN: echo "cost_div = 10" >> %t.machine
+// RUN: RAPTOR_MACHINE=%t.machine RAPTOR_ESTIMATE_TRUNCATE=fp64:fp32 RAPTOR_ESTIMATE_SCOPE=all RAPTOR_ESTIMATE_REPORT=%t.all.csv %t.a.out
+// RUN: FileCheck %s --check-prefix=ALL < %t.all.csv
+// RUN: RAPTOR_MACHINE=%t.machine RAPTOR_ESTIMATE_TRUNCATE=fp64:fp32 RAPTOR_ESTIMATE_REPORT=%t.truncated.csv %t.a.out
+// RUN: FileCheck %s --check-prefix=TRUNCATED < %t.truncated.csv
+
+// The function f does 19000 fp64 additions and 100 fp64 divisions, at 10
+// flops each, and loads 8000 bytes of fp64 data. Its loop does 4000 fp32
+// multiplications and loads 4000 bytes of fp32 data, which f includes.
+//
+// Before, f takes 20000 / 1e9 + 4000 / 4e9 = 2.1e-05 s of compute and
+// (8000 + 4000) / 1e9 = 1.2e-05 s of memory traffic. In fp32 the compute of
+// the fp64 part drops to 5e-06 s and its traffic to 4e-06 s, so f becomes
+// memory bound at 8e-06 s. The loop has no fp64 and does not change.
+
+// ALL: name,kind,function,seconds_before,bound_before,seconds_after,bound_after,speedup
+// ALL-NEXT: "f",function,"f",2.1e-05,compute,8e-06,memory,2.625
+// ALL-NEXT: "f.loop",loop,"f",4e-06,memory,4e-06,memory,1.000
+// ALL-NEXT: "total",total,,2.1e-05,,8e-06,,2.625
+
+// Nothing ran under truncation, so by default nothing changes.
+
+// TRUNCATED: name,kind,function,seconds_before,bound_before,seconds_after,bound_after,speedup
+// TRUNCATED-NEXT: "f",function,"f",2.1e-05,compute,2.1e-05,compute,1.000
+// TRUNCATED-NEXT: "f.loop",loop,"f",4e-06,memory,4e-06,memory,1.000
+// TRUNCATED-NEXT: "total",total,,2.1e-05,,2.1e-05,,1.000
+
+#include <cstdint>
+
+// Layout of the records -raptor-flop-report creates, with the counters of
+// ReportCounters.def: [fp64: addsub mul fma div sqrt math other load store]
+// [fp32: ...][fp16: ...], not truncated and truncated.
+struct Record {
+  int64_t registered;
+  const char *name;
+  Record *parent;
+  int64_t counters[2][27];
+};
+
+extern "C" void __raptor_fprt_report_block(Record *rec, const int64_t *counts);
+
+Record F = {0, "f", nullptr, {}};
+Record Loop = {0, "f.loop", &F, {}};
+
+int main() {
+  int64_t fBlock[27] = {};
+  fBlock[0] = 19000; // fp64 addsub
+  fBlock[3] = 100;   // fp64 div
+  fBlock[7] = 8000;  // fp64 load
+  int64_t loopBlock[27] = {};
+  loopBlock[9 + 1] = 4;  // fp32 mul
+  loopBlock[9 + 7] = 4;  // fp32 load
+
+  __raptor_fprt_report_block(&F, fBlock);
+  for (int i = 0; i < 1000; i++)
+    __raptor_fprt_report_block(&Loop, loopBlock);
+  return 0;
+}
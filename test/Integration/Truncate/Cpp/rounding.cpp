@@ -0,0 +1,39 @@
+// clang-format off
+// RUN: %clang -O0 %s -o %t.a.out %loadClangRaptor %linkRaptorRT -lm -lmpfr && %t.a.out
+// RUN: %clang -O2 %s -o %t.a.out %loadClangRaptor %linkRaptorRT -lm -lmpfr && %t.a.out
+
+// The rounding functions round to an integer in their own direction, not to
+// nearest like the other operations in op mode.
+
+#include <math.h>
+
+#include "../../test_utils.h"
+
+__attribute__((noinline))
+double do_floor(double a) { return floor(a); }
+__attribute__((noinline))
+double do_ceil(double a) { return ceil(a); }
+__attribute__((noinline))
+double do_round(double a) { return round(a); }
+__attribute__((noinline))
+double do_trunc(double a) { return trunc(a); }
+
+template <typename fty> fty *__raptor_truncate_op_func(fty *, int, int, int, int);
+
+#define FROM 64
+
+int main() {
+    APPROX_EQ(__raptor_truncate_op_func(do_floor, FROM, 1, 8, 23)(-2.5), -3.0, 0.0);
+    APPROX_EQ(__raptor_truncate_op_func(do_floor, FROM, 1, 8, 23)(2.5), 2.0, 0.0);
+    APPROX_EQ(__raptor_truncate_op_func(do_ceil, FROM, 1, 8, 23)(-2.5), -2.0, 0.0);
+    APPROX_EQ(__raptor_truncate_op_func(do_ceil, FROM, 1, 8, 23)(2.5), 3.0, 0.0);
+    APPROX_EQ(__raptor_truncate_op_func(do_round, FROM, 1, 8, 23)(2.5), 3.0, 0.0);
+    APPROX_EQ(__raptor_truncate_op_func(do_round, FROM, 1, 8, 23)(-2.5), -3.0, 0.0);
+    APPROX_EQ(__raptor_truncate_op_func(do_round, FROM, 1, 8, 23)(0.5), 1.0, 0.0);
+    APPROX_EQ(__raptor_truncate_op_func(do_trunc, FROM, 1, 8, 23)(-2.5), -2.0, 0.0);
+
+    // Also where the format has few bits to spare: 2.5 still fits mpfr(5,2).
+    APPROX_EQ(__raptor_truncate_op_func(do_floor, FROM, 1, 5, 2)(-2.5), -3.0, 0.0);
+    APPROX_EQ(__raptor_truncate_op_func(do_round, FROM, 1, 5, 2)(2.5), 3.0, 0.0);
+    return 0;
+}
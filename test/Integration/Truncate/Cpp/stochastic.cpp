@@ -0,0 +1,59 @@
+// clang-format off
+// RUN: %clang -O2 %s -o %t.a.out %loadClangRaptor %linkRaptorRT -lm -lmpfr
+// RUN: RAPTOR_SR_SEED=42 %t.a.out > %t.first
+// RUN: RAPTOR_SR_SEED=42 %t.a.out > %t.second
+// RUN: diff %t.first %t.second
+// RUN: FileCheck %s < %t.first
+
+// CHECK: bits {{[01]+}}
+// CHECK: ok
+
+// Type 2 rounds 1 + 2^-25, a quarter of an ulp of float above 1, down to 1
+// three times out of four and up to 1 + 2^-23 otherwise, so the mean stays
+// 1 + 2^-25 where rounding to nearest would always give 1. With the same
+// RAPTOR_SR_SEED two runs round the same way.
+
+#include <math.h>
+
+#include "../../test_utils.h"
+
+#define N 100000
+
+__attribute__((noinline))
+double do_add(double a, double b) { return a + b; }
+
+template <typename fty> fty *__raptor_truncate_op_func(fty *, int, int, int, int);
+
+#define FROM 64
+
+int main() {
+    volatile double one = 1.0;
+    volatile double quarter = ldexp(1.0, -25);
+    double ulp = ldexp(1.0, -23);
+
+    double sum = 0;
+    unsigned up = 0;
+    printf("bits ");
+    for (int i = 0; i < N; i++) {
+        double r = __raptor_truncate_op_func(do_add, FROM, 2, 8, 23)(one, quarter);
+        if (r != 1.0 && r != 1.0 + ulp) {
+            fprintf(stderr, "%a is not a neighbour of 1 + 2^-25\n", r);
+            abort();
+        }
+        up += r != 1.0;
+        sum += r - 1.0;
+        if (i < 64)
+            printf("%d", r != 1.0);
+    }
+    printf("\n");
+
+    // Both neighbours come up, and the mean is unbiased to within 0.01 ulp,
+    // about seven standard deviations of the mean of N ops.
+    if (up == 0 || up == N) {
+        fprintf(stderr, "always rounded to the same neighbour\n");
+        abort();
+    }
+    APPROX_EQ(sum / N, (double)quarter, 0.01 * ulp);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,47 @@
+// RUN: %clang -O3 %s -o %t.a.out %loadClangRaptor %linkRaptorRTTrace %includeRaptorRT -lm
+// RUN: RAPTOR_TRACE_TOP=0 %t.a.out 2> %t.mem
+// RUN: FileCheck %s < %t.mem
+// RUN: RAPTOR_TRACE_SPILL=%t.trace RAPTOR_TRACE_WINDOW=1 %t.a.out
+// RUN: %raptorTraceSweep -n 0 %t.trace > %t.sweep
+// RUN: FileCheck %s < %t.sweep
+// RUN: RAPTOR_TRACE_SPILL=%t.float.trace RAPTOR_TRACE_SPILL_FLOAT=1 RAPTOR_TRACE_WINDOW=1 %t.a.out
+// RUN: %raptorTraceSweep -n 0 %t.float.trace > %t.float.sweep
+// RUN: FileCheck %s < %t.float.sweep
+// RUN: awk '/^[0-9]+ /{print $1, $4, $5, $7}' %t.mem > %t.mem.rank
+// RUN: awk '/^[0-9]+ /{print $1, $4, $5, $7}' %t.sweep > %t.sweep.rank
+// RUN: awk '/^[0-9]+ /{print $1, $4, $5, $7}' %t.float.sweep > %t.float.sweep.rank
+// RUN: diff %t.mem.rank %t.sweep.rank
+// RUN: diff %t.mem.rank %t.float.sweep.rank
+
+// The loop records 1200000 ops, more than the one chunk of 2^20 nodes the
+// window keeps, so the spilled tape has several segments and the adjoints
+// cross from one segment into the one before it.
+
+// CHECK: sensitivity of 1 outputs to truncating 1200000 ops from double to float, top 2 of 2 sites
+// CHECK-NEXT: rank sensitivity max ops op location
+// CHECK-NEXT: 1 {{[0-9.]+}}e-08 {{[0-9.]+}}e-08 600000 fadd at
+// CHECK-NEXT: 2 {{[0-9.]+}}e-{{09|10}} {{[0-9.]+}}e-{{09|10}} 600000 fmul at
+
+#include "raptor/raptor.h"
+#include <cstdio>
+
+#define FROM 64
+#define TO 1, 8, 23
+
+double step(double acc, double y) { return acc * y + 1; }
+
+template <typename fty>
+fty *__raptor_truncate_mem_func(fty *, int, int, int, int);
+extern double __raptor_truncate_mem_value(...);
+extern double __raptor_expand_mem_value(...);
+
+int main() {
+  double acc = __raptor_truncate_mem_value(1.0, FROM, TO);
+  double y = __raptor_truncate_mem_value(0.1, FROM, TO);
+  for (int i = 0; i < 600000; i++)
+    acc = __raptor_truncate_mem_func(step, FROM, TO)(acc, y);
+  double res = __raptor_expand_mem_value(acc, FROM, TO);
+  fprintf(stderr, "res %f\n", res);
+  __raptor_fprt_delete_all();
+  return 0;
+}
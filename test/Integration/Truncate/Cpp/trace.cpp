@@ -0,0 +1,37 @@
+// RUN: %clang -O3 %s -o %t.a.out %loadClangRaptor %linkRaptorRTTrace %includeRaptorRT -lm
+// RUN: %t.a.out 2>&1 | FileCheck %s
+// RUN: RAPTOR_TRACE_TOP=1 %t.a.out 2>&1 | FileCheck %s --check-prefix=TOP
+
+// CHECK: res 0.600000
+// CHECK: raptor: sensitivity of 1 outputs to truncating 2 ops from double to float, top 2 of 2 sites
+// CHECK-NEXT: rank sensitivity max ops op location
+// CHECK-NEXT: 1 2.384{{[0-9]+}}e-08 2.384{{[0-9]+}}e-08 1 {{[a-z]+}} at
+// CHECK-NEXT: 2 2.384{{[0-9]+}}e-08 2.384{{[0-9]+}}e-08 1 {{[a-z]+}} at
+
+// TOP: top 1 of 2 sites
+// TOP-NEXT: rank
+// TOP-NEXT: 1 {{.*}} at
+// TOP-NOT: {{^}}2
+
+#include "raptor/raptor.h"
+#include <cstdio>
+
+#define FROM 64
+#define TO 1, 8, 23
+
+double scale(double x, double y) { return 2 * (x * y); }
+
+template <typename fty>
+fty *__raptor_truncate_mem_func(fty *, int, int, int, int);
+extern double __raptor_truncate_mem_value(...);
+extern double __raptor_expand_mem_value(...);
+
+int main() {
+  double a = __raptor_truncate_mem_value(3.0, FROM, TO);
+  double b = __raptor_truncate_mem_value(0.1, FROM, TO);
+  double res = __raptor_expand_mem_value(
+      __raptor_truncate_mem_func(scale, FROM, TO)(a, b), FROM, TO);
+  fprintf(stderr, "res %f\n", res);
+  __raptor_fprt_delete_all();
+  return 0;
+}
@@ -0,0 +1,41 @@
+; RUN: %opt %s %newLoadRaptor -passes="raptor" -raptor-truncate-access-count -S | FileCheck %s
+
+define void @f(ptr %a, ptr %b, ptr %n, i1 %c) {
+entry:
+  %x = load double, ptr %a, align 8
+  %y = load double, ptr %b, align 8
+  %i = load i64, ptr %n, align 8
+  %v = load <4 x float>, ptr %b, align 16
+  %z = fadd double %x, %y
+  store double %z, ptr %a, align 8
+  store i64 %i, ptr %n, align 8
+  br i1 %c, label %then, label %exit
+
+then:
+  store float 1.0, ptr %b, align 4
+  br label %exit
+
+exit:
+  %p = load ptr, ptr %n, align 8
+  ret void
+}
+
+; CHECK: define void @f(ptr %a, ptr %b, ptr %n, i1 %c) {
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   %x = load double, ptr %a, align 8
+; CHECK-NEXT:   %y = load double, ptr %b, align 8
+; CHECK-NEXT:   %i = load i64, ptr %n, align 8
+; CHECK-NEXT:   %v = load <4 x float>, ptr %b, align 16
+; CHECK-NEXT:   %z = fadd double %x, %y
+; CHECK-NEXT:   store double %z, ptr %a, align 8
+; CHECK-NEXT:   store i64 %i, ptr %n, align 8
+; CHECK-NEXT:   call void @__raptor_fprt_memory_access_block(i64 32, i64 8)
+; CHECK-NEXT:   br i1 %c, label %then, label %exit
+; CHECK: then:
+; CHECK-NEXT:   store float 1.000000e+00, ptr %b, align 4
+; CHECK-NEXT:   call void @__raptor_fprt_memory_access_block(i64 0, i64 4)
+; CHECK-NEXT:   br label %exit
+; CHECK: exit:
+; CHECK-NEXT:   %p = load ptr, ptr %n, align 8
+; CHECK-NEXT:   ret void
+; CHECK-NEXT: }
@@ -0,0 +1,28 @@
+; RUN: %opt %s %newLoadRaptor -passes="raptor" -raptor-truncate-access-trace -S | FileCheck %s
+
+define void @f(ptr %a, ptr %b, ptr %n) {
+entry:
+  %p = getelementptr inbounds double, ptr %a, i64 4
+  %x = load double, ptr %p, align 8
+  %i = load i64, ptr %n, align 8
+  %v = load <4 x float>, ptr %b, align 16
+  store double %x, ptr %b, align 8
+  store i64 %i, ptr %n, align 8
+  ret void
+}
+
+; CHECK: @[[NAME:.+]] = private unnamed_addr constant [2 x i8] c"f\00"
+
+; CHECK: define void @f(ptr %a, ptr %b, ptr %n) {
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   %p = getelementptr inbounds double, ptr %a, i64 4
+; CHECK-NEXT:   call void @__raptor_fprt_memory_trace(ptr %p, i64 8, i64 0, i64 64, ptr %a, ptr @[[NAME]])
+; CHECK-NEXT:   %x = load double, ptr %p, align 8
+; CHECK-NEXT:   %i = load i64, ptr %n, align 8
+; CHECK-NEXT:   call void @__raptor_fprt_memory_trace(ptr %b, i64 16, i64 0, i64 32, ptr %b, ptr @[[NAME]])
+; CHECK-NEXT:   %v = load <4 x float>, ptr %b, align 16
+; CHECK-NEXT:   call void @__raptor_fprt_memory_trace(ptr %b, i64 8, i64 1, i64 64, ptr %b, ptr @[[NAME]])
+; CHECK-NEXT:   store double %x, ptr %b, align 8
+; CHECK-NEXT:   store i64 %i, ptr %n, align 8
+; CHECK-NEXT:   ret void
+; CHECK-NEXT: }
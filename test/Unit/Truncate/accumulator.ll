@@ -0,0 +1,83 @@
+; RUN: %opt %s %newLoadRaptor -passes="raptor" -S | FileCheck %s
+
+define double @dot(ptr %a, ptr %b, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi double [ 0.0, %entry ], [ %acc.next, %loop ]
+  %sum = phi double [ 0.0, %entry ], [ %sum.next, %loop ]
+  %pa = getelementptr inbounds double, ptr %a, i64 %i
+  %pb = getelementptr inbounds double, ptr %b, i64 %i
+  %x = load double, ptr %pa
+  %y = load double, ptr %pb
+  %acc.next = call double @llvm.fmuladd.f64(double %x, double %y, double %acc)
+  %xy = fadd double %x, %y
+  %sum.next = fadd double %xy, %sum
+  %i.next = add i64 %i, 1
+  %cmp = icmp ult i64 %i.next, %n
+  br i1 %cmp, label %loop, label %exit
+
+exit:
+  %r = fsub double %acc.next, %sum.next
+  ret double %r
+}
+
+; A reduction through a chain of two adds, both accumulate.
+define double @chain(ptr %a, i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %p = phi double [ 0.0, %entry ], [ %t2, %loop ]
+  %pa = getelementptr inbounds double, ptr %a, i64 %i
+  %x = load double, ptr %pa
+  %y = fmul double %x, %x
+  %t1 = fadd double %p, %x
+  %t2 = fsub double %t1, %y
+  %i.next = add i64 %i, 1
+  %cmp = icmp ult i64 %i.next, %n
+  br i1 %cmp, label %loop, label %exit
+
+exit:
+  %r = fadd double %t1, %t2
+  ret double %r
+}
+
+declare double @llvm.fmuladd.f64(double, double, double)
+
+declare ptr @__raptor_truncate_op_func(...)
+
+define double @tester(ptr %a, ptr %b, i64 %n) {
+entry:
+  %ptr = call ptr (...) @__raptor_truncate_op_func(ptr @dot, i64 64, i64 1, i64 5, i64 10, i64 8, i64 23)
+  %r = call double %ptr(ptr %a, ptr %b, i64 %n)
+  ret double %r
+}
+
+define double @tester2(ptr %a, i64 %n) {
+entry:
+  %ptr = call ptr (...) @__raptor_truncate_op_func(ptr @chain, i64 64, i64 1, i64 5, i64 10, i64 8, i64 23)
+  %r = call double %ptr(ptr %a, i64 %n)
+  ret double %r
+}
+
+; CHECK: define double @tester(ptr %a, ptr %b, i64 %n) {
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   %r = call double @__raptor_done_truncate_op_func_ieee_64_to_mpfr_5_10_acc_mpfr_8_23_1_1_0_dot(ptr %a, ptr %b, i64 %n)
+
+; The accumulator widths come before the operand widths, only the reduction
+; and the fmuladd accumulate.
+; CHECK: define internal double @__raptor_done_truncate_op_func_ieee_64_to_mpfr_5_10_acc_mpfr_8_23_1_1_0_dot(
+; CHECK:   call double @__raptor_fprt_ieee_64_intr_llvm_fmuladd_f64_acc(double %x, double %y, double %acc, i64 8, i64 23, i64 5, i64 10, i64 2,
+; CHECK:   %xy = call double @__raptor_fprt_ieee_64_binop_fadd(double %x, double %y, i64 5, i64 10, i64 2,
+; CHECK:   %sum.next = call double @__raptor_fprt_ieee_64_binop_fadd_acc(double %xy, double %sum, i64 8, i64 23, i64 5, i64 10, i64 2,
+; CHECK:   %r = call double @__raptor_fprt_ieee_64_binop_fsub(double %{{.*}}, double %sum.next, i64 5, i64 10, i64 2,
+
+; CHECK: define internal double @__raptor_done_truncate_op_func_ieee_64_to_mpfr_5_10_acc_mpfr_8_23_1_1_0_chain(
+; CHECK:   %y = call double @__raptor_fprt_ieee_64_binop_fmul(double %x, double %x, i64 5, i64 10, i64 2,
+; CHECK:   %t1 = call double @__raptor_fprt_ieee_64_binop_fadd_acc(double %p, double %x, i64 8, i64 23, i64 5, i64 10, i64 2,
+; CHECK:   %t2 = call double @__raptor_fprt_ieee_64_binop_fsub_acc(double %t1, double %y, i64 8, i64 23, i64 5, i64 10, i64 2,
+; CHECK:   %r = call double @__raptor_fprt_ieee_64_binop_fadd(double %t1, double %t2, i64 5, i64 10, i64 2,
@@ -0,0 +1,66 @@
+; RUN: %opt %s %newLoadRaptor -passes="raptor" -raptor-cancellation-count=4 -S | FileCheck %s
+
+define double @f(double %a, double %b, float %c) {
+entry:
+  %s = fsub double %a, %b
+  %m = fmul double %s, %a
+  %t = fadd float %c, %c
+  %e = fpext float %t to double
+  %r = fadd double %m, %e
+  ret double %r
+}
+
+; x - x of a half below 2^-4 has an exponent field below the 11 bits of its
+; significand, the zero result still counts as a total cancellation.
+define half @g(half %x) {
+entry:
+  %d = fsub half %x, %x
+  ret half %d
+}
+
+; CHECK: define double @f(double %a, double %b, float %c) {
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   %s = fsub double %a, %b
+; CHECK-NEXT:   %[[A:.+]] = bitcast double %a to i64
+; CHECK-NEXT:   %[[AS:.+]] = lshr i64 %[[A]], 52
+; CHECK-NEXT:   %[[AE:.+]] = and i64 %[[AS]], 2047
+; CHECK-NEXT:   %[[B:.+]] = bitcast double %b to i64
+; CHECK-NEXT:   %[[BS:.+]] = lshr i64 %[[B]], 52
+; CHECK-NEXT:   %[[BE:.+]] = and i64 %[[BS]], 2047
+; CHECK-NEXT:   %[[MAX:.+]] = call i64 @llvm.umax.i64(i64 %[[AE]], i64 %[[BE]])
+; CHECK-NEXT:   %[[S:.+]] = bitcast double %s to i64
+; CHECK-NEXT:   %[[SS:.+]] = lshr i64 %[[S]], 52
+; CHECK-NEXT:   %[[SE:.+]] = and i64 %[[SS]], 2047
+; CHECK-NEXT:   %[[DIFF:.+]] = sub i64 %[[MAX]], %[[SE]]
+; CHECK-NEXT:   %[[TINY:.+]] = icmp eq i64 %[[SE]], 0
+; CHECK-NEXT:   %[[NONZERO:.+]] = icmp ne i64 %[[MAX]], 0
+; CHECK-NEXT:   %[[TOTAL:.+]] = and i1 %[[TINY]], %[[NONZERO]]
+; CHECK-NEXT:   %[[LOST:.+]] = select i1 %[[TOTAL]], i64 53, i64 %[[DIFF]]
+; CHECK-NEXT:   %[[COND:.+]] = icmp sge i64 %[[LOST]], 4
+; CHECK-NEXT:   br i1 %[[COND]], label %[[THEN:.+]], label %[[TAIL:.+]], !prof
+
+; CHECK: [[THEN]]:
+; CHECK-NEXT:   call void @__raptor_fprt_cancellation(i64 %[[LOST]], i64 52, ptr @[[LOC:.+]])
+; CHECK-NEXT:   br label %[[TAIL]]
+
+; CHECK: [[TAIL]]:
+; CHECK-NEXT:   %m = fmul double %s, %a
+; CHECK-NEXT:   %t = fadd float %c, %c
+; CHECK:        icmp sge i32 %{{.+}}, 4
+; CHECK:        call void @__raptor_fprt_cancellation(i64 %{{.+}}, i64 23, ptr @[[LOC]])
+; CHECK:        %r = fadd double %m, %e
+; CHECK:        call void @__raptor_fprt_cancellation(i64 %{{.+}}, i64 52, ptr @[[LOC]])
+; CHECK:        ret double
+
+; CHECK: define half @g(half %x) {
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   %d = fsub half %x, %x
+; CHECK:        %[[DE:.+]] = and i16 %{{.+}}, 31
+; CHECK-NEXT:   %[[DDIFF:.+]] = sub i16 %[[DMAX:.+]], %[[DE]]
+; CHECK-NEXT:   %[[DTINY:.+]] = icmp eq i16 %[[DE]], 0
+; CHECK-NEXT:   %[[DNONZERO:.+]] = icmp ne i16 %[[DMAX]], 0
+; CHECK-NEXT:   %[[DTOTAL:.+]] = and i1 %[[DTINY]], %[[DNONZERO]]
+; CHECK-NEXT:   %[[DLOST:.+]] = select i1 %[[DTOTAL]], i16 11, i16 %[[DDIFF]]
+; CHECK-NEXT:   %[[DCOND:.+]] = icmp sge i16 %[[DLOST]], 4
+; CHECK:        %[[DLOST64:.+]] = sext i16 %[[DLOST]] to i64
+; CHECK-NEXT:   call void @__raptor_fprt_cancellation(i64 %[[DLOST64]], i64 10, ptr @{{.+}})
@@ -0,0 +1,36 @@
+; RUN: %opt %s %newLoadRaptor -passes="raptor" -raptor-context-depth=3 -S | FileCheck %s
+
+define double @g(double %x) {
+  %m = fmul double %x, %x
+  ret double %m
+}
+
+define double @f(double %x) {
+  %y = call double @g(double %x)
+  %a = fadd double %y, %x
+  ret double %a
+}
+
+declare double (double)* @__raptor_truncate_op_func(...)
+
+define double @tester(double %x) {
+entry:
+  %ptr = call double (double)* (...) @__raptor_truncate_op_func(double (double)* @f, i64 64, i64 0, i64 32)
+  %r = call double %ptr(double %x)
+  ret double %r
+}
+
+; g is truncated while f is, so its name is emitted first.
+; CHECK: @[[G:.+]] = private unnamed_addr constant [2 x i8] c"g\00"
+; CHECK: @[[F:.+]] = private unnamed_addr constant [2 x i8] c"f\00"
+
+; CHECK: define internal double @__raptor_done_truncate_op_func_ieee_64_to_ieee_32_0_0_0_f(double %x) {
+; CHECK-NEXT:   %[[DEPTH:.+]] = call i64 @__raptor_fprt_ctx_enter(ptr @[[F]], i64 3)
+; CHECK-NEXT:   %y = call double @__raptor_done_truncate_op_func_ieee_64_to_ieee_32_0_0_0_g(
+; CHECK:        call void @__raptor_fprt_ctx_exit(i64 %[[DEPTH]])
+; CHECK-NEXT:   ret double
+
+; CHECK: define internal double @__raptor_done_truncate_op_func_ieee_64_to_ieee_32_0_0_0_g(double %x) {
+; CHECK-NEXT:   %[[DEPTH:.+]] = call i64 @__raptor_fprt_ctx_enter(ptr @[[G]], i64 3)
+; CHECK:        call void @__raptor_fprt_ctx_exit(i64 %[[DEPTH]])
+; CHECK-NEXT:   ret double
@@ -0,0 +1,39 @@
+; RUN: %opt %s %newLoadRaptor -passes="raptor" -raptor-flop-report -S | FileCheck %s
+
+define double @f(ptr %x, i64 %n) {
+entry:
+  %y = load double, ptr %x, align 8
+  %m = fmul double %y, %y
+  %s = call double @llvm.fmuladd.f64(double %m, double %y, double %y)
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi float [ 0.0, %entry ], [ %acc.next, %loop ]
+  %gep = getelementptr float, ptr %x, i64 %i
+  %v = load float, ptr %gep, align 4
+  %acc.next = fadd float %acc, %v
+  %i.next = add i64 %i, 1
+  %cond = icmp ult i64 %i.next, %n
+  br i1 %cond, label %loop, label %exit
+
+exit:
+  ret double %s
+}
+
+declare double @llvm.fmuladd.f64(double, double, double)
+
+; CHECK: @[[FREC:.+]] = private global { i64, ptr, ptr, [2 x [27 x i64]] } { i64 0, ptr @{{.+}}, ptr null, [2 x [27 x i64]] zeroinitializer }
+; CHECK: @[[FBLOCK:.+]] = private unnamed_addr constant [27 x i64] [i64 0, i64 1, i64 1, i64 0, i64 0, i64 0, i64 0, i64 8, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0]
+; CHECK: @[[LREC:.+]] = private global { i64, ptr, ptr, [2 x [27 x i64]] } { i64 0, ptr @{{.+}}, ptr @[[FREC]], [2 x [27 x i64]] zeroinitializer }
+; CHECK: @[[LBLOCK:.+]] = private unnamed_addr constant [27 x i64] [i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 1, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 4, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0, i64 0]
+
+; CHECK: define double @f(ptr %x, i64 %n) {
+; CHECK: %s = call double @llvm.fmuladd.f64(double %m, double %y, double %y)
+; CHECK-NEXT: call void @__raptor_fprt_report_block(ptr @[[FREC]], ptr @[[FBLOCK]])
+; CHECK-NEXT: br label %loop
+; CHECK: %cond = icmp ult i64 %i.next, %n
+; CHECK-NEXT: call void @__raptor_fprt_report_block(ptr @[[LREC]], ptr @[[LBLOCK]])
+; CHECK-NEXT: br i1 %cond, label %loop, label %exit
+; CHECK: exit:
+; CHECK-NEXT: ret double %s
@@ -0,0 +1,43 @@
+; RUN: %opt %s %newLoadRaptor -passes="raptor" -raptor-range-profile -S | FileCheck %s
+
+declare double @sqrt(double)
+
+define double @g(double %a) {
+entry:
+  %s = call double @sqrt(double %a)
+  ret double %s
+}
+
+define float @f(ptr %x, double %b) {
+entry:
+  %a = load float, ptr %x
+  %m = fmul float %a, %a
+  %c = call double @g(double %b)
+  %t = fptrunc double %c to float
+  %r = fadd float %m, %t
+  ret float %r
+}
+
+; CHECK: @[[G:.+]] = private unnamed_addr constant [2 x i8] c"g\00"
+; CHECK: @[[F:.+]] = private unnamed_addr constant [2 x i8] c"f\00"
+
+; CHECK: define double @g(double %a) {
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   %s = call double @sqrt(double %a)
+; CHECK-NEXT:   call void @__raptor_fprt_range_profile(double %s, i64 11, i64 52, ptr @[[G]])
+; CHECK-NEXT:   ret double %s
+
+; CHECK: define float @f(ptr %x, double %b) {
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   %a = load float, ptr %x
+; CHECK-NEXT:   %[[AE:.+]] = fpext float %a to double
+; CHECK-NEXT:   call void @__raptor_fprt_range_profile(double %[[AE]], i64 8, i64 23, ptr @[[F]])
+; CHECK-NEXT:   %m = fmul float %a, %a
+; CHECK-NEXT:   %[[ME:.+]] = fpext float %m to double
+; CHECK-NEXT:   call void @__raptor_fprt_range_profile(double %[[ME]], i64 8, i64 23, ptr @[[F]])
+; CHECK-NEXT:   %c = call double @g(double %b)
+; CHECK-NEXT:   %t = fptrunc double %c to float
+; CHECK-NEXT:   %r = fadd float %m, %t
+; CHECK-NEXT:   %[[RE:.+]] = fpext float %r to double
+; CHECK-NEXT:   call void @__raptor_fprt_range_profile(double %[[RE]], i64 8, i64 23, ptr @[[F]])
+; CHECK-NEXT:   ret float %r
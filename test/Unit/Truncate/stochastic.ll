@@ -0,0 +1,37 @@
+; RUN: %opt %s %newLoadRaptor -passes="raptor" -S | FileCheck %s
+
+define double @f(double %x) {
+  %m = fmul double %x, %x
+  ret double %m
+}
+
+declare double (double)* @__raptor_truncate_op_func(...)
+
+define double @tester(double %x) {
+entry:
+  %ptr = call double (double)* (...) @__raptor_truncate_op_func(double (double)* @f, i64 64, i64 2, i64 8, i64 7)
+  %r = call double %ptr(double %x)
+  ret double %r
+}
+
+define double @tester_nearest(double %x) {
+entry:
+  %ptr = call double (double)* (...) @__raptor_truncate_op_func(double (double)* @f, i64 64, i64 1, i64 8, i64 7)
+  %r = call double %ptr(double %x)
+  ret double %r
+}
+
+; CHECK: define double @tester(double %x) {
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   %r = call double @__raptor_done_truncate_op_func_ieee_64_to_mpfrsr_8_7_1_1_0_f(double %x)
+
+; CHECK: define double @tester_nearest(double %x) {
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   %r = call double @__raptor_done_truncate_op_func_ieee_64_to_mpfr_8_7_1_1_0_f(double %x)
+
+; The stochastic rounding flag is or'ed into the op mode.
+; CHECK: define internal double @__raptor_done_truncate_op_func_ieee_64_to_mpfrsr_8_7_1_1_0_f(double %x) {
+; CHECK:   call double @__raptor_fprt_ieee_64_binop_fmul(double %x, double %x, i64 8, i64 7, i64 10,
+
+; CHECK: define internal double @__raptor_done_truncate_op_func_ieee_64_to_mpfr_8_7_1_1_0_f(double %x) {
+; CHECK:   call double @__raptor_fprt_ieee_64_binop_fmul(double %x, double %x, i64 8, i64 7, i64 2,
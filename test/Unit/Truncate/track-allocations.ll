@@ -0,0 +1,51 @@
+; RUN: %opt %s %newLoadRaptor -passes="raptor" -raptor-track-allocations -S | FileCheck %s
+
+declare ptr @malloc(i64)
+declare ptr @calloc(i64, i64)
+declare ptr @realloc(ptr, i64)
+declare void @free(ptr)
+
+define void @f(i64 %n) {
+entry:
+  %a = call ptr @malloc(i64 %n)
+  %b = call ptr @calloc(i64 %n, i64 8)
+  call void @free(ptr %a)
+  call void @free(ptr %b)
+  ret void
+}
+
+define double @g(ptr %p, i64 %n) {
+entry:
+  %q = call ptr @realloc(ptr %p, i64 %n)
+  %x = load double, ptr %q
+  store double %x, ptr %p
+  ret double %x
+}
+
+; CHECK: @[[LOC:.+]] = private unnamed_addr constant [12 x i8] c"unknown:0:0\00"
+
+; CHECK: define void @f(i64 %n) {
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   %a = call ptr @malloc(i64 %n)
+; CHECK-NEXT:   call void @__raptor_fprt_alloc(ptr %a, i64 %n, ptr @[[LOC]])
+; CHECK-NEXT:   %b = call ptr @calloc(i64 %n, i64 8)
+; CHECK-NEXT:   %[[SIZE:.+]] = mul i64 %n, 8
+; CHECK-NEXT:   call void @__raptor_fprt_alloc(ptr %b, i64 %[[SIZE]], ptr @[[LOC]])
+; CHECK-NEXT:   call void @__raptor_fprt_free(ptr %a)
+; CHECK-NEXT:   call void @free(ptr %a)
+; CHECK-NEXT:   call void @__raptor_fprt_free(ptr %b)
+; CHECK-NEXT:   call void @free(ptr %b)
+; CHECK-NEXT:   ret void
+; CHECK-NEXT: }
+
+; The old block is only replaced once realloc succeeded.
+; CHECK: define double @g(ptr %p, i64 %n) {
+; CHECK-NEXT: entry:
+; CHECK-NEXT:   %q = call ptr @realloc(ptr %p, i64 %n)
+; CHECK-NEXT:   call void @__raptor_fprt_realloc(ptr %p, ptr %q, i64 %n, ptr @[[LOC]])
+; CHECK-NEXT:   call void @__raptor_fprt_alloc_access(ptr %q, i64 8, i64 0)
+; CHECK-NEXT:   %x = load double, ptr %q
+; CHECK-NEXT:   call void @__raptor_fprt_alloc_access(ptr %p, i64 8, i64 1)
+; CHECK-NEXT:   store double %x, ptr %p
+; CHECK-NEXT:   ret double %x
+; CHECK-NEXT: }
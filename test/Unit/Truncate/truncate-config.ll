@@ -0,0 +1,22 @@
+; RUN: printf '# from the range profile\nf ieee(64)-mpfr(5,10)\n# g ieee(64)-mpfr(11,52)\n' > %t.cfg
+; RUN: %opt %s %newLoadRaptor -passes="raptor" -raptor-truncate-config=%t.cfg -S | FileCheck %s
+
+define double @f(double %x) {
+  %m = fmul double %x, %x
+  ret double %m
+}
+
+define double @g(double %x) {
+  %y = call double @f(double %x)
+  %a = fadd double %y, %x
+  ret double %a
+}
+
+; CHECK: define double @f(double %x) {
+; CHECK:   call double @__raptor_fprt_ieee_64_binop_fmul(double %x, double %x, i64 5, i64 10, i64 6,
+; CHECK:   ret double
+
+; CHECK: define double @g(double %x) {
+; CHECK-NEXT:   %y = call double @f(double %x)
+; CHECK-NEXT:   %a = fadd double %y, %x
+; CHECK-NEXT:   ret double %a
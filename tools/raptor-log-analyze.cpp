@@ -0,0 +1,524 @@
+//===- raptor-log-analyze.cpp - Streaming analyzer for raw flop logs ------===//
+//
+//                             Raptor Project
+//
+// Part of the Raptor Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Computes the exponent and mantissa statistics of raw flop logs (written with
+// RAPTOR_FLOP_LOG_PREFIX, with or without RAPTOR_FLOP_LOG_SITES) of any size.
+// The log is memory mapped and split into chunks that a pool of threads works
+// through, so nothing but the histograms is ever held in memory.
+//
+//   raptor-log-analyze [-j <threads>] [-p <percent>]... [-t <type>]
+//                      [-r <record bytes>] [-o <histogram>] [-c <csv>] <log>...
+//
+// For every log we print the value counts, the exponent range and, for every
+// -p (default 99, 99.9 and 100), the fewest exponent and mantissa bits of a
+// format that represents that percentage of the values: the exponent bits
+// cover the exponents of the finite nonzero values within the normal range of
+// the narrower format, the mantissa bits hold all significant bits of the
+// normal values. Zeros are always covered, infinities and NaNs are ignored.
+//
+// The type and the record size are taken from the site table next to the log
+// or from the type in its name, e.g. run.double, unless given with -t and -r.
+// -o writes the histogram in the format of RAPTOR_FLOP_LOG_MODE=histogram, so
+// scripts/raptor_plot_float_histogram.py can plot it, -c writes the exponent
+// and mantissa distributions as CSV. Both need a single log.
+//
+//===----------------------------------------------------------------------===//
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct TypeInfo {
+  const char *name;
+  unsigned bytes;
+  unsigned exponentBits;
+  unsigned mantissaBits;
+};
+
+const TypeInfo Types[] = {{"double", 8, 11, 52},
+                          {"float", 4, 8, 23},
+                          {"half", 2, 5, 10},
+                          {"bfloat", 2, 8, 7}};
+
+const TypeInfo *findType(const std::string &name) {
+  for (auto &type : Types)
+    if (name == type.name)
+      return &type;
+  return nullptr;
+}
+
+// Histograms of one log, or of the part a thread has seen.
+struct Stats {
+  uint64_t count = 0;
+  uint64_t zero = 0;
+  uint64_t subnormal = 0;
+  uint64_t inf = 0;
+  uint64_t nan = 0;
+  // Indexed by the biased exponent field, as in the runtime's histograms.
+  uint64_t exponent[1 << 11] = {};
+  // Subnormals by the position of their leading mantissa bit.
+  uint64_t subnormalLead[64] = {};
+  // Normal values by the number of trailing zero bits of the mantissa.
+  uint64_t trailingZeros[64] = {};
+
+  void add(const Stats &other) {
+    count += other.count;
+    zero += other.zero;
+    subnormal += other.subnormal;
+    inf += other.inf;
+    nan += other.nan;
+    for (unsigned i = 0; i < std::size(exponent); ++i)
+      exponent[i] += other.exponent[i];
+    for (unsigned i = 0; i < 64; ++i) {
+      subnormalLead[i] += other.subnormalLead[i];
+      trailingZeros[i] += other.trailingZeros[i];
+    }
+  }
+};
+
+// Values are processed in blocks: the exponent fields of a whole block are
+// extracted first, in a loop without branches the compiler vectorizes, and
+// only then counted. Consecutive values mostly share their exponent, so the
+// counts go to NumLanes interleaved copies of the histograms to keep the
+// increments of one bin from waiting on each other.
+constexpr size_t BlockSize = 1024;
+constexpr unsigned NumLanes = 4;
+
+template <typename IntTy, unsigned ExponentBits, unsigned MantissaBits>
+class Scanner {
+  static constexpr unsigned MaxExponent = (1u << ExponentBits) - 1;
+  static constexpr IntTy MantissaMask = ((IntTy)1 << MantissaBits) - 1;
+
+  uint64_t exponent[NumLanes][MaxExponent + 1] = {};
+  uint64_t trailingZeros[NumLanes][MantissaBits + 1] = {};
+  Stats special;
+
+  void block(const IntTy *bits, size_t n) {
+    uint16_t exps[BlockSize];
+    for (size_t i = 0; i < n; ++i)
+      exps[i] = (bits[i] >> MantissaBits) & MaxExponent;
+    for (size_t i = 0; i < n; ++i) {
+      unsigned lane = i % NumLanes;
+      unsigned exp = exps[i];
+      IntTy man = bits[i] & MantissaMask;
+      ++exponent[lane][exp];
+      if (exp != 0 && exp != MaxExponent) {
+        ++trailingZeros[lane][man ? __builtin_ctzll(man) : MantissaBits];
+      } else if (exp == MaxExponent) {
+        ++(man ? special.nan : special.inf);
+      } else if (man) {
+        ++special.subnormal;
+        ++special.subnormalLead[63 - __builtin_clzll(man)];
+      } else {
+        ++special.zero;
+      }
+    }
+  }
+
+public:
+  // Records of stride bytes, with the value at their start.
+  void scan(const char *data, size_t n, size_t stride) {
+    IntTy bits[BlockSize];
+    while (n) {
+      size_t m = std::min(n, BlockSize);
+      if (stride == sizeof(IntTy)) {
+        block((const IntTy *)data, m);
+      } else {
+        for (size_t i = 0; i < m; ++i)
+          memcpy(&bits[i], data + i * stride, sizeof(IntTy));
+        block(bits, m);
+      }
+      data += m * stride;
+      n -= m;
+      special.count += m;
+    }
+  }
+
+  void collect(Stats &res) {
+    res.add(special);
+    for (unsigned lane = 0; lane < NumLanes; ++lane) {
+      for (unsigned i = 0; i <= MaxExponent; ++i)
+        res.exponent[i] += exponent[lane][i];
+      for (unsigned i = 0; i <= MantissaBits; ++i)
+        res.trailingZeros[i] += trailingZeros[lane][i];
+    }
+  }
+};
+
+template <typename IntTy, unsigned ExponentBits, unsigned MantissaBits>
+void scanChunks(const char *data, size_t records, size_t stride,
+                size_t chunkRecords, unsigned threads, Stats &res) {
+  size_t numChunks = (records + chunkRecords - 1) / chunkRecords;
+  std::atomic<size_t> next{0};
+  std::vector<Stats> partial(threads);
+  auto work = [&](unsigned t) {
+    auto scanner =
+        std::make_unique<Scanner<IntTy, ExponentBits, MantissaBits>>();
+    for (size_t c; (c = next.fetch_add(1)) < numChunks;) {
+      size_t first = c * chunkRecords;
+      size_t n = std::min(chunkRecords, records - first);
+      const char *start = data + first * stride;
+      scanner->scan(start, n, stride);
+      // Done with these pages, do not let them pile up in our address space.
+      size_t page = sysconf(_SC_PAGESIZE);
+      uintptr_t from = ((uintptr_t)start + page - 1) / page * page;
+      uintptr_t to = ((uintptr_t)start + n * stride) / page * page;
+      if (to > from)
+        madvise((void *)from, to - from, MADV_DONTNEED);
+    }
+    scanner->collect(partial[t]);
+  };
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; ++t)
+    pool.emplace_back(work, t);
+  work(0);
+  for (auto &thread : pool)
+    thread.join();
+  for (auto &p : partial)
+    res.add(p);
+}
+
+// The narrowest format that represents percent of the values.
+struct Requirement {
+  double percent;
+  unsigned exponentBits;
+  unsigned mantissaBits;
+};
+
+class Analysis {
+  const TypeInfo &type;
+  const Stats &stats;
+  int bias;
+  // Unbiased exponent of the finite nonzero values, offset by Offset.
+  static constexpr int Offset = 1 << 11;
+  std::vector<uint64_t> byExponent;
+
+public:
+  int minExponent = INT32_MAX;
+  int maxExponent = INT32_MIN;
+
+  Analysis(const TypeInfo &type, const Stats &stats)
+      : type(type), stats(stats), bias((1 << (type.exponentBits - 1)) - 1),
+        byExponent(2 * Offset) {
+    for (unsigned e = 1; e + 1 < (1u << type.exponentBits); ++e)
+      addExponent((int)e - bias, stats.exponent[e]);
+    // A subnormal with its leading bit at position l is 2^(l - m) 2^(1-bias).
+    for (unsigned l = 0; l < type.mantissaBits; ++l)
+      addExponent(1 - bias - (int)(type.mantissaBits - l),
+                  stats.subnormalLead[l]);
+  }
+
+  void addExponent(int e, uint64_t n) {
+    if (!n)
+      return;
+    byExponent[e + Offset] += n;
+    minExponent = std::min(minExponent, e);
+    maxExponent = std::max(maxExponent, e);
+  }
+
+  uint64_t finite() const { return stats.count - stats.inf - stats.nan; }
+
+  uint64_t normal() const {
+    return finite() - stats.zero - stats.subnormal;
+  }
+
+  // Finite values with unbiased exponents in [lo, hi], zeros included.
+  uint64_t covered(int lo, int hi) const {
+    uint64_t n = stats.zero;
+    for (int e = std::max(lo, minExponent); e <= std::min(hi, maxExponent); ++e)
+      n += byExponent[e + Offset];
+    return n;
+  }
+
+  Requirement require(double percent) const {
+    Requirement res = {percent, type.exponentBits, type.mantissaBits};
+    double needed = percent / 100 * finite();
+    for (unsigned e = 2; e <= type.exponentBits; ++e) {
+      int max = (1 << (e - 1)) - 1;
+      if (covered(1 - max, max) >= needed) {
+        res.exponentBits = e;
+        break;
+      }
+    }
+    needed = percent / 100 * normal();
+    uint64_t n = 0;
+    for (unsigned m = 0; m <= type.mantissaBits; ++m) {
+      n += stats.trailingZeros[type.mantissaBits - m];
+      if (n >= needed) {
+        res.mantissaBits = m;
+        break;
+      }
+    }
+    return res;
+  }
+
+  void writeCSV(FILE *out) const {
+    fprintf(out, "kind,bin,count,cumulative_fraction\n");
+    uint64_t n = stats.zero, total = finite();
+    if (minExponent <= maxExponent) {
+      for (int e = minExponent; e <= maxExponent; ++e) {
+        n += byExponent[e + Offset];
+        fprintf(out, "exponent,%d,%llu,%.9g\n", e,
+                (unsigned long long)byExponent[e + Offset],
+                total ? (double)n / total : 0.0);
+      }
+    }
+    n = 0;
+    total = normal();
+    for (unsigned m = 0; m <= type.mantissaBits; ++m) {
+      uint64_t c = stats.trailingZeros[type.mantissaBits - m];
+      n += c;
+      fprintf(out, "mantissa_bits,%u,%llu,%.9g\n", m, (unsigned long long)c,
+              total ? (double)n / total : 0.0);
+    }
+  }
+
+  // The format of FloatLoggerTy::writeHistogram in runtime/ir/Log.cpp.
+  void writeHistogram(FILE *out) const {
+    fprintf(out, "# raptor flop histogram v1\n");
+    fprintf(out, "type %s\n", type.name);
+    fprintf(out, "exponent_bits %u\n", type.exponentBits);
+    fprintf(out, "mantissa_bits %u\n", type.mantissaBits);
+    fprintf(out, "bias %d\n", bias);
+    fprintf(out, "count %llu\n", (unsigned long long)stats.count);
+    fprintf(out, "zero %llu\n", (unsigned long long)stats.zero);
+    fprintf(out, "subnormal %llu\n", (unsigned long long)stats.subnormal);
+    fprintf(out, "inf %llu\n", (unsigned long long)stats.inf);
+    fprintf(out, "nan %llu\n", (unsigned long long)stats.nan);
+    for (unsigned i = 0; i < (1u << type.exponentBits); ++i)
+      if (stats.exponent[i])
+        fprintf(out, "exponent %u %llu\n", i,
+                (unsigned long long)stats.exponent[i]);
+    for (unsigned i = 0; i <= type.mantissaBits; ++i)
+      if (stats.trailingZeros[i])
+        fprintf(out, "trailing_zeros %u %llu\n", i,
+                (unsigned long long)stats.trailingZeros[i]);
+  }
+};
+
+// Type and record size from the site table written with
+// RAPTOR_FLOP_LOG_SITES=1, e.g. "# record 16 bytes: double value, ...".
+bool readSiteTable(const std::string &log, std::string &type,
+                   unsigned &recordSize) {
+  FILE *in = fopen((log + ".sites").c_str(), "r");
+  if (!in)
+    return false;
+  char line[4096];
+  char name[32];
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), in))
+    found = sscanf(line, "# record %u bytes: %31s", &recordSize, name) == 2;
+  fclose(in);
+  if (found)
+    type = name;
+  return found;
+}
+
+struct Options {
+  unsigned threads = 0;
+  std::vector<double> percents;
+  std::string type;
+  unsigned recordSize = 0;
+  const char *histogram = nullptr;
+  const char *csv = nullptr;
+};
+
+FILE *openOutput(const char *path) {
+  FILE *out = fopen(path, "w");
+  if (!out)
+    fprintf(stderr, "raptor-log-analyze: could not open '%s': %s\n", path,
+            strerror(errno));
+  return out;
+}
+
+bool analyze(const std::string &log, const Options &opts) {
+  std::string typeName = opts.type;
+  unsigned recordSize = opts.recordSize;
+  std::string siteType;
+  unsigned siteRecordSize = 0;
+  if (readSiteTable(log, siteType, siteRecordSize)) {
+    if (typeName.empty())
+      typeName = siteType;
+    if (!recordSize)
+      recordSize = siteRecordSize;
+  }
+  if (typeName.empty())
+    typeName = log.substr(log.rfind('.') + 1);
+  const TypeInfo *type = findType(typeName);
+  if (!type) {
+    fprintf(stderr,
+            "raptor-log-analyze: %s: cannot tell the type of the log, use "
+            "-t double|float|half|bfloat\n",
+            log.c_str());
+    return false;
+  }
+  if (!recordSize)
+    recordSize = type->bytes;
+  if (recordSize < type->bytes) {
+    fprintf(stderr, "raptor-log-analyze: %s: records of %u bytes cannot hold "
+                    "a %s\n",
+            log.c_str(), recordSize, type->name);
+    return false;
+  }
+
+  int fd = open(log.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "raptor-log-analyze: could not open '%s': %s\n",
+            log.c_str(), strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    return false;
+  }
+  size_t records = st.st_size / recordSize;
+  if (st.st_size % recordSize)
+    fprintf(stderr, "raptor-log-analyze: %s: ignoring a partial record at "
+                    "the end\n",
+            log.c_str());
+
+  Stats stats;
+  if (records) {
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      fprintf(stderr, "raptor-log-analyze: could not map '%s': %s\n",
+              log.c_str(), strerror(errno));
+      close(fd);
+      return false;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    // Enough chunks to balance the threads, large enough to stream.
+    size_t chunkRecords = std::max<size_t>((64 << 20) / recordSize, 1);
+    const char *data = (const char *)map;
+    if (type->bytes == 8)
+      scanChunks<uint64_t, 11, 52>(data, records, recordSize, chunkRecords,
+                                   opts.threads, stats);
+    else if (type->bytes == 4)
+      scanChunks<uint32_t, 8, 23>(data, records, recordSize, chunkRecords,
+                                  opts.threads, stats);
+    else if (type->exponentBits == 5)
+      scanChunks<uint16_t, 5, 10>(data, records, recordSize, chunkRecords,
+                                  opts.threads, stats);
+    else
+      scanChunks<uint16_t, 8, 7>(data, records, recordSize, chunkRecords,
+                                 opts.threads, stats);
+    munmap(map, st.st_size);
+  }
+  close(fd);
+
+  Analysis analysis(*type, stats);
+  printf("# %s: %s, %llu values\n", log.c_str(), type->name,
+         (unsigned long long)stats.count);
+  printf("zero,subnormal,inf,nan,min_exponent,max_exponent\n");
+  printf("%llu,%llu,%llu,%llu,", (unsigned long long)stats.zero,
+         (unsigned long long)stats.subnormal, (unsigned long long)stats.inf,
+         (unsigned long long)stats.nan);
+  if (analysis.minExponent <= analysis.maxExponent)
+    printf("%d,%d\n", analysis.minExponent, analysis.maxExponent);
+  else
+    printf(",\n");
+  printf("percent,exponent_bits,mantissa_bits,format\n");
+  for (double percent : opts.percents) {
+    Requirement r = analysis.require(percent);
+    printf("%g,%u,%u,mpfr(%u,%u)\n", r.percent, r.exponentBits, r.mantissaBits,
+           r.exponentBits, r.mantissaBits);
+  }
+
+  bool ok = true;
+  if (opts.histogram) {
+    if (FILE *out = openOutput(opts.histogram)) {
+      analysis.writeHistogram(out);
+      fclose(out);
+    } else {
+      ok = false;
+    }
+  }
+  if (opts.csv) {
+    if (FILE *out = openOutput(opts.csv)) {
+      analysis.writeCSV(out);
+      fclose(out);
+    } else {
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void usage() {
+  fprintf(stderr, "usage: raptor-log-analyze [-j <threads>] [-p <percent>]... "
+                  "[-t <type>]\n"
+                  "                          [-r <record bytes>] "
+                  "[-o <histogram>] [-c <csv>] <log>...\n");
+  exit(1);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options opts;
+  int opt;
+  while ((opt = getopt(argc, argv, "j:p:t:r:o:c:")) != -1) {
+    switch (opt) {
+    case 'j':
+      opts.threads = atoi(optarg);
+      break;
+    case 'p': {
+      double percent = atof(optarg);
+      if (percent <= 0 || percent > 100) {
+        fprintf(stderr, "raptor-log-analyze: invalid percentage '%s'\n",
+                optarg);
+        return 1;
+      }
+      opts.percents.push_back(percent);
+      break;
+    }
+    case 't':
+      opts.type = optarg;
+      break;
+    case 'r':
+      opts.recordSize = atoi(optarg);
+      break;
+    case 'o':
+      opts.histogram = optarg;
+      break;
+    case 'c':
+      opts.csv = optarg;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (optind == argc || ((opts.histogram || opts.csv) && argc - optind > 1))
+    usage();
+  if (opts.threads == 0)
+    opts.threads = std::max(std::thread::hardware_concurrency(), 1u);
+  if (opts.percents.empty())
+    opts.percents = {99, 99.9, 100};
+
+  bool ok = true;
+  for (int i = optind; i < argc; ++i)
+    ok &= analyze(argv[i], opts);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,338 @@
+//===- raptor-logd.cpp - Live consumer of shared memory flop logs ---------===//
+//
+//                             Raptor Project
+//
+// Part of the Raptor Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Reference consumer for the flop log rings written with RAPTOR_FLOP_LOG_SHM.
+// It attaches to one or more rings, waiting for the program to create them,
+// and keeps per type, per operation and per site statistics of the logged
+// values (count, zeros, subnormals, infinities, NaNs and the range of the
+// exponent) until the program closes all rings.
+//
+//   raptor-logd [-i <seconds>] [-o <report>] [-k] <ring>...
+//
+// A ring is given by its name in /dev/shm or by a path, e.g. run.double for
+// RAPTOR_FLOP_LOG_SHM=run. -i prints a summary every <seconds> while the
+// program runs, -o writes the final report to a file instead of stdout and -k
+// keeps the ring files, which are removed once consumed otherwise.
+//
+//===----------------------------------------------------------------------===//
+
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "raptor/LogFormat.h"
+#include "raptor/LogRing.h"
+
+namespace {
+
+volatile sig_atomic_t Interrupted = 0;
+
+struct ValueStats {
+  uint64_t count = 0;
+  uint64_t zero = 0;
+  uint64_t subnormal = 0;
+  uint64_t inf = 0;
+  uint64_t nan = 0;
+  // Range of the unbiased exponent of the normal values.
+  int minExp = INT32_MAX;
+  int maxExp = INT32_MIN;
+
+  void add(double value, bool isSubnormal) {
+    ++count;
+    if (std::isnan(value)) {
+      ++nan;
+    } else if (std::isinf(value)) {
+      ++inf;
+    } else if (value == 0) {
+      ++zero;
+    } else if (isSubnormal) {
+      ++subnormal;
+    } else {
+      int exp = std::ilogb(value);
+      minExp = std::min(minExp, exp);
+      maxExp = std::max(maxExp, exp);
+    }
+  }
+
+  void print(FILE *out) const {
+    fprintf(out, "%llu,%llu,%llu,%llu,%llu,", (unsigned long long)count,
+            (unsigned long long)zero, (unsigned long long)subnormal,
+            (unsigned long long)inf, (unsigned long long)nan);
+    if (minExp <= maxExp)
+      fprintf(out, "%d,%d", minExp, maxExp);
+    else
+      fprintf(out, ",");
+  }
+};
+
+// Widens a 16-bit value with the given number of exponent bits, half or
+// bfloat, without relying on compiler support for the types.
+double decode16(uint16_t bits, unsigned expBits, bool &isSubnormal) {
+  unsigned manBits = 15 - expBits;
+  int bias = (1 << (expBits - 1)) - 1;
+  unsigned exp = (bits >> manBits) & ((1u << expBits) - 1);
+  unsigned man = bits & ((1u << manBits) - 1);
+  double sign = bits >> 15 ? -1 : 1;
+  isSubnormal = exp == 0 && man != 0;
+  if (exp == (1u << expBits) - 1)
+    return man ? NAN : sign * INFINITY;
+  if (exp == 0)
+    return sign * std::ldexp(man, 1 - bias - (int)manBits);
+  return sign * std::ldexp(man | (1u << manBits), (int)exp - bias - (int)manBits);
+}
+
+struct RingTy {
+  std::string path;
+  __raptor_log_ring *ring = nullptr;
+  size_t mapSize = 0;
+  bool done = false;
+
+  ValueStats total;
+  std::map<uint8_t, ValueStats> ops;
+  std::map<uint32_t, ValueStats> sites;
+
+  // Maps the ring once the producer has initialized it.
+  bool attach() {
+    int fd = open(path.c_str(), O_RDWR);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        st.st_size < (off_t)RAPTOR_LOG_RING_DATA_OFFSET) {
+      close(fd);
+      return false;
+    }
+    void *map =
+        mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+      return false;
+    auto r = (__raptor_log_ring *)map;
+    if (__atomic_load_n(&r->magic, __ATOMIC_ACQUIRE) != RAPTOR_LOG_RING_MAGIC ||
+        (uint64_t)st.st_size < RAPTOR_LOG_RING_DATA_OFFSET + r->capacity) {
+      munmap(map, st.st_size);
+      return false;
+    }
+    if (r->version != RAPTOR_LOG_RING_VERSION) {
+      fprintf(stderr, "raptor-logd: %s: unsupported ring version %u\n",
+              path.c_str(), r->version);
+      munmap(map, st.st_size);
+      done = true;
+      return false;
+    }
+    ring = r;
+    mapSize = st.st_size;
+    return true;
+  }
+
+  void record(const char *data) {
+    double value;
+    bool isSubnormal;
+    if (strcmp(ring->type, "double") == 0) {
+      double d;
+      memcpy(&d, data, sizeof(d));
+      value = d;
+      isSubnormal = std::fpclassify(d) == FP_SUBNORMAL;
+    } else if (strcmp(ring->type, "float") == 0) {
+      float f;
+      memcpy(&f, data, sizeof(f));
+      value = f;
+      isSubnormal = std::fpclassify(f) == FP_SUBNORMAL;
+    } else if (strcmp(ring->type, "half") == 0 ||
+               strcmp(ring->type, "bfloat") == 0) {
+      uint16_t bits;
+      memcpy(&bits, data, sizeof(bits));
+      value = decode16(bits, ring->type[0] == 'h' ? 5 : 8, isSubnormal);
+    } else {
+      fprintf(stderr, "raptor-logd: %s: unsupported type '%s'\n",
+              path.c_str(), ring->type);
+      done = true;
+      return;
+    }
+    total.add(value, isSubnormal);
+    if (!ring->sites)
+      return;
+    // The metadata follows the value in every __raptor_log_record_.
+    uint32_t site;
+    memcpy(&site, data + ring->record_size - 8, sizeof(site));
+    uint8_t op = data[ring->record_size - 4];
+    ops[op].add(value, isSubnormal);
+    sites[site].add(value, isSubnormal);
+  }
+
+  // Consumes everything available, returns the number of records read.
+  uint64_t poll() {
+    if (done || (!ring && !attach()))
+      return 0;
+    const char *base = (const char *)ring + RAPTOR_LOG_RING_DATA_OFFSET;
+    // Read closed before head, so we do not miss data written before closing.
+    bool closed = __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE);
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = ring->tail;
+    uint64_t n = (head - tail) / ring->record_size;
+    for (; tail != head && !done; tail += ring->record_size)
+      record(base + tail % ring->capacity);
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    if (closed)
+      done = true;
+    return n;
+  }
+
+  std::map<uint32_t, std::string> readSites() {
+    std::map<uint32_t, std::string> res;
+    FILE *in = fopen((path + ".sites").c_str(), "r");
+    if (!in)
+      return res;
+    char line[4096];
+    while (fgets(line, sizeof(line), in)) {
+      if (line[0] == '#')
+        continue;
+      char *tab = strchr(line, '\t');
+      if (!tab)
+        continue;
+      line[strcspn(line, "\n")] = '\0';
+      res[strtoul(line, nullptr, 10)] = tab + 1;
+    }
+    fclose(in);
+    return res;
+  }
+
+  void print(FILE *out, bool final) {
+    if (!ring)
+      return;
+    const char *columns =
+        "records,zero,subnormal,inf,nan,min_exponent,max_exponent";
+    fprintf(out, "# %s: %s, dropped %llu\n", path.c_str(), ring->type,
+            (unsigned long long)__atomic_load_n(&ring->dropped,
+                                                __ATOMIC_RELAXED));
+    fprintf(out, "type,%s\n%s,", columns, ring->type);
+    total.print(out);
+    fprintf(out, "\n");
+    if (!ring->sites)
+      return;
+    fprintf(out, "op,%s\n", columns);
+    for (auto &it : ops) {
+      fprintf(out, "%s,", it.first < __raptor_log_num_ops
+                              ? __raptor_log_op_names[it.first]
+                              : "invalid");
+      it.second.print(out);
+      fprintf(out, "\n");
+    }
+    // The site table is only written when the log is closed.
+    auto names = final ? readSites() : std::map<uint32_t, std::string>();
+    fprintf(out, "site,location,%s\n", columns);
+    for (auto &it : sites) {
+      auto name = names.find(it.first);
+      fprintf(out, "%u,\"%s\",", it.first,
+              name != names.end() ? name->second.c_str() : "");
+      it.second.print(out);
+      fprintf(out, "\n");
+    }
+  }
+
+  void detach(bool keep) {
+    if (ring)
+      munmap(ring, mapSize);
+    ring = nullptr;
+    if (!keep) {
+      unlink(path.c_str());
+      unlink((path + ".sites").c_str());
+    }
+  }
+};
+
+void usage() {
+  fprintf(stderr,
+          "usage: raptor-logd [-i <seconds>] [-o <report>] [-k] <ring>...\n");
+  exit(1);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  double interval = 0;
+  const char *report = nullptr;
+  bool keep = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "i:o:k")) != -1) {
+    switch (opt) {
+    case 'i':
+      interval = atof(optarg);
+      break;
+    case 'o':
+      report = optarg;
+      break;
+    case 'k':
+      keep = true;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (optind == argc)
+    usage();
+
+  std::vector<RingTy> rings(argc - optind);
+  for (int i = optind; i < argc; ++i)
+    rings[i - optind].path = strchr(argv[i], '/')
+                                 ? std::string(argv[i])
+                                 : std::string("/dev/shm/") + argv[i];
+
+  signal(SIGINT, [](int) { Interrupted = 1; });
+  signal(SIGTERM, [](int) { Interrupted = 1; });
+
+  auto lastPrint = std::chrono::steady_clock::now();
+  while (!Interrupted) {
+    uint64_t n = 0;
+    bool allDone = true;
+    for (auto &ring : rings) {
+      n += ring.poll();
+      allDone &= ring.done;
+    }
+    if (allDone)
+      break;
+    auto now = std::chrono::steady_clock::now();
+    if (interval > 0 &&
+        std::chrono::duration<double>(now - lastPrint).count() >= interval) {
+      for (auto &ring : rings)
+        ring.print(stdout, false);
+      fflush(stdout);
+      lastPrint = now;
+    }
+    if (!n)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  FILE *out = stdout;
+  if (report && !(out = fopen(report, "w"))) {
+    fprintf(stderr, "raptor-logd: could not open report '%s'\n", report);
+    out = stdout;
+  }
+  for (auto &ring : rings) {
+    ring.print(out, true);
+    // Leave the rings of a still running program alone.
+    ring.detach(keep || !ring.done);
+  }
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
@@ -0,0 +1,271 @@
+//===- raptor-trace-sweep.cpp - Sensitivity sweep over spilled tapes ------===//
+//
+//                             Raptor Project
+//
+// Part of the Raptor Project, under the Apache License v2.0 with LLVM
+// Exceptions. See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Ranks the sites of a tape spilled by Raptor-RT-Trace (RAPTOR_TRACE_SPILL) by
+// how much truncating their ops to float perturbs the outputs, like
+// __raptor_fprt_delete_all does for tapes that fit in memory.
+//
+//   raptor-trace-sweep [-n <top>] <trace>
+//
+// The segments are read back one at a time from the last to the first, so
+// besides one segment only the adjoints, 8 bytes per node, are held in memory.
+// -n is the number of sites to report, 0 for all, default 10.
+//
+//===----------------------------------------------------------------------===//
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "raptor/TraceFormat.h"
+
+namespace {
+
+struct Site {
+  std::string name;
+  std::string loc;
+  uint64_t count = 0;
+  double sensitivity = 0;
+  double max = 0;
+};
+
+struct Trace {
+  const char *path;
+  int fd = -1;
+  bool floats = false;
+  __raptor_trace_trailer trailer;
+  std::vector<uint64_t> segmentOffsets;
+  std::vector<uint32_t> outputs;
+  std::vector<Site> sites;
+
+  ~Trace() {
+    if (fd >= 0)
+      close(fd);
+  }
+};
+
+bool readAt(const Trace &trace, void *data, size_t size, uint64_t offset) {
+  auto *p = (char *)data;
+  while (size) {
+    ssize_t n = pread(trace.fd, p, size, offset);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      fprintf(stderr, "raptor-trace-sweep: could not read '%s': %s\n",
+              trace.path, n < 0 ? strerror(errno) : "unexpected end of file");
+      return false;
+    }
+    p += n;
+    size -= n;
+    offset += n;
+  }
+  return true;
+}
+
+bool corrupt(const Trace &trace, const char *what) {
+  fprintf(stderr, "raptor-trace-sweep: '%s' is not a complete trace: %s\n",
+          trace.path, what);
+  return false;
+}
+
+bool openTrace(Trace &trace) {
+  trace.fd = open(trace.path, O_RDONLY);
+  struct stat st;
+  if (trace.fd < 0 || fstat(trace.fd, &st)) {
+    fprintf(stderr, "raptor-trace-sweep: could not open '%s': %s\n",
+            trace.path, strerror(errno));
+    return false;
+  }
+
+  __raptor_trace_file_header header;
+  if ((uint64_t)st.st_size < sizeof(header) + sizeof(trace.trailer))
+    return corrupt(trace, "too short");
+  if (!readAt(trace, &header, sizeof(header), 0))
+    return false;
+  if (memcmp(header.magic, RAPTOR_TRACE_MAGIC, sizeof(header.magic)))
+    return corrupt(trace, "bad magic");
+  if (header.version != RAPTOR_TRACE_VERSION)
+    return corrupt(trace, "unsupported version");
+  trace.floats = header.flags & __raptor_trace_float;
+
+  uint64_t trailerOffset = st.st_size - sizeof(trace.trailer);
+  if (!readAt(trace, &trace.trailer, sizeof(trace.trailer), trailerOffset))
+    return false;
+  if (memcmp(trace.trailer.magic, RAPTOR_TRACE_MAGIC,
+             sizeof(trace.trailer.magic)) ||
+      trace.trailer.index_offset > trailerOffset)
+    return corrupt(trace, "no index, was the program interrupted?");
+
+  std::vector<uint8_t> index(trailerOffset - trace.trailer.index_offset);
+  if (!readAt(trace, index.data(), index.size(), trace.trailer.index_offset))
+    return false;
+  const uint8_t *p = index.data(), *end = p + index.size();
+  auto take = [&](void *data, size_t size) {
+    if ((size_t)(end - p) < size)
+      return false;
+    memcpy(data, p, size);
+    p += size;
+    return true;
+  };
+  trace.segmentOffsets.resize(trace.trailer.num_segments);
+  trace.outputs.resize(trace.trailer.num_outputs);
+  trace.sites.resize(trace.trailer.num_sites);
+  bool ok = take(trace.segmentOffsets.data(),
+                 sizeof(uint64_t) * trace.segmentOffsets.size()) &&
+            take(trace.outputs.data(), sizeof(uint32_t) * trace.outputs.size());
+  for (Site &site : trace.sites) {
+    for (std::string *str : {&site.name, &site.loc}) {
+      uint32_t length;
+      ok = ok && take(&length, sizeof(length)) && (size_t)(end - p) >= length;
+      if (ok) {
+        str->assign((const char *)p, length);
+        p += length;
+      }
+    }
+  }
+  if (!ok)
+    return corrupt(trace, "truncated index");
+  for (uint32_t o : trace.outputs)
+    if (o >= trace.trailer.num_nodes)
+      return corrupt(trace, "output out of range");
+  return true;
+}
+
+// Same estimate as the runtime: the error of rounding the result to float.
+double truncationError(double a) { return std::fabs(a - (float)a); }
+
+bool sweep(Trace &trace) {
+  std::vector<double> adjoints(trace.trailer.num_nodes);
+  for (uint32_t o : trace.outputs)
+    adjoints[o] = 1;
+
+  std::vector<uint8_t> buffer;
+  std::vector<__raptor_trace_node> nodes;
+  for (size_t s = trace.segmentOffsets.size(); s-- > 0;) {
+    if (s > 0)
+      posix_fadvise(trace.fd, trace.segmentOffsets[s - 1],
+                    trace.segmentOffsets[s] - trace.segmentOffsets[s - 1],
+                    POSIX_FADV_WILLNEED);
+
+    __raptor_trace_segment_header header;
+    if (!readAt(trace, &header, sizeof(header), trace.segmentOffsets[s]))
+      return false;
+    if (header.magic != RAPTOR_TRACE_SEGMENT_MAGIC ||
+        (uint64_t)header.first_id + header.num_nodes >
+            trace.trailer.num_nodes ||
+        header.bytes > (uint64_t)header.num_nodes *
+                           __raptor_trace_max_node_bytes)
+      return corrupt(trace, "bad segment");
+    buffer.resize(header.bytes + __raptor_trace_max_node_bytes);
+    if (!readAt(trace, buffer.data(), header.bytes,
+                trace.segmentOffsets[s] + sizeof(header)))
+      return false;
+
+    nodes.resize(header.num_nodes);
+    const uint8_t *p = buffer.data();
+    uint32_t prevSite = 0;
+    for (uint32_t i = 0; i < header.num_nodes; i++) {
+      p = __raptor_trace_decode(p, header.first_id + i, nodes[i], prevSite,
+                                trace.floats);
+      if (nodes[i].site >= trace.sites.size())
+        return corrupt(trace, "site out of range");
+      for (unsigned k = 0; k < nodes[i].input_num; k++)
+        if (nodes[i].inputs[k] >= header.first_id + i)
+          return corrupt(trace, "input out of range");
+    }
+    if (p != buffer.data() + header.bytes)
+      return corrupt(trace, "bad segment");
+
+    // Users always come after their inputs, so the adjoint of a node is
+    // complete once the nodes after it were visited.
+    for (uint32_t i = header.num_nodes; i-- > 0;) {
+      const __raptor_trace_node &node = nodes[i];
+      double a = adjoints[header.first_id + i];
+      if (!(node.flags & (__raptor_trace_input | __raptor_trace_const))) {
+        Site &site = trace.sites[node.site];
+        double sensitivity = truncationError(node.result) * a;
+        site.count++;
+        site.sensitivity += sensitivity;
+        site.max = std::max(site.max, sensitivity);
+      }
+      if (a == 0)
+        continue;
+      for (unsigned k = 0; k < node.input_num; k++)
+        adjoints[node.inputs[k]] += std::fabs(node.derivatives[k]) * a;
+    }
+  }
+  return true;
+}
+
+void report(const Trace &trace, size_t top) {
+  std::vector<size_t> order;
+  uint64_t ops = 0;
+  for (size_t s = 0; s < trace.sites.size(); s++) {
+    if (!trace.sites[s].count)
+      continue;
+    order.push_back(s);
+    ops += trace.sites[s].count;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return trace.sites[a].sensitivity > trace.sites[b].sensitivity;
+  });
+  if (top == 0 || top > order.size())
+    top = order.size();
+
+  printf("sensitivity of %zu outputs to truncating %llu ops from double to "
+         "float, top %zu of %zu sites\n",
+         trace.outputs.size(), (unsigned long long)ops, top, order.size());
+  printf("rank sensitivity max ops op location\n");
+  for (size_t r = 0; r < top; r++) {
+    const Site &site = trace.sites[order[r]];
+    printf("%zu %e %e %llu %s at %s\n", r + 1, site.sensitivity, site.max,
+           (unsigned long long)site.count, site.name.c_str(),
+           site.loc.c_str());
+  }
+}
+
+void usage() {
+  fprintf(stderr, "usage: raptor-trace-sweep [-n <top>] <trace>\n");
+  exit(1);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t top = 10;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    switch (opt) {
+    case 'n':
+      top = strtoull(optarg, nullptr, 10);
+      break;
+    default:
+      usage();
+    }
+  }
+  if (argc - optind != 1)
+    usage();
+
+  Trace trace;
+  trace.path = argv[optind];
+  if (!openTrace(trace) || !sweep(trace))
+    return 1;
+  report(trace, top);
+  return 0;
+}